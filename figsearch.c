@@ -1,41 +1,207 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <assert.h>
 #include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "figsearch.h"
 
 /* =========================================
  *                Constants
  * ========================================= */
 
-#define ERR_NONE                (0)
-#define ERR_ALLOCATION_FAILURE  (0x00FA75E5)
-#define ERR_INTERNAL            (0x000000B5)
-#define ERR_INVALID_NUMBER_ARGS (0xB16B00B5)
-#define ERR_INVALID_COMMAND     (0xBAADF00D)
-#define ERR_INVALID_BITMAP_FILE (0x8BADF00D)
-#define ERR_INVALID_DIMENSION   (0xABADBABE)
-
 #define PXL_FILLED ('1')
 #define PXL_EMPTY  ('0')
+static_assert((PXL_FILLED & 1) == 1 && (PXL_EMPTY & 1) == 0,
+              "pixels are packed by their lowest bit @see bmp_row_pack");
 
-#define CMD_MAX_ARGS (3)
 #define CMD_MIN_ARGS (2)
 
-#define COORD_INVALID (UINT32_MAX)
-
 #define BMP_LOADER_READ_CHUNK_SIZE (512)
+/** @brief text bitmap files up to this size are loaded without the heap and
+ * stdio @see bmp_tiny_load */
+#define BMP_TINY_MAX_SIZE (4096)
+/** @brief chunk size of raw (P5) samples read at once; kept larger than the
+ * text chunk so the threshold loop runs over long contiguous blocks */
+#define BMP_LOADER_PGM_CHUNK_SIZE (4096)
+/** @brief marks that no threshold was requested and the PGM's default (half of
+ * its maximal gray value) should be used */
+#define BMP_LOADER_THRESHOLD_DEFAULT (UINT32_MAX)
+
+#define PGM_MAGIC          ('P')
+#define PGM_MAGIC_ASCII    ('2')
+#define PGM_MAGIC_BINARY   ('5')
+#define PGM_MAX_GRAY_VALUE (65535)
+
+/** @brief first word of a mosaic manifest */
+#define MOSAIC_MAGIC ("mosaic")
+
+/* =========================================
+ *                  Memory
+ * ========================================= */
+
+/** @brief stages of a command which allocations are accounted to */
+typedef enum MemPhase {
+    MEM_PHASE_SETUP = 0,
+    MEM_PHASE_LOAD,
+    MEM_PHASE_SEARCH,
+    MEM_PHASE_COUNT
+} MemPhase;
+
+/** @brief allocation counters of a single phase */
+typedef struct MemPhaseStats {
+    atomic_uint_least64_t allocations;
+    atomic_uint_least64_t bytes;
+    /** @brief most bytes live (allocated by any phase) while the phase
+     * allocated */
+    atomic_uint_least64_t peak;
+    atomic_uint_least64_t largest;
+} MemPhaseStats;
+
+/** @brief prefix of every block which remembers its size, it keeps the
+ * alignment of the block malloc returned */
+typedef union MemHeader {
+    size_t      size;
+    max_align_t align;
+} MemHeader;
+
+static MemPhaseStats         mem_stats[MEM_PHASE_COUNT];
+static atomic_uint_least64_t mem_live;
+/** @brief phase of the calling thread @see parallel_for */
+static _Thread_local MemPhase mem_phase = MEM_PHASE_SETUP;
+/** @brief bytes allocated minus bytes released by the calling thread and the
+ * parallel_for slices it joined @see parallel_for */
+static _Thread_local int64_t mem_thread_net;
+
+static inline void mem_phase_enter(MemPhase phase) { mem_phase = phase; }
+
+static inline MemPhase mem_phase_current(void) { return mem_phase; }
+
+static void mem_atomic_max(atomic_uint_least64_t *value, uint64_t candidate) {
+    uint_least64_t current = atomic_load_explicit(value, memory_order_relaxed);
+    while (current < candidate &&
+           !atomic_compare_exchange_weak_explicit(value, &current, candidate,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+}
+
+/** @brief accounts allocation of `size` bytes to the thread's phase,
+ * `released` bytes of a reallocated block stop being live */
+static void mem_account(size_t size, size_t released) {
+    MemPhaseStats *stats = &mem_stats[mem_phase];
+    atomic_fetch_add_explicit(&stats->allocations, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->bytes, size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&mem_live, released, memory_order_relaxed);
+    mem_thread_net += (int64_t)size - (int64_t)released;
+    const uint64_t live =
+        atomic_fetch_add_explicit(&mem_live, size, memory_order_relaxed) +
+        size;
+    mem_atomic_max(&stats->peak, live);
+    mem_atomic_max(&stats->largest, size);
+}
+
+/** @brief malloc which accounts the allocation @see MemPhaseStats
+ * @note blocks have to be released by mem_free (or mem_realloc) */
+static void *mem_malloc(size_t size) {
+    if (size > SIZE_MAX - sizeof(MemHeader)) {
+        return NULL;
+    }
+    MemHeader *header = malloc(sizeof(MemHeader) + size);
+    if (header == NULL) {
+        return NULL;
+    }
+    header->size = size;
+    mem_account(size, 0);
+    return header + 1;
+}
+
+static void *mem_calloc(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    void *block = mem_malloc(count * size);
+    if (block != NULL) {
+        memset(block, 0, count * size);
+    }
+    return block;
+}
+
+static void *mem_realloc(void *block, size_t size) {
+    if (block == NULL) {
+        return mem_malloc(size);
+    }
+    if (size > SIZE_MAX - sizeof(MemHeader)) {
+        return NULL;
+    }
+    MemHeader   *header = (MemHeader *)block - 1;
+    const size_t released = header->size;
+    header = realloc(header, sizeof(MemHeader) + size);
+    if (header == NULL) {
+        return NULL;
+    }
+    header->size = size;
+    mem_account(size, released);
+    return header + 1;
+}
+
+static void mem_free(void *block) {
+    if (block == NULL) {
+        return;
+    }
+    MemHeader *header = (MemHeader *)block - 1;
+    atomic_fetch_sub_explicit(&mem_live, header->size, memory_order_relaxed);
+    mem_thread_net -= (int64_t)header->size;
+    free(header);
+}
+
+#ifndef FIGSEARCH_NO_MAIN
+
+static const char *const MEM_PHASE_NAMES[MEM_PHASE_COUNT] = {"setup", "load",
+                                                             "search"};
+
+/** @brief prints allocation counters of every phase which allocated */
+static void mem_print_stats(FILE *diag) {
+    for (size_t i = 0; i < MEM_PHASE_COUNT; i++) {
+        const MemPhaseStats *stats = &mem_stats[i];
+        const uint64_t       allocations = atomic_load(&stats->allocations);
+        if (allocations == 0) {
+            continue;
+        }
+        fprintf(diag,
+                "memory: %s %" PRIu64 " allocations, %" PRIu64
+                " bytes, peak %" PRIu64 " bytes live, largest %" PRIu64
+                " bytes\n",
+                MEM_PHASE_NAMES[i], allocations,
+                (uint64_t)atomic_load(&stats->bytes),
+                (uint64_t)atomic_load(&stats->peak),
+                (uint64_t)atomic_load(&stats->largest));
+    }
+}
+
+#endif /* FIGSEARCH_NO_MAIN */
 
 /* =========================================
  *                  Error
  * ========================================= */
 
-typedef int ErrorNum;
 typedef struct Error {
     ErrorNum code;
     char    *msg;
@@ -55,7 +221,7 @@ static Error error_ctor(ErrorNum err, const char *fmt, ...) {
     va_end(fmt_args);
     va_start(fmt_args, fmt);
 
-    char *err_msg = calloc(size, sizeof(char));
+    char *err_msg = mem_calloc(size, sizeof(char));
     if (err_msg == NULL) {
         /* note: since we cannot allocate, we cannot really create the message
          * and pass it through the call stack */
@@ -83,13 +249,101 @@ static inline void error_print(Error err) { fprintf(stderr, "%s\n", err.msg); }
 static ErrorNum error_dtor(Error *err) {
     ErrorNum err_code = err->code;
     if (err->msg != NULL) {
-        free(err->msg);
+        mem_free(err->msg);
         err->msg = NULL;
         err->code = ERR_NONE;
     }
     return err_code;
 }
 
+/* =========================================
+ *                 Parallel
+ * ========================================= */
+
+/** @brief upper bound of worker threads spawned by parallel_for */
+#define PARALLEL_MAX_THREADS (64)
+
+/** @brief processes items [begin, end) of a parallel_for */
+typedef void (*ParallelTask)(void *arg, uint32_t begin, uint32_t end);
+
+/** @brief part of the work of parallel_for handed to a single thread */
+typedef struct ParallelSlice {
+    ParallelTask task;
+    void        *arg;
+    uint32_t     begin;
+    uint32_t     end;
+    /** @brief allocations of the slice are accounted to the caller's phase */
+    MemPhase phase;
+    /** @brief bytes the slice left allocated @see mem_thread_net */
+    int64_t net;
+} ParallelSlice;
+
+static void *parallel_slice_run(void *slice) {
+    ParallelSlice *s = slice;
+    mem_phase_enter(s->phase);
+    const int64_t base = mem_thread_net;
+    s->task(s->arg, s->begin, s->end);
+    s->net = mem_thread_net - base;
+    return NULL;
+}
+
+/** @return number of threads worth spawning on this machine */
+static uint32_t parallel_thread_count(void) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online < 1) {
+        return 1;
+    }
+    return online > PARALLEL_MAX_THREADS ? PARALLEL_MAX_THREADS
+                                         : (uint32_t)online;
+}
+
+/**
+ * @brief splits items [0, count) into contiguous slices and runs `task` over
+ * them in parallel, returns once all slices are done
+ * @param min_slice minimal number of items worth a separate thread
+ * @note falls back to running the slice on the calling thread when a thread
+ * cannot be spawned, so the work is always done */
+static void parallel_for(uint32_t count, uint32_t min_slice, ParallelTask task,
+                         void *arg) {
+    uint32_t threads = parallel_thread_count();
+    if (min_slice == 0) {
+        min_slice = 1;
+    }
+    if (threads > count / min_slice) {
+        threads = count / min_slice;
+    }
+    if (threads <= 1) {
+        task(arg, 0, count);
+        return;
+    }
+    ParallelSlice slices[PARALLEL_MAX_THREADS];
+    pthread_t     handles[PARALLEL_MAX_THREADS];
+    bool          spawned[PARALLEL_MAX_THREADS] = {0};
+    for (uint32_t i = 0; i < threads; i++) {
+        slices[i] = (ParallelSlice){
+            .task = task,
+            .arg = arg,
+            .begin = (uint32_t)((uint64_t)count * i / threads),
+            .end = (uint32_t)((uint64_t)count * (i + 1) / threads),
+            .phase = mem_phase_current(),
+        };
+    }
+    /* the calling thread takes the first slice itself */
+    for (uint32_t i = 1; i < threads; i++) {
+        spawned[i] = pthread_create(&handles[i], NULL, parallel_slice_run,
+                                    &slices[i]) == 0;
+    }
+    parallel_slice_run(&slices[0]);
+    for (uint32_t i = 1; i < threads; i++) {
+        if (spawned[i]) {
+            pthread_join(handles[i], NULL);
+            mem_thread_net += slices[i].net;
+        } else {
+            parallel_slice_run(&slices[i]);
+        }
+    }
+}
+
 /* =========================================
  *                  Bitmap
  * ========================================= */
@@ -102,12 +356,49 @@ typedef struct BitmapSize {
 typedef char   Pixel;
 typedef Pixel *BitmapData;
 
+/** @brief marks a bound which has not been determined yet */
+#define BMP_BOUND_UNKNOWN (UINT32_MAX)
+
+/** @brief exact sizes of shapes found by the finished searches, every
+ * following search on the same bitmap may use them to prune its search space
+ * @note 0 stands for "no such shape", BMP_BOUND_UNKNOWN for "not searched" */
+typedef struct BitmapBounds {
+    /** @brief length of the longest horizontal line */
+    uint32_t hline;
+    /** @brief length of the longest vertical line */
+    uint32_t vline;
+    /** @brief side length of the largest square */
+    uint32_t square;
+} BitmapBounds;
+
+/** @brief structures derived from bitmap data, each of them is built on its
+ * first use and shared by all of the following searches on the bitmap
+ * @note the cache is not synchronized, a bitmap must be searched by one
+ * thread at a time */
+typedef struct BitmapCache {
+    struct RowStore        *row_store;
+    struct TiledBitmap     *tiled;
+    struct SummedAreaTable *sat;
+    struct RunArrays       *runs;
+    struct Pyramid         *pyramid;
+    struct Complement      *complement;
+    struct PackedRows      *packed;
+    struct FusedLines      *fused;
+    struct CornerMasks     *corners;
+    BitmapBounds            bounds;
+    /** @brief the bitmap has too few empty rows for the pyramid to be built
+     * @see pyramid_worthwhile */
+    bool pyramid_rejected;
+} BitmapCache;
+
 /** @brief representation of "bitmap" file */
 typedef struct Bitmap {
     BitmapSize dimensions;
     /** @note whole bitmap is stored linearly, in order to receive the
      * appropriate linear size of this buffer @see bmp_size_raw */
     BitmapData data;
+    /** @brief lazily built derived structures @see BitmapCache */
+    BitmapCache *cache;
 } Bitmap;
 
 /** @brief loader is used for loading bitmap and validating bitmap files, to
@@ -119,6 +410,9 @@ typedef struct BitmapLoader {
     const char *file_name;
     /** @brief holds the current number of pixels stored in staging buffer */
     size_t size;
+    /** @brief gray value from which PGM samples are considered PXL_FILLED
+     * @see BMP_LOADER_THRESHOLD_DEFAULT */
+    uint32_t threshold;
 } BitmapLoader;
 
 /**
@@ -132,39 +426,81 @@ static inline size_t bmp_size_raw(BitmapSize dimension) {
  * @return ERR_NONE when out_bmp was successfully populated */
 static Error bmp_ctor(BitmapSize dimensions, Bitmap *out_bmp) {
     out_bmp->dimensions = dimensions;
-    out_bmp->data = malloc(sizeof(Pixel) * bmp_size_raw(dimensions) + 1);
-    if (out_bmp->data == NULL) {
+    out_bmp->data = mem_malloc(sizeof(Pixel) * bmp_size_raw(dimensions) + 1);
+    out_bmp->cache = mem_malloc(sizeof(BitmapCache));
+    if (out_bmp->data == NULL || out_bmp->cache == NULL) {
+        mem_free(out_bmp->data);
+        mem_free(out_bmp->cache);
+        out_bmp->data = NULL;
+        out_bmp->cache = NULL;
         return error_ctor(ERR_ALLOCATION_FAILURE,
                           "Failed to allocate bitmap data buffer!\n");
     }
+    *out_bmp->cache = (BitmapCache){
+        .bounds = {BMP_BOUND_UNKNOWN, BMP_BOUND_UNKNOWN, BMP_BOUND_UNKNOWN},
+    };
     return error_none();
 }
 
 #define bmp_at(bmp, row, col) (bmp)->data[row * (bmp)->dimensions.width + col]
 
+/** @brief releases all of the cached structures
+ * @note defined once all of the cached structures are known */
+static void bmp_cache_dtor(BitmapCache *cache);
+
 /**
  * @brief destructs given bitmap if it is populated with data */
 static void bmp_dtor(Bitmap *bmp) {
+    if (bmp->cache != NULL) {
+        bmp_cache_dtor(bmp->cache);
+        mem_free(bmp->cache);
+        bmp->cache = NULL;
+    }
     if (bmp->data != NULL) {
-        free(bmp->data);
+        mem_free(bmp->data);
+        bmp->data = NULL;
         bmp->dimensions = (BitmapSize){0};
     }
 }
 
+/** @return upper bound of the largest square side (a square side can be
+ * neither longer than the longest hline nor than the longest vline) */
+static inline uint32_t bmp_bound_square_upper(const Bitmap *bmp) {
+    const BitmapBounds *bounds = &bmp->cache->bounds;
+    if (bounds->square != BMP_BOUND_UNKNOWN) {
+        return bounds->square;
+    }
+    return bounds->hline < bounds->vline ? bounds->hline : bounds->vline;
+}
+
+/** @return lower bound of the longest line length, `known_length` is the
+ * exact length (if already searched), any line is at least as long as the
+ * side of the largest square */
+static inline uint32_t bmp_bound_line_lower(const Bitmap *bmp,
+                                            uint32_t      known_length) {
+    if (known_length != BMP_BOUND_UNKNOWN) {
+        return known_length;
+    }
+    const uint32_t square = bmp->cache->bounds.square;
+    return square != BMP_BOUND_UNKNOWN ? square : 0;
+}
+
 /** @brief creates default bitmap loader */
 static inline BitmapLoader bmp_loader_ctor(const char *file_name) {
     return (BitmapLoader){
         .staging.dimensions = (BitmapSize){0},
         .staging.data = NULL,
+        .staging.cache = NULL,
         .size = 0,
         .file_name = file_name,
+        .threshold = BMP_LOADER_THRESHOLD_DEFAULT,
     };
 }
 
 /** @brief destroys bitmap loader */
 static void bmp_loader_dtor(BitmapLoader *restrict loader) {
     if (loader->staging.data != NULL) {
-        free(loader->staging.data);
+        bmp_dtor(&loader->staging);
         loader->size = 0;
         loader->file_name = NULL;
     }
@@ -267,31 +603,249 @@ static inline Error bmp_loader_load_size(FILE *file, BitmapSize *out_size) {
 }
 
 /**
- * @brief loads a bitmap into the staging buffer
- * @note ensure the loader has a unique staging buffer to avoid violations */
-static Error bmp_loader_load(BitmapLoader *restrict loader) {
-    /* try to open bitmap */
-    FILE *file = fopen(loader->file_name, "r");
-    if (file == NULL) {
-        return error_ctor(ERR_INVALID_BITMAP_FILE,
-                          "Failed to open file [%s]! Os error: %s\n",
-                          loader->file_name, strerror(errno));
-    }
+ * @brief loads bitmap stored in the figsearch text format (header followed by
+ * '0'/'1' pixels) into the staging buffer
+ * @note expects the file pointer to be at the beginning of the header */
+static Error bmp_loader_load_text(FILE *file, BitmapLoader *restrict loader) {
     /* load the data size from file */
     BitmapSize size = {0};
     Error      err = bmp_loader_load_size(file, &size);
     if (err.code != ERR_NONE) {
-        fclose(file);
         return err;
     }
     /* allocate (blank) staging buffer for bitmap */
     err = bmp_ctor(size, &loader->staging);
     if (err.code != ERR_NONE) {
-        fclose(file);
         return err;
     }
     /* filter whitespace from file and write to the staging buffer */
-    err = bmp_loader_ignore_whitespace(file, loader);
+    return bmp_loader_ignore_whitespace(file, loader);
+}
+
+/**
+ * @brief loads single decimal value of PGM header (or P2 raster), skipping
+ * leading whitespace and '#' comments
+ * @note the single delimiter following the value is consumed as well, which
+ * is exactly what P5 requires after the maximal gray value
+ * @return error_none when loaded successfully, otherwise Error::code > 0 */
+static Error bmp_loader_pgm_load_value(FILE *file, uint32_t *out_value) {
+    int c = fgetc(file);
+    /* skip whitespace and comments (comment spans until the end of line) */
+    for (; c != EOF; c = fgetc(file)) {
+        if (c == '#') {
+            while (c != EOF && c != '\n') {
+                c = fgetc(file);
+            }
+            continue;
+        }
+        if (!bmp_valid_whitespace((char)c)) {
+            break;
+        }
+    }
+    if (c == EOF || !isdigit(c)) {
+        return error_ctor(ERR_INVALID_BITMAP_FILE,
+                          "Expected a numeric PGM value but found: '%c'",
+                          c == EOF ? ' ' : c);
+    }
+    uint32_t value = 0;
+    for (; c != EOF && isdigit(c); c = fgetc(file)) {
+        if (value > (UINT32_MAX - 9) / 10) {
+            return error_ctor(ERR_INVALID_BITMAP_FILE,
+                              "PGM value out of range!");
+        }
+        value = value * 10 + (uint32_t)(c - '0');
+    }
+    if (c != EOF && !bmp_valid_whitespace((char)c)) {
+        return error_ctor(ERR_INVALID_BITMAP_FILE,
+                          "Unexpected character encountered: '%c'", c);
+    }
+    *out_value = value;
+    return error_none();
+}
+
+/**
+ * @brief thresholds 8-bit gray samples directly into pixels
+ * @note the loop is branch-free on purpose, so the compiler turns it into a
+ * vector compare (one byte per lane) */
+static inline void bmp_threshold_u8(const uint8_t *restrict samples,
+                                    Pixel *restrict out, size_t count,
+                                    uint8_t threshold) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = (Pixel)(PXL_EMPTY + (samples[i] >= threshold));
+    }
+}
+
+/** @brief 16-bit (big-endian) variant of bmp_threshold_u8 */
+static inline void bmp_threshold_u16(const uint8_t *restrict samples,
+                                     Pixel *restrict out, size_t count,
+                                     uint32_t threshold) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t value = ((uint32_t)samples[2 * i] << 8) | samples[2 * i + 1];
+        out[i] = (Pixel)(PXL_EMPTY + (value >= threshold));
+    }
+}
+
+/**
+ * @brief reads raw (P5) raster and thresholds it straight into the staging
+ * buffer
+ * @return error when the raster does not match the header size */
+static Error bmp_loader_pgm_load_binary(FILE *file,
+                                        BitmapLoader *restrict loader,
+                                        uint32_t max_value,
+                                        uint32_t threshold) {
+    const size_t sample_size = max_value > UINT8_MAX ? 2 : 1;
+    const size_t expected = bmp_size_raw(loader->staging.dimensions);
+    uint8_t      buffer[BMP_LOADER_PGM_CHUNK_SIZE];
+    while (loader->size < expected) {
+        size_t count = sizeof(buffer) / sample_size;
+        if (count > expected - loader->size) {
+            count = expected - loader->size;
+        }
+        size_t read = fread(buffer, sample_size, count, file);
+        if (read == 0) {
+            break;
+        }
+        Pixel *out = loader->staging.data + loader->size;
+        if (sample_size == 1) {
+            /* threshold above any 8-bit sample means no filled pixel */
+            if (threshold > UINT8_MAX) {
+                memset(out, PXL_EMPTY, read);
+            } else {
+                bmp_threshold_u8(buffer, out, read, (uint8_t)threshold);
+            }
+        } else {
+            bmp_threshold_u16(buffer, out, read, threshold);
+        }
+        loader->size += read;
+    }
+    /* raster has to end exactly where the header says */
+    if (loader->size == expected && fgetc(file) != EOF) {
+        return error_ctor(ERR_INVALID_BITMAP_FILE,
+                          "The raw bitmap size does not match given"
+                          " dimensions!");
+    }
+    return error_none();
+}
+
+/**
+ * @brief reads plain (P2) raster and thresholds it into the staging buffer
+ * @return error when a sample is invalid or the raster size does not match */
+static Error bmp_loader_pgm_load_ascii(FILE *file,
+                                       BitmapLoader *restrict loader,
+                                       uint32_t max_value, uint32_t threshold) {
+    const size_t expected = bmp_size_raw(loader->staging.dimensions);
+    for (; loader->size < expected; loader->size++) {
+        uint32_t value = 0;
+        Error    err = bmp_loader_pgm_load_value(file, &value);
+        if (err.code != ERR_NONE) {
+            return err;
+        }
+        if (value > max_value) {
+            return error_ctor(ERR_INVALID_BITMAP_FILE,
+                              "PGM sample %" PRIu32
+                              " exceeds the maximal gray value %" PRIu32,
+                              value, max_value);
+        }
+        loader->staging.data[loader->size] =
+            (Pixel)(PXL_EMPTY + (value >= threshold));
+    }
+    /* only whitespace may follow the raster */
+    for (int c = fgetc(file); c != EOF; c = fgetc(file)) {
+        if (!bmp_valid_whitespace((char)c)) {
+            return error_ctor(ERR_INVALID_BITMAP_FILE,
+                              "The raw bitmap size does not match given"
+                              " dimensions!");
+        }
+    }
+    return error_none();
+}
+
+/**
+ * @brief loads PGM header (size and maximal gray value), `threshold` is
+ * resolved to half of the maximal gray value when left at the default
+ * @note expects the file pointer to be right after the magic number
+ * @return error when the header is malformed */
+static Error bmp_loader_pgm_load_header(FILE *file, BitmapSize *out_size,
+                                        uint32_t *out_max_value,
+                                        uint32_t *threshold) {
+    /* PGM header stores width first, unlike figsearch's text format */
+    uint32_t header[3] = {0};
+    for (size_t i = 0; i < sizeof(header) / sizeof(*header); i++) {
+        Error err = bmp_loader_pgm_load_value(file, &header[i]);
+        if (err.code != ERR_NONE) {
+            return err;
+        }
+    }
+    *out_size = (BitmapSize){.width = header[0], .height = header[1]};
+    *out_max_value = header[2];
+    if (out_size->width == 0 || out_size->height == 0) {
+        return error_ctor(ERR_INVALID_DIMENSION,
+                          "Dimension size cannot be zero!\n");
+    }
+    if (*out_max_value == 0 || *out_max_value > PGM_MAX_GRAY_VALUE) {
+        return error_ctor(ERR_INVALID_BITMAP_FILE,
+                          "Invalid PGM maximal gray value: %" PRIu32,
+                          *out_max_value);
+    }
+    if (*threshold == BMP_LOADER_THRESHOLD_DEFAULT) {
+        *threshold = *out_max_value / 2 + 1;
+    }
+    return error_none();
+}
+
+/**
+ * @brief loads grayscale PGM (P2/P5) bitmap and thresholds it into the
+ * staging buffer, so no intermediate 0/1 text file is needed
+ * @note expects the file pointer to be right after the magic number */
+static Error bmp_loader_load_pgm(FILE *file, BitmapLoader *restrict loader,
+                                 bool binary) {
+    BitmapSize size = {0};
+    uint32_t   max_value = 0, threshold = loader->threshold;
+    Error err = bmp_loader_pgm_load_header(file, &size, &max_value, &threshold);
+    if (err.code != ERR_NONE) {
+        return err;
+    }
+    /* allocate (blank) staging buffer for bitmap */
+    err = bmp_ctor(size, &loader->staging);
+    if (err.code != ERR_NONE) {
+        return err;
+    }
+    return binary ? bmp_loader_pgm_load_binary(file, loader, max_value,
+                                               threshold)
+                  : bmp_loader_pgm_load_ascii(file, loader, max_value,
+                                              threshold);
+}
+
+/** @brief loads mosaic manifest (tiles of one logical bitmap)
+ * @note defined along with the row reader it loads the tiles by */
+static Error bmp_loader_load_mosaic(FILE *file, BitmapLoader *restrict loader);
+
+/**
+ * @brief loads a bitmap into the staging buffer
+ * @note figsearch text bitmaps, PGM (P2/P5) files and mosaic manifests are
+ * accepted, the format is recognized by the magic number
+ * @note ensure the loader has a unique staging buffer to avoid violations */
+static Error bmp_loader_load(BitmapLoader *restrict loader) {
+    /* try to open bitmap */
+    FILE *file = fopen(loader->file_name, "rb");
+    if (file == NULL) {
+        return error_ctor(ERR_INVALID_BITMAP_FILE,
+                          "Failed to open file [%s]! Os error: %s\n",
+                          loader->file_name, strerror(errno));
+    }
+    /* determine the format from the magic number */
+    Error err = error_none();
+    int   magic[2] = {fgetc(file), fgetc(file)};
+    if (magic[0] == PGM_MAGIC &&
+        (magic[1] == PGM_MAGIC_ASCII || magic[1] == PGM_MAGIC_BINARY)) {
+        err = bmp_loader_load_pgm(file, loader, magic[1] == PGM_MAGIC_BINARY);
+    } else if (magic[0] == MOSAIC_MAGIC[0] && magic[1] == MOSAIC_MAGIC[1]) {
+        rewind(file);
+        err = bmp_loader_load_mosaic(file, loader);
+    } else {
+        rewind(file);
+        err = bmp_loader_load_text(file, loader);
+    }
     if (err.code != ERR_NONE) {
         fclose(file);
         return err;
@@ -313,469 +867,7399 @@ static Error bmp_loader_load(BitmapLoader *restrict loader) {
     return error_none();
 }
 
-/* =========================================
- *                 Point
- * ========================================= */
+#ifndef FIGSEARCH_NO_MAIN
 
-/** @brief stores coordinate value of pixel from a bitmap */
-typedef struct Point {
-    /** @brief represents bitmap's column index */
-    uint32_t x;
-    /** @brief represents bitmap's row index */
-    uint32_t y;
-} Point;
+/**
+ * @brief parses decimal dimension of a tiny bitmap at `text[*at]`, skipping
+ * leading whitespace
+ * @return false when there is no plain non-zero number */
+static bool bmp_tiny_dimension(const char *text, size_t length, size_t *at,
+                               uint32_t *out_dimension) {
+    while (*at < length && bmp_valid_whitespace(text[*at])) {
+        (*at)++;
+    }
+    uint64_t value = 0;
+    size_t   begin = *at;
+    for (; *at < length && isdigit((unsigned char)text[*at]); (*at)++) {
+        value = value * 10 + (uint64_t)(text[*at] - '0');
+        if (value > BMP_TINY_MAX_SIZE) {
+            return false;
+        }
+    }
+    *out_dimension = (uint32_t)value;
+    return *at != begin && value != 0;
+}
 
-/** @brief constructs Point */
-static inline Point point_ctor(uint32_t x, uint32_t y) { return (Point){x, y}; }
+/**
+ * @brief low latency path for tiny text bitmaps: the whole file is read by
+ * read() into `buffer` (BMP_TINY_MAX_SIZE + 1 bytes, usually on the caller's
+ * stack) and its pixels are compacted in place, `out_bmp` uses `buffer` and
+ * `cache` as its storage, so no heap is touched
+ * @note the bitmap must not be passed to bmp_dtor, release its cache by
+ * bmp_cache_dtor
+ * @return false when the file is not a valid tiny text bitmap, the regular
+ * loader has to be used then (it reports the errors as well) */
+static bool bmp_tiny_load(const char *file_name, char *buffer,
+                          BitmapCache *cache, Bitmap *out_bmp) {
+    const int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    size_t  length = 0;
+    ssize_t count = 0;
+    do {
+        count = read(fd, buffer + length, BMP_TINY_MAX_SIZE + 1 - length);
+        length += count > 0 ? (size_t)count : 0;
+    } while (count > 0 && length <= BMP_TINY_MAX_SIZE);
+    close(fd);
+    if (count < 0 || length > BMP_TINY_MAX_SIZE) {
+        return false;
+    }
 
-/** @brief constructs Point and populates it with invalid data */
-static inline Point point_invalid_ctor() {
-    return (Point){COORD_INVALID, COORD_INVALID};
+    BitmapSize size = {0};
+    size_t     at = 0;
+    if (!bmp_tiny_dimension(buffer, length, &at, &size.height) ||
+        !bmp_tiny_dimension(buffer, length, &at, &size.width) ||
+        bmp_size_raw(size) > BMP_TINY_MAX_SIZE) {
+        return false;
+    }
+    /* pixels are never ahead of the characters they were read from */
+    size_t pixels = 0;
+    for (; at < length; at++) {
+        if (bmp_valid_pix(buffer[at])) {
+            buffer[pixels++] = buffer[at];
+        } else if (!bmp_valid_whitespace(buffer[at])) {
+            return false;
+        }
+    }
+    if (pixels != bmp_size_raw(size)) {
+        return false;
+    }
+    *cache = (BitmapCache){
+        .bounds = {BMP_BOUND_UNKNOWN, BMP_BOUND_UNKNOWN, BMP_BOUND_UNKNOWN},
+    };
+    *out_bmp = (Bitmap){.dimensions = size, .data = buffer, .cache = cache};
+    return true;
 }
 
-/** @brief checks whether a given point has invalid coordinates */
-static inline bool point_is_invalid(Point p) {
-    return p.x == COORD_INVALID || p.y == COORD_INVALID;
-}
+#endif /* FIGSEARCH_NO_MAIN */
 
 /* =========================================
- *              ShapeGeometry
+ *            Bitmap Expression
  * ========================================= */
 
-/** @brief a common structure to represent geometrical shapes (Line/Square) */
-typedef struct {
-    /** @brief top-left or start point */
-    Point start;
-    /** @brief bottom-right or end point */
-    Point end;
-} ShapeGeometry;
+/** @brief number of pixels packed into a single word of a packed row */
+#define BMP_ROW_WORD_BITS (64)
+/** @brief gathers the lowest bits of 8 bytes into the top byte, so that bit
+ * `i` of it holds the bit of the `i`-th byte */
+#define BMP_ROW_GATHER (0x0102040810204080ULL)
+#define BMP_ROW_LOW_BITS (0x0101010101010101ULL)
+/** @brief deepest nesting of a bitmap expression */
+#define BMP_EXPR_MAX_DEPTH (64)
 
-/** @brief constructs basic shape from given points */
-static inline ShapeGeometry shape_geometry_ctor(Point start, Point end) {
-    return (ShapeGeometry){start, end};
-}
-/** @brief constructs invalid shape */
-static inline ShapeGeometry shape_geometry_invalid_ctor() {
-    return shape_geometry_ctor(point_invalid_ctor(), point_invalid_ctor());
-}
-/**
- * @brief compares two shapes based on their size
- * @return <0...lhs<rhs; >0...lhs>rhs; =0...lhs==rhs */
-static int shape_geometry_cmp(const ShapeGeometry lhs, const ShapeGeometry rhs,
-                              uint32_t (*size_func)(const ShapeGeometry)) {
-    uint32_t length_delta = size_func(lhs) - size_func(rhs);
-    if (length_delta != 0) {
-        return length_delta;
+/** @return number of trailing zero bits of `value` (64 for zero) */
+static inline uint32_t bits_ctz64(uint64_t value) {
+    if (value == 0) {
+        return 64;
     }
-    if (lhs.start.y != rhs.start.y) {
-        return rhs.start.y - lhs.start.y;
+#if defined(__GNUC__) || defined(__clang__)
+    return (uint32_t)__builtin_ctzll(value);
+#else
+    uint32_t count = 0;
+    for (; (value & 1) == 0; value >>= 1) {
+        count++;
     }
-    return rhs.start.x - lhs.start.x;
+    return count;
+#endif
 }
-static inline void shape_geometry_print(const ShapeGeometry shape) {
-    printf("%" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu32 "\n", shape.start.y,
-           shape.start.x, shape.end.y, shape.end.x);
+
+/** @return number of set bits of `value` */
+static inline uint32_t bits_popcount64(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (uint32_t)__builtin_popcountll(value);
+#else
+    uint32_t count = 0;
+    for (; value != 0; value &= value - 1) {
+        count++;
+    }
+    return count;
+#endif
 }
-static inline bool shape_geometry_is_invalid(const ShapeGeometry shape) {
-    return point_is_invalid(shape.start) || point_is_invalid(shape.end);
+
+/** @brief packs `width` pixels into words (bit `c % 64` of word `c / 64`
+ * stands for column `c`) */
+static void bmp_row_pack(const Pixel *pixels, uint32_t width,
+                         uint64_t *out_words) {
+    for (uint32_t first = 0; first < width; first += BMP_ROW_WORD_BITS) {
+        const uint32_t count = width - first < BMP_ROW_WORD_BITS
+                                   ? width - first
+                                   : BMP_ROW_WORD_BITS;
+        uint64_t bits = 0;
+        uint32_t bit = 0;
+        /* filled and empty pixels differ in the lowest bit, 8 pixels are
+         * gathered by a single multiplication */
+        for (; bit + 8 <= count; bit += 8) {
+            uint64_t bytes = 0;
+            for (uint32_t i = 0; i < 8; i++) {
+                bytes |= (uint64_t)(unsigned char)pixels[first + bit + i]
+                         << (8 * i);
+            }
+            bits |= (((bytes & BMP_ROW_LOW_BITS) * BMP_ROW_GATHER) >> 56)
+                    << bit;
+        }
+        for (; bit < count; bit++) {
+            bits |= (uint64_t)(pixels[first + bit] == PXL_FILLED) << bit;
+        }
+        out_words[first / BMP_ROW_WORD_BITS] = bits;
+    }
 }
 
-/* =========================================
- *                  Line
- * ========================================= */
+/** @brief inverse of bmp_row_pack */
+static void bmp_row_unpack(const uint64_t *words, uint32_t width,
+                           Pixel *out_pixels) {
+    for (uint32_t col = 0; col < width; col++) {
+        out_pixels[col] = (Pixel)(
+            PXL_EMPTY + ((words[col / BMP_ROW_WORD_BITS] >>
+                          (col % BMP_ROW_WORD_BITS)) & 1));
+    }
+}
 
-/** @brief defines a line by its begin and end point */
-typedef ShapeGeometry Line;
-typedef Line          VLine;  // [V]ertical
-typedef Line          HLine;  // [H]orizontal
+typedef enum BitmapRowFormat {
+    BMP_ROWS_TEXT = 0,
+    BMP_ROWS_PGM_ASCII,
+    BMP_ROWS_PGM_BINARY
+} BitmapRowFormat;
 
-#define line_ctor(start, end) shape_geometry_ctor((start), (end))
-#define line_invalid_ctor()   shape_geometry_invalid_ctor()
-#define line_is_invalid(line) shape_geometry_is_invalid((line))
-#define line_print(line)      shape_geometry_print((line))
-#define hline_cmp(lhs, rhs)   shape_geometry_cmp((lhs), (rhs), hline_length)
-#define vline_cmp(lhs, rhs)   shape_geometry_cmp((lhs), (rhs), vline_length)
+/** @brief reads a bitmap file (any format of BitmapLoader) one row at a time,
+ * so the file is never held in memory as a whole */
+typedef struct BitmapRowReader {
+    FILE           *file;
+    const char     *file_name;
+    BitmapSize      dimensions;
+    BitmapRowFormat format;
+    uint32_t        max_value;
+    uint32_t        threshold;
+    /** @brief raw samples of a single P5 row */
+    uint8_t *samples;
+    /** @brief buffered part of the text raster */
+    char   chunk[BMP_LOADER_READ_CHUNK_SIZE];
+    size_t chunk_begin;
+    size_t chunk_end;
+} BitmapRowReader;
 
-/** @brief calculates length of horizontal line */
-static inline uint32_t hline_length(HLine line) {
-    return line.end.x - line.start.x + 1;
+static void bmp_row_reader_dtor(BitmapRowReader *reader) {
+    if (reader->file != NULL) {
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+    mem_free(reader->samples);
+    reader->samples = NULL;
 }
-/** @brief calculates length of vertical line */
-static inline uint32_t vline_length(VLine line) {
-    return line.end.y - line.start.y + 1;
+
+/**
+ * @brief opens `file_name` and reads its header
+ * @return ERR_INVALID_BITMAP_FILE when the file cannot be opened, errors of
+ * the header otherwise */
+static Error bmp_row_reader_ctor(const char *file_name, uint32_t threshold,
+                                 BitmapRowReader *out_reader) {
+    *out_reader = (BitmapRowReader){
+        .file = fopen(file_name, "rb"),
+        .file_name = file_name,
+        .threshold = threshold,
+    };
+    if (out_reader->file == NULL) {
+        return error_ctor(ERR_INVALID_BITMAP_FILE,
+                          "Failed to open file [%s]! Os error: %s\n",
+                          file_name, strerror(errno));
+    }
+    FILE *file = out_reader->file;
+    Error err = error_none();
+    int   magic[2] = {fgetc(file), fgetc(file)};
+    if (magic[0] == PGM_MAGIC &&
+        (magic[1] == PGM_MAGIC_ASCII || magic[1] == PGM_MAGIC_BINARY)) {
+        out_reader->format = magic[1] == PGM_MAGIC_BINARY
+                                 ? BMP_ROWS_PGM_BINARY
+                                 : BMP_ROWS_PGM_ASCII;
+        err = bmp_loader_pgm_load_header(file, &out_reader->dimensions,
+                                         &out_reader->max_value,
+                                         &out_reader->threshold);
+    } else {
+        rewind(file);
+        out_reader->format = BMP_ROWS_TEXT;
+        err = bmp_loader_load_size(file, &out_reader->dimensions);
+    }
+    if (err.code == ERR_NONE && out_reader->format == BMP_ROWS_PGM_BINARY) {
+        out_reader->samples =
+            mem_malloc((size_t)out_reader->dimensions.width * 2);
+        if (out_reader->samples == NULL) {
+            err = error_ctor(ERR_ALLOCATION_FAILURE,
+                             "Failed to allocate row buffer!\n");
+        }
+    }
+    if (err.code != ERR_NONE) {
+        bmp_row_reader_dtor(out_reader);
+    }
+    return err;
+}
+
+/** @brief error of a raster which does not match its header */
+static inline Error bmp_row_reader_size_error(const BitmapRowReader *reader) {
+    return error_ctor(ERR_INVALID_DIMENSION,
+                      "The raw bitmap size of [%s] does not match given "
+                      "dimensions!",
+                      reader->file_name);
 }
 
 /**
- * @brief searches for a vertical line from `begin` in bitmap
- * @return invalid horizontal line if given point is not set */
-static inline HLine line_find_hline(const Bitmap *bmp, const Point begin) {
-    if (bmp_at(bmp, begin.y, begin.x) == PXL_FILLED) {
-        /* iterate until hit empty pixel or end of row */
-        uint32_t x_track = begin.x + 1;
-        for (; x_track < bmp->dimensions.width &&
-               bmp_at(bmp, begin.y, x_track) == PXL_FILLED;
-             x_track++)
-            ;
-        return line_ctor(begin, point_ctor(x_track - 1, begin.y));
+ * @brief reads the next row of pixels into `out` (width of the bitmap)
+ * @return error when the raster is malformed or ends too early */
+static Error bmp_row_reader_next(BitmapRowReader *reader, Pixel *out) {
+    const uint32_t width = reader->dimensions.width;
+    switch (reader->format) {
+        case BMP_ROWS_TEXT:
+            for (uint32_t col = 0; col < width;) {
+                if (reader->chunk_begin == reader->chunk_end) {
+                    reader->chunk_begin = 0;
+                    reader->chunk_end = fread(reader->chunk, sizeof(char),
+                                              sizeof(reader->chunk),
+                                              reader->file);
+                    if (reader->chunk_end == 0) {
+                        return bmp_row_reader_size_error(reader);
+                    }
+                }
+                const char c = reader->chunk[reader->chunk_begin++];
+                if (bmp_valid_whitespace(c)) {
+                    continue;
+                }
+                if (!bmp_valid_pix(c)) {
+                    return error_ctor(ERR_INVALID_BITMAP_FILE,
+                                      "Unexpected character encountered: "
+                                      "'%c'",
+                                      c);
+                }
+                out[col++] = c;
+            }
+            return error_none();
+        case BMP_ROWS_PGM_ASCII:
+            for (uint32_t col = 0; col < width; col++) {
+                uint32_t value = 0;
+                Error    err = bmp_loader_pgm_load_value(reader->file, &value);
+                if (err.code != ERR_NONE) {
+                    return err;
+                }
+                if (value > reader->max_value) {
+                    return error_ctor(ERR_INVALID_BITMAP_FILE,
+                                      "PGM sample %" PRIu32
+                                      " exceeds the maximal gray value "
+                                      "%" PRIu32,
+                                      value, reader->max_value);
+                }
+                out[col] = (Pixel)(PXL_EMPTY + (value >= reader->threshold));
+            }
+            return error_none();
+        case BMP_ROWS_PGM_BINARY: {
+            const size_t sample_size = reader->max_value > UINT8_MAX ? 2 : 1;
+            if (fread(reader->samples, sample_size, width, reader->file) !=
+                width) {
+                return bmp_row_reader_size_error(reader);
+            }
+            if (sample_size == 2) {
+                bmp_threshold_u16(reader->samples, out, width,
+                                  reader->threshold);
+            } else if (reader->threshold > UINT8_MAX) {
+                memset(out, PXL_EMPTY, width);
+            } else {
+                bmp_threshold_u8(reader->samples, out, width,
+                                 (uint8_t)reader->threshold);
+            }
+            return error_none();
+        }
     }
-    return line_invalid_ctor();
+    return error_ctor(ERR_INTERNAL, "Invalid control path executed on line: %d",
+                      __LINE__);
 }
 
-/** @see line_find_hline */
-static inline VLine line_find_vline(const Bitmap *bmp, const Point begin) {
-    if (bmp_at(bmp, begin.y, begin.x) == PXL_FILLED) {
-        /* iterate until hit empty pixel or end of column */
-        uint32_t y_track = begin.y + 1;
-        for (; y_track < bmp->dimensions.height &&
-               bmp_at(bmp, y_track, begin.x) == PXL_FILLED;
-             y_track++) {
+/**
+ * @brief checks that nothing but whitespace follows the last row (P5 raster
+ * has to end right after it)
+ * @return error when the raster is longer than its header says */
+static Error bmp_row_reader_finish(BitmapRowReader *reader) {
+    if (reader->format == BMP_ROWS_PGM_BINARY) {
+        return fgetc(reader->file) == EOF ? error_none()
+                                          : bmp_row_reader_size_error(reader);
+    }
+    for (; reader->chunk_begin < reader->chunk_end; reader->chunk_begin++) {
+        if (!bmp_valid_whitespace(reader->chunk[reader->chunk_begin])) {
+            return bmp_row_reader_size_error(reader);
         }
-        return line_ctor(begin, point_ctor(begin.x, y_track - 1));
     }
-    return line_invalid_ctor();
+    for (int c = fgetc(reader->file); c != EOF; c = fgetc(reader->file)) {
+        if (!bmp_valid_whitespace((char)c)) {
+            return bmp_row_reader_size_error(reader);
+        }
+    }
+    return error_none();
 }
 
-/** @brief scans for longest horizontal line */
-static HLine line_find_longest_hline(const Bitmap *bmp) {
-    HLine    max = line_invalid_ctor(), temp = {0};
-    uint32_t max_length = 0;
-    /* iterate over each row */
-    for (uint32_t row = 0; row < bmp->dimensions.height; row++) {
-        /* scan each line for any horizontal line matches */
-        for (uint32_t col = 0; col < bmp->dimensions.width - max_length;
-             col++) {
-            temp = line_find_hline(bmp, (Point){col, row});
-            if (line_is_invalid(temp)) {
-                continue;
+typedef enum BitmapExprOp {
+    BMP_EXPR_FILE = 0,
+    BMP_EXPR_NOT,
+    BMP_EXPR_AND,
+    BMP_EXPR_OR,
+    BMP_EXPR_XOR
+} BitmapExprOp;
+
+/** @brief names of the expression operators (indexed by BitmapExprOp) */
+static const char *const BMP_EXPR_OP_NAMES[] = {NULL, "not", "and", "or",
+                                                "xor"};
+
+/** @brief node of a bitmap expression such as `and(a.txt, not(b.txt))`,
+ * every node holds its current row packed into words */
+typedef struct BitmapExpr {
+    BitmapExprOp       op;
+    /** @brief operands (NULL terminated linked list of siblings) */
+    struct BitmapExpr *args;
+    struct BitmapExpr *next;
+    /** @brief path of the file (BMP_EXPR_FILE) */
+    char           *file_name;
+    BitmapRowReader reader;
+    uint64_t       *words;
+} BitmapExpr;
+
+static void bmp_expr_dtor(BitmapExpr *expr) {
+    while (expr != NULL) {
+        BitmapExpr *next = expr->next;
+        bmp_expr_dtor(expr->args);
+        bmp_row_reader_dtor(&expr->reader);
+        mem_free(expr->file_name);
+        mem_free(expr->words);
+        mem_free(expr);
+        expr = next;
+    }
+}
+
+/** @return operator the `text` starts with (followed by '('), BMP_EXPR_FILE
+ * when it is a plain path */
+static BitmapExprOp bmp_expr_match_op(const char *text, const char **out_end) {
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    for (int op = BMP_EXPR_NOT; op <= BMP_EXPR_XOR; op++) {
+        const size_t length = strlen(BMP_EXPR_OP_NAMES[op]);
+        if (strncmp(text, BMP_EXPR_OP_NAMES[op], length) != 0) {
+            continue;
+        }
+        const char *rest = text + length;
+        while (isspace((unsigned char)*rest)) {
+            rest++;
+        }
+        if (*rest == '(') {
+            *out_end = rest + 1;
+            return (BitmapExprOp)op;
+        }
+    }
+    *out_end = text;
+    return BMP_EXPR_FILE;
+}
+
+/** @return true when the bitmap location is an expression, not a path */
+static inline bool bmp_expr_is_expression(const char *text) {
+    const char *end;
+    return bmp_expr_match_op(text, &end) != BMP_EXPR_FILE;
+}
+
+/**
+ * @brief parses expression at `*text` (advanced past it), operand files are
+ * opened right away
+ * @return ERR_INVALID_BITMAP_FILE when the expression is malformed */
+static Error bmp_expr_parse(const char **text, uint32_t threshold,
+                            uint32_t depth, BitmapExpr **out_expr) {
+    if (depth > BMP_EXPR_MAX_DEPTH) {
+        return error_ctor(ERR_INVALID_BITMAP_FILE,
+                          "Bitmap expression is nested too deep!");
+    }
+    BitmapExpr *expr = mem_calloc(1, sizeof(BitmapExpr));
+    if (expr == NULL) {
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate bitmap expression!\n");
+    }
+    *out_expr = expr;
+    expr->op = bmp_expr_match_op(*text, text);
+    if (expr->op == BMP_EXPR_FILE) {
+        /* the path spans until the delimiter of the enclosing operator */
+        const char *end = *text + strcspn(*text, ",)");
+        const char *last = end;
+        while (last > *text && isspace((unsigned char)last[-1])) {
+            last--;
+        }
+        if (last == *text) {
+            return error_ctor(ERR_INVALID_BITMAP_FILE,
+                              "Missing bitmap location in expression!");
+        }
+        expr->file_name = mem_malloc((size_t)(last - *text) + 1);
+        if (expr->file_name == NULL) {
+            return error_ctor(ERR_ALLOCATION_FAILURE,
+                              "Failed to allocate bitmap expression!\n");
+        }
+        memcpy(expr->file_name, *text, (size_t)(last - *text));
+        expr->file_name[last - *text] = '\0';
+        *text = end;
+        return bmp_row_reader_ctor(expr->file_name, threshold, &expr->reader);
+    }
+    /* comma separated operands closed by ')' */
+    size_t       count = 0;
+    BitmapExpr **tail = &expr->args;
+    for (;;) {
+        Error err = bmp_expr_parse(text, threshold, depth + 1, tail);
+        if (err.code != ERR_NONE) {
+            return err;
+        }
+        tail = &(*tail)->next;
+        count++;
+        while (isspace((unsigned char)**text)) {
+            (*text)++;
+        }
+        if (**text == ')') {
+            (*text)++;
+            break;
+        }
+        if (**text != ',') {
+            return error_ctor(ERR_INVALID_BITMAP_FILE,
+                              "Expected ',' or ')' in bitmap expression but "
+                              "found: '%c'",
+                              **text == '\0' ? ' ' : **text);
+        }
+        (*text)++;
+    }
+    if ((expr->op == BMP_EXPR_NOT) != (count == 1)) {
+        return error_ctor(ERR_INVALID_BITMAP_FILE,
+                          "Operator [%s] expects %s operand(s) but %zu given!",
+                          BMP_EXPR_OP_NAMES[expr->op],
+                          expr->op == BMP_EXPR_NOT ? "one" : "two or more",
+                          count);
+    }
+    return error_none();
+}
+
+/**
+ * @brief allocates row words of every node and checks that all operands are
+ * of the same size (`*size` is set by the first operand)
+ * @return ERR_INVALID_DIMENSION when operand sizes differ */
+static Error bmp_expr_prepare(BitmapExpr *expr, BitmapSize *size,
+                              bool *size_known) {
+    for (BitmapExpr *arg = expr->args; arg != NULL; arg = arg->next) {
+        Error err = bmp_expr_prepare(arg, size, size_known);
+        if (err.code != ERR_NONE) {
+            return err;
+        }
+    }
+    if (expr->op == BMP_EXPR_FILE) {
+        const BitmapSize own = expr->reader.dimensions;
+        if (*size_known &&
+            (own.width != size->width || own.height != size->height)) {
+            return error_ctor(ERR_INVALID_DIMENSION,
+                              "Bitmap [%s] is %" PRIu32 "x%" PRIu32
+                              " but the other operands are %" PRIu32
+                              "x%" PRIu32 "!",
+                              expr->file_name, own.height, own.width,
+                              size->height, size->width);
+        }
+        *size = own;
+        *size_known = true;
+    }
+    expr->words = mem_malloc(sizeof(uint64_t) *
+                             ((size->width + BMP_ROW_WORD_BITS - 1) /
+                              BMP_ROW_WORD_BITS));
+    if (expr->words == NULL) {
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate bitmap expression!\n");
+    }
+    return error_none();
+}
+
+/**
+ * @brief advances every operand file by one row and combines the packed rows
+ * into `expr->words`, `scratch` holds a row of pixels of an operand
+ * @return error of an operand raster */
+static Error bmp_expr_next_row(BitmapExpr *expr, uint32_t width,
+                               Pixel *scratch) {
+    const uint32_t words = (width + BMP_ROW_WORD_BITS - 1) / BMP_ROW_WORD_BITS;
+    if (expr->op == BMP_EXPR_FILE) {
+        Error err = bmp_row_reader_next(&expr->reader, scratch);
+        if (err.code == ERR_NONE) {
+            bmp_row_pack(scratch, width, expr->words);
+        }
+        return err;
+    }
+    for (BitmapExpr *arg = expr->args; arg != NULL; arg = arg->next) {
+        Error err = bmp_expr_next_row(arg, width, scratch);
+        if (err.code != ERR_NONE) {
+            return err;
+        }
+        const uint64_t *in = arg->words;
+        uint64_t       *out = expr->words;
+        if (arg == expr->args) {
+            for (uint32_t i = 0; i < words; i++) {
+                out[i] = expr->op == BMP_EXPR_NOT ? ~in[i] : in[i];
             }
-            col = temp.end.x;
-            if (line_is_invalid(max) || hline_cmp(max, temp) < 0) {
-                max = temp;
-                max_length = hline_length(max);
+            continue;
+        }
+        for (uint32_t i = 0; i < words; i++) {
+            out[i] = expr->op == BMP_EXPR_AND  ? out[i] & in[i]
+                     : expr->op == BMP_EXPR_OR ? out[i] | in[i]
+                                               : out[i] ^ in[i];
+        }
+    }
+    return error_none();
+}
+
+/** @brief checks the end of every operand file @see bmp_row_reader_finish */
+static Error bmp_expr_finish(BitmapExpr *expr) {
+    for (BitmapExpr *arg = expr->args; arg != NULL; arg = arg->next) {
+        Error err = bmp_expr_finish(arg);
+        if (err.code != ERR_NONE) {
+            return err;
+        }
+    }
+    return expr->op == BMP_EXPR_FILE ? bmp_row_reader_finish(&expr->reader)
+                                     : error_none();
+}
+
+/**
+ * @brief evaluates bitmap expression `text` (e.g. `and(a.txt, not(b.txt))`)
+ * into `out_bmp`, operand files are streamed together row by row and their
+ * packed rows combined word by word, only the result is stored
+ * @return error when the expression or an operand file is invalid */
+static Error bmp_expr_load(const char *text, uint32_t threshold,
+                           Bitmap *out_bmp) {
+    *out_bmp = (Bitmap){0};
+    BitmapExpr *expr = NULL;
+    BitmapSize  size = {0};
+    bool        size_known = false;
+    Pixel      *scratch = NULL;
+    const char *end = text;
+    Error       err = bmp_expr_parse(&end, threshold, 0, &expr);
+    if (err.code == ERR_NONE) {
+        while (isspace((unsigned char)*end)) {
+            end++;
+        }
+        if (*end != '\0') {
+            err = error_ctor(ERR_INVALID_BITMAP_FILE,
+                             "Unexpected text after bitmap expression: [%s]",
+                             end);
+        }
+    }
+    if (err.code == ERR_NONE) {
+        err = bmp_expr_prepare(expr, &size, &size_known);
+    }
+    if (err.code == ERR_NONE) {
+        scratch = mem_malloc(sizeof(Pixel) * size.width);
+        err = scratch == NULL
+                  ? error_ctor(ERR_ALLOCATION_FAILURE,
+                               "Failed to allocate row buffer!\n")
+                  : bmp_ctor(size, out_bmp);
+    }
+    for (uint32_t row = 0; err.code == ERR_NONE && row < size.height; row++) {
+        err = bmp_expr_next_row(expr, size.width, scratch);
+        if (err.code == ERR_NONE) {
+            bmp_row_unpack(expr->words, size.width, &bmp_at(out_bmp, row, 0));
+        }
+    }
+    if (err.code == ERR_NONE) {
+        err = bmp_expr_finish(expr);
+    }
+    if (err.code != ERR_NONE) {
+        bmp_dtor(out_bmp);
+    }
+    mem_free(scratch);
+    bmp_expr_dtor(expr);
+    return err;
+}
+
+/* =========================================
+ *                 Mosaic
+ * ========================================= */
+
+/** @brief single tile file of a mosaic, placed at `row`/`col` of the logical
+ * bitmap, with the runs it needs to be stitched to its neighbours */
+typedef struct MosaicTile {
+    char      *file_name;
+    uint32_t   row;
+    uint32_t   col;
+    BitmapSize dimensions;
+    /** @brief filled runs touching the left/right edge of each tile row */
+    uint32_t *row_head;
+    uint32_t *row_tail;
+    /** @brief filled runs touching the top/bottom edge of each tile column */
+    uint32_t *col_head;
+    uint32_t *col_tail;
+    /** @brief longest lines lying inside of the tile */
+    uint32_t hline;
+    uint32_t vline;
+    Error    err;
+} MosaicTile;
+
+/** @brief manifest "mosaic HEIGHT WIDTH" followed by "ROW COL PATH" lines,
+ * tile paths are relative to the manifest, uncovered pixels are empty */
+typedef struct Mosaic {
+    BitmapSize  dimensions;
+    MosaicTile *tiles;
+    uint32_t    count;
+    uint32_t    threshold;
+    /** @brief logical bitmap the tiles are loaded into */
+    Bitmap *bmp;
+} Mosaic;
+
+static void mosaic_dtor(Mosaic *mosaic) {
+    for (uint32_t i = 0; i < mosaic->count; i++) {
+        mem_free(mosaic->tiles[i].file_name);
+        mem_free(mosaic->tiles[i].row_head);
+        error_dtor(&mosaic->tiles[i].err);
+    }
+    mem_free(mosaic->tiles);
+    *mosaic = (Mosaic){0};
+}
+
+/** @brief parses decimal number at `*text` and moves `*text` after it
+ * @return false when there is no number or it does not fit */
+static bool mosaic_parse_u32(char **text, uint32_t *out_value) {
+    while (isspace((unsigned char)**text)) {
+        (*text)++;
+    }
+    if (!isdigit((unsigned char)**text)) {
+        return false;
+    }
+    errno = 0;
+    char         *end = NULL;
+    unsigned long value = strtoul(*text, &end, 10);
+    if (errno != 0 || value > UINT32_MAX) {
+        return false;
+    }
+    *text = end;
+    *out_value = (uint32_t)value;
+    return true;
+}
+
+/**
+ * @brief parses tile line "ROW COL PATH", `dir_length` leading characters of
+ * `dir` are prepended to relative paths
+ * @return error when the line is malformed */
+static Error mosaic_parse_tile(char *text, size_t line, const char *dir,
+                               size_t dir_length, MosaicTile *out_tile) {
+    *out_tile = (MosaicTile){0};
+    if (!mosaic_parse_u32(&text, &out_tile->row) ||
+        !mosaic_parse_u32(&text, &out_tile->col) ||
+        !isspace((unsigned char)*text)) {
+        return error_ctor(ERR_INVALID_BITMAP_FILE,
+                          "Mosaic line %zu: expected \"row col path\"!", line);
+    }
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    size_t length = strlen(text);
+    while (length > 0 && isspace((unsigned char)text[length - 1])) {
+        length--;
+    }
+    if (length == 0) {
+        return error_ctor(ERR_INVALID_BITMAP_FILE,
+                          "Mosaic line %zu: expected \"row col path\"!", line);
+    }
+    if (text[0] == '/') {
+        dir_length = 0;
+    }
+    out_tile->file_name = mem_malloc(dir_length + length + 1);
+    if (out_tile->file_name == NULL) {
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate mosaic tile!\n");
+    }
+    memcpy(out_tile->file_name, dir, dir_length);
+    memcpy(out_tile->file_name + dir_length, text, length);
+    out_tile->file_name[dir_length + length] = '\0';
+    return error_none();
+}
+
+/**
+ * @brief reads the manifest from `file` (named `file_name`) into
+ * `out_mosaic`, tiles are not loaded yet
+ * @return error when the manifest is malformed */
+static Error mosaic_parse(FILE *file, const char *file_name,
+                          Mosaic *out_mosaic) {
+    *out_mosaic = (Mosaic){0};
+    const char *slash = strrchr(file_name, '/');
+    size_t      dir_length = slash != NULL ? (size_t)(slash - file_name) + 1 : 0;
+    Error       err = error_none();
+    bool        header = false;
+    uint32_t    capacity = 0;
+    char       *text = NULL;
+    size_t      text_size = 0;
+    for (size_t line = 1; getline(&text, &text_size, file) != -1; line++) {
+        /* skip blank lines and comments */
+        char *first = text;
+        while (isspace((unsigned char)*first)) {
+            first++;
+        }
+        if (*first == '\0' || *first == '#') {
+            continue;
+        }
+        if (!header) {
+            char *dims = first + strlen(MOSAIC_MAGIC);
+            if (strncmp(first, MOSAIC_MAGIC, strlen(MOSAIC_MAGIC)) != 0 ||
+                !mosaic_parse_u32(&dims, &out_mosaic->dimensions.height) ||
+                !mosaic_parse_u32(&dims, &out_mosaic->dimensions.width)) {
+                err = error_ctor(ERR_INVALID_BITMAP_FILE,
+                                 "Mosaic line %zu: expected \"%s height "
+                                 "width\"!",
+                                 line, MOSAIC_MAGIC);
+                break;
+            }
+            header = true;
+            continue;
+        }
+        if (out_mosaic->count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            MosaicTile *tiles =
+                mem_realloc(out_mosaic->tiles, sizeof(MosaicTile) * capacity);
+            if (tiles == NULL) {
+                err = error_ctor(ERR_ALLOCATION_FAILURE,
+                                 "Failed to allocate mosaic tiles!\n");
+                break;
             }
+            out_mosaic->tiles = tiles;
+        }
+        err = mosaic_parse_tile(first, line, file_name, dir_length,
+                                &out_mosaic->tiles[out_mosaic->count]);
+        if (err.code != ERR_NONE) {
+            mem_free(out_mosaic->tiles[out_mosaic->count].file_name);
+            break;
         }
+        out_mosaic->count++;
     }
-    return max;
+    free(text);
+    if (err.code == ERR_NONE &&
+        (out_mosaic->dimensions.width == 0 ||
+         out_mosaic->dimensions.height == 0)) {
+        err = error_ctor(ERR_INVALID_DIMENSION,
+                         "Dimension size cannot be zero!\n");
+    }
+    if (err.code != ERR_NONE) {
+        mosaic_dtor(out_mosaic);
+    }
+    return err;
 }
 
-/** @brief scans for longest vertical line */
-static VLine line_find_longest_vline(const Bitmap *bmp) {
-    VLine    max = line_invalid_ctor(), temp = {0};
-    uint32_t max_length = 0;
-    /* iterate over each column */
-    for (uint32_t col = 0; col < bmp->dimensions.width; col++) {
-        /* scan each line for any vertical line matches */
-        for (uint32_t row = 0; row < bmp->dimensions.height - max_length;
-             row++) {
-            temp = line_find_vline(bmp, (Point){col, row});
-            if (line_is_invalid(temp)) {
-                continue;
+/**
+ * @brief reads headers of all tiles and checks that every tile lies inside
+ * of the logical bitmap and no two tiles overlap
+ * @note tiles are compared pairwise, manifests list at most thousands of
+ * tiles */
+static Error mosaic_place_tiles(Mosaic *mosaic) {
+    const BitmapSize size = mosaic->dimensions;
+    for (uint32_t i = 0; i < mosaic->count; i++) {
+        MosaicTile     *tile = &mosaic->tiles[i];
+        BitmapRowReader reader;
+        Error err = bmp_row_reader_ctor(tile->file_name, mosaic->threshold,
+                                        &reader);
+        if (err.code != ERR_NONE) {
+            return err;
+        }
+        tile->dimensions = reader.dimensions;
+        bmp_row_reader_dtor(&reader);
+        if (tile->row > size.height ||
+            tile->dimensions.height > size.height - tile->row ||
+            tile->col > size.width ||
+            tile->dimensions.width > size.width - tile->col) {
+            return error_ctor(ERR_INVALID_DIMENSION,
+                              "Mosaic tile [%s] does not fit into the "
+                              "%" PRIu32 "x%" PRIu32 " bitmap!",
+                              tile->file_name, size.height, size.width);
+        }
+        for (uint32_t j = 0; j < i; j++) {
+            const MosaicTile *other = &mosaic->tiles[j];
+            if (tile->row < other->row + other->dimensions.height &&
+                other->row < tile->row + tile->dimensions.height &&
+                tile->col < other->col + other->dimensions.width &&
+                other->col < tile->col + tile->dimensions.width) {
+                return error_ctor(ERR_INVALID_DIMENSION,
+                                  "Mosaic tiles [%s] and [%s] overlap!",
+                                  other->file_name, tile->file_name);
             }
-            row = temp.end.y;
-            if (line_is_invalid(max) || vline_cmp(max, temp) < 0) {
-                max = temp;
-                max_length = vline_length(max);
+        }
+    }
+    return error_none();
+}
+
+/** @brief records runs of a freshly loaded tile row `row` (tile coordinates)
+ * @note `col_tail` holds the runs reaching the current row until the last
+ * row is summarized, which makes them the runs touching the bottom edge */
+static void mosaic_tile_summarize(MosaicTile *tile, uint32_t row,
+                                  const Pixel *pixels) {
+    const uint32_t width = tile->dimensions.width;
+    uint32_t       run = 0;
+    tile->row_head[row] = 0;
+    for (uint32_t col = 0; col < width; col++) {
+        if (pixels[col] == PXL_FILLED) {
+            run++;
+            tile->col_tail[col]++;
+            if (tile->col_head[col] == row) {
+                tile->col_head[col]++;
             }
+        } else {
+            if (run == col) {
+                tile->row_head[row] = run;
+            }
+            run = 0;
+            tile->col_tail[col] = 0;
+        }
+        if (run > tile->hline) {
+            tile->hline = run;
+        }
+        if (tile->col_tail[col] > tile->vline) {
+            tile->vline = tile->col_tail[col];
         }
     }
-    return max;
+    if (run == width) {
+        tile->row_head[row] = width;
+    }
+    tile->row_tail[row] = run;
 }
 
-/* =========================================
- *                  Square
- * ========================================= */
+/** @brief streams rows of a placed tile right into the logical bitmap
+ * @return error when the tile file is invalid */
+static Error mosaic_tile_load(const Mosaic *mosaic, MosaicTile *tile) {
+    const BitmapSize size = tile->dimensions;
+    tile->row_head = mem_calloc(
+        (size_t)size.height * 2 + (size_t)size.width * 2, sizeof(uint32_t));
+    if (tile->row_head == NULL) {
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate mosaic tile runs!\n");
+    }
+    tile->row_tail = tile->row_head + size.height;
+    tile->col_head = tile->row_tail + size.height;
+    tile->col_tail = tile->col_head + size.width;
 
-/** @brief Square is defined by its "top_left" point (ShapeGeometry::start) and
- * its "bottom_right" point (ShapeGeometry::end) */
-typedef ShapeGeometry Square;
+    BitmapRowReader reader;
+    Error err = bmp_row_reader_ctor(tile->file_name, mosaic->threshold, &reader);
+    if (err.code != ERR_NONE) {
+        return err;
+    }
+    if (reader.dimensions.width != size.width ||
+        reader.dimensions.height != size.height) {
+        bmp_row_reader_dtor(&reader);
+        return error_ctor(ERR_INVALID_DIMENSION,
+                          "Mosaic tile [%s] changed while loading!",
+                          tile->file_name);
+    }
+    for (uint32_t row = 0; err.code == ERR_NONE && row < size.height; row++) {
+        Pixel *pixels = &bmp_at(mosaic->bmp, (tile->row + row), tile->col);
+        err = bmp_row_reader_next(&reader, pixels);
+        if (err.code == ERR_NONE) {
+            mosaic_tile_summarize(tile, row, pixels);
+        }
+    }
+    if (err.code == ERR_NONE) {
+        err = bmp_row_reader_finish(&reader);
+    }
+    bmp_row_reader_dtor(&reader);
+    return err;
+}
+
+/** @brief parallel task loading tiles [begin, end) */
+static void mosaic_load_tiles(void *arg, uint32_t begin, uint32_t end) {
+    Mosaic *mosaic = arg;
+    for (uint32_t i = begin; i < end; i++) {
+        mosaic->tiles[i].err = mosaic_tile_load(mosaic, &mosaic->tiles[i]);
+    }
+}
+
+static int mosaic_key_cmp(const void *lhs, const void *rhs) {
+    const uint64_t a = *(const uint64_t *)lhs, b = *(const uint64_t *)rhs;
+    return (a > b) - (a < b);
+}
+
+/**
+ * @brief joins the edge runs of neighbouring tiles along rows (or columns)
+ * of the logical bitmap, tiles covering the current row are kept ordered by
+ * their column, so each row visits only its own tiles
+ * @return length of the longest line crossing tiles (or ERR_ALLOCATION_FAILURE
+ * error) */
+static Error mosaic_stitch(const Mosaic *mosaic, bool rows,
+                           uint32_t *out_length) {
+    uint64_t *keys = mem_malloc(sizeof(uint64_t) * (mosaic->count + 1));
+    uint32_t *active = mem_malloc(sizeof(uint32_t) * (mosaic->count + 1));
+    if (keys == NULL || active == NULL) {
+        mem_free(keys);
+        mem_free(active);
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate mosaic stitching!\n");
+    }
+    /* tiles ordered by the first row (column) they cover */
+    for (uint32_t i = 0; i < mosaic->count; i++) {
+        const MosaicTile *tile = &mosaic->tiles[i];
+        keys[i] = (uint64_t)(rows ? tile->row : tile->col) << 32 | i;
+    }
+    qsort(keys, mosaic->count, sizeof(uint64_t), mosaic_key_cmp);
+
+    const uint32_t lines = rows ? mosaic->dimensions.height
+                                : mosaic->dimensions.width;
+    uint32_t next = 0, count = 0, longest = 0;
+    for (uint32_t line = 0; line < lines; line++) {
+        /* drop tiles ending above the line */
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            const MosaicTile *tile = &mosaic->tiles[active[i]];
+            const uint32_t    end = rows ? tile->row + tile->dimensions.height
+                                         : tile->col + tile->dimensions.width;
+            if (end > line) {
+                active[kept++] = active[i];
+            }
+        }
+        count = kept;
+        /* insert tiles starting at the line, ordered along the line */
+        for (; next < mosaic->count && keys[next] >> 32 == line; next++) {
+            const uint32_t    index = (uint32_t)keys[next];
+            const MosaicTile *tile = &mosaic->tiles[index];
+            const uint32_t    along = rows ? tile->col : tile->row;
+            uint32_t          at = count++;
+            for (; at > 0; at--) {
+                const MosaicTile *prev = &mosaic->tiles[active[at - 1]];
+                if ((rows ? prev->col : prev->row) < along) {
+                    break;
+                }
+                active[at] = active[at - 1];
+            }
+            active[at] = index;
+        }
+        /* carry the run through adjacent tiles */
+        uint32_t carry = 0, carry_end = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            const MosaicTile *tile = &mosaic->tiles[active[i]];
+            const uint32_t    along = rows ? tile->col : tile->row;
+            const uint32_t    length = rows ? tile->dimensions.width
+                                            : tile->dimensions.height;
+            const uint32_t    at = line - (rows ? tile->row : tile->col);
+            const uint32_t    head = rows ? tile->row_head[at]
+                                          : tile->col_head[at];
+            const uint32_t    tail = rows ? tile->row_tail[at]
+                                          : tile->col_tail[at];
+            if (along != carry_end) {
+                carry = 0;
+            }
+            if (head == length) {
+                carry += length;
+            } else {
+                if (carry + head > longest) {
+                    longest = carry + head;
+                }
+                carry = tail;
+            }
+            if (carry > longest) {
+                longest = carry;
+            }
+            carry_end = along + length;
+        }
+    }
+    mem_free(keys);
+    mem_free(active);
+    *out_length = longest;
+    return error_none();
+}
+
+/**
+ * @brief loads all tiles of the mosaic in parallel into the staging buffer,
+ * stitching the tiles gives the exact longest hline/vline, they are stored
+ * as the bitmap bounds so searches only look for lines of that length and
+ * squares no longer than them
+ * @note expects the file pointer to be at the beginning of the manifest */
+static Error bmp_loader_load_mosaic(FILE *file, BitmapLoader *restrict loader) {
+    Mosaic mosaic;
+    Error  err = mosaic_parse(file, loader->file_name, &mosaic);
+    if (err.code != ERR_NONE) {
+        return err;
+    }
+    mosaic.threshold = loader->threshold;
+    mosaic.bmp = &loader->staging;
+    err = mosaic_place_tiles(&mosaic);
+    if (err.code == ERR_NONE) {
+        err = bmp_ctor(mosaic.dimensions, &loader->staging);
+    }
+    if (err.code == ERR_NONE) {
+        memset(loader->staging.data, PXL_EMPTY,
+               bmp_size_raw(mosaic.dimensions));
+        parallel_for(mosaic.count, 1, mosaic_load_tiles, &mosaic);
+    }
+    for (uint32_t i = 0; err.code == ERR_NONE && i < mosaic.count; i++) {
+        err = mosaic.tiles[i].err;
+        mosaic.tiles[i].err = error_none();
+    }
+    BitmapBounds bounds = {0, 0, BMP_BOUND_UNKNOWN};
+    for (uint32_t i = 0; err.code == ERR_NONE && i < mosaic.count; i++) {
+        const MosaicTile *tile = &mosaic.tiles[i];
+        bounds.hline = tile->hline > bounds.hline ? tile->hline : bounds.hline;
+        bounds.vline = tile->vline > bounds.vline ? tile->vline : bounds.vline;
+    }
+    uint32_t hline = 0, vline = 0;
+    if (err.code == ERR_NONE) {
+        err = mosaic_stitch(&mosaic, true, &hline);
+    }
+    if (err.code == ERR_NONE) {
+        err = mosaic_stitch(&mosaic, false, &vline);
+    }
+    if (err.code == ERR_NONE) {
+        bounds.hline = hline > bounds.hline ? hline : bounds.hline;
+        bounds.vline = vline > bounds.vline ? vline : bounds.vline;
+        loader->staging.cache->bounds = bounds;
+        loader->size = bmp_size_raw(mosaic.dimensions);
+    }
+    mosaic_dtor(&mosaic);
+    return err;
+}
+
+/**
+ * @brief loads bitmap `file_name`, which may be a bitmap expression as well,
+ * PGM bitmaps are thresholded by `threshold`
+ * @return error of the loader when the bitmap file is not valid */
+static Error bmp_load(const char *file_name, uint32_t threshold,
+                      Bitmap *out_bmp) {
+    if (bmp_expr_is_expression(file_name)) {
+        return bmp_expr_load(file_name, threshold, out_bmp);
+    }
+    BitmapLoader loader = bmp_loader_ctor(file_name);
+    loader.threshold = threshold;
+    Error err = bmp_loader_load(&loader);
+    if (err.code != ERR_NONE) {
+        bmp_loader_dtor(&loader);
+        return err;
+    }
+    *out_bmp = bmp_loader_get_bitmap(&loader);
+    return error_none();
+}
+
+/* =========================================
+ *                 Point
+ * ========================================= */
+
+/** @brief constructs Point */
+static inline Point point_ctor(uint32_t x, uint32_t y) { return (Point){x, y}; }
+
+/** @brief constructs Point and populates it with invalid data */
+static inline Point point_invalid_ctor() {
+    return (Point){COORD_INVALID, COORD_INVALID};
+}
+
+/** @brief checks whether a given point has invalid coordinates */
+static inline bool point_is_invalid(Point p) {
+    return p.x == COORD_INVALID || p.y == COORD_INVALID;
+}
+
+/* =========================================
+ *              ShapeGeometry
+ * ========================================= */
+
+/** @brief constructs basic shape from given points */
+static inline ShapeGeometry shape_geometry_ctor(Point start, Point end) {
+    return (ShapeGeometry){start, end};
+}
+/** @brief constructs invalid shape */
+static inline ShapeGeometry shape_geometry_invalid_ctor() {
+    return shape_geometry_ctor(point_invalid_ctor(), point_invalid_ctor());
+}
+/**
+ * @brief compares two shapes based on their size
+ * @return <0...lhs<rhs; >0...lhs>rhs; =0...lhs==rhs */
+static int shape_geometry_cmp(const ShapeGeometry lhs, const ShapeGeometry rhs,
+                              uint32_t (*size_func)(const ShapeGeometry)) {
+    uint32_t length_delta = size_func(lhs) - size_func(rhs);
+    if (length_delta != 0) {
+        return length_delta;
+    }
+    if (lhs.start.y != rhs.start.y) {
+        return rhs.start.y - lhs.start.y;
+    }
+    return rhs.start.x - lhs.start.x;
+}
+static inline void shape_geometry_fprint(FILE               *out,
+                                         const ShapeGeometry shape) {
+    fprintf(out, "%" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu32 "\n",
+            shape.start.y, shape.start.x, shape.end.y, shape.end.x);
+}
+static inline void shape_geometry_print(const ShapeGeometry shape) {
+    shape_geometry_fprint(stdout, shape);
+}
+static inline bool shape_geometry_is_invalid(const ShapeGeometry shape) {
+    return point_is_invalid(shape.start) || point_is_invalid(shape.end);
+}
+
+/* =========================================
+ *              Search Context
+ * ========================================= */
+
+/** @brief counters describing the work done by a search (printed on --stats) */
+typedef struct SearchStats {
+    /** @brief number of bitmap rows seen by the row store */
+    uint32_t rows;
+    /** @brief number of distinct rows kept by the row store */
+    uint32_t unique_rows;
+    /** @brief number of runs of identical consecutive rows */
+    uint32_t row_runs;
+    /** @brief number of rows/columns walked with the pyramid */
+    uint32_t pyramid_lines;
+    /** @brief number of rows/columns the pyramid proved not worth a scan */
+    uint32_t pyramid_skipped;
+    /** @brief number of top-left corners square anchors are taken from */
+    uint64_t corners;
+    /** @brief number of filled pixels (potential anchors without corners) */
+    uint64_t filled;
+    /** @brief the corner masks were dropped, anchors are all filled pixels */
+    bool corners_dropped;
+    /** @brief number of pixels read by the skip scans */
+    uint64_t probed;
+    /** @brief number of pixels of the bitmap scanned by the skip scans */
+    uint64_t pixels;
+} SearchStats;
+
+/** @brief number of ties kept in memory before they are spilled to disk */
+#define TIE_SINK_BATCH (1024)
+
+/**
+ * @brief collects every shape of the maximal size within a single scan
+ *
+ * Ties of the current maximum are batched in a fixed buffer which is spilled
+ * to an anonymous temporary file when full, so memory stays bounded no matter
+ * how many ties there are. A larger shape just rewinds the sink. When the
+ * maximal size is known before the scan (@see BitmapBounds), ties are written
+ * straight to the output. */
+typedef struct TieSink {
+    FILE *out;
+    /** @brief maximal size known upfront or BMP_BOUND_UNKNOWN */
+    uint32_t exact;
+    /** @brief size of the collected ties */
+    uint32_t size;
+    /** @brief spill file (created on first overflow of the batch) */
+    FILE *spill;
+    /** @brief number of ties written to the spill file */
+    uint64_t spilled;
+    size_t   buffered;
+    ShapeGeometry batch[TIE_SINK_BATCH];
+} TieSink;
+
+#ifndef FIGSEARCH_NO_MAIN
+
+/** @brief initializes sink writing ties of size `exact` (if known) to `out` */
+static void tie_sink_init(TieSink *sink, FILE *out, uint32_t exact) {
+    sink->out = out;
+    sink->exact = exact;
+    sink->size = 0;
+    sink->spill = NULL;
+    sink->spilled = 0;
+    sink->buffered = 0;
+}
+
+static void tie_sink_dtor(TieSink *sink) {
+    if (sink->spill != NULL) {
+        fclose(sink->spill);
+        sink->spill = NULL;
+    }
+}
+
+#endif /* FIGSEARCH_NO_MAIN */
+
+/** @brief moves the batch to the spill file */
+static Error tie_sink_flush(TieSink *sink) {
+    if (sink->spill == NULL && (sink->spill = tmpfile()) == NULL) {
+        return error_ctor(ERR_INTERNAL, "Failed to create tie spill file! "
+                                        "Os error: %s", strerror(errno));
+    }
+    if (fwrite(sink->batch, sizeof(*sink->batch), sink->buffered,
+               sink->spill) != sink->buffered) {
+        return error_ctor(ERR_INTERNAL, "Failed to spill ties! Os error: %s",
+                          strerror(errno));
+    }
+    sink->spilled += sink->buffered;
+    sink->buffered = 0;
+    return error_none();
+}
+
+/** @brief offers `shape` of given `size`, shapes smaller than the collected
+ * ties are ignored, larger ones discard them */
+static Error tie_sink_add(TieSink *sink, ShapeGeometry shape, uint32_t size) {
+    if (sink->exact != BMP_BOUND_UNKNOWN) {
+        if (size == sink->exact) {
+            shape_geometry_fprint(sink->out, shape);
+        }
+        return error_none();
+    }
+    if (size < sink->size) {
+        return error_none();
+    }
+    if (size > sink->size) {
+        sink->size = size;
+        sink->buffered = 0;
+        sink->spilled = 0;
+        if (sink->spill != NULL) {
+            rewind(sink->spill);
+        }
+    }
+    if (sink->buffered == TIE_SINK_BATCH) {
+        Error err = tie_sink_flush(sink);
+        if (err.code != ERR_NONE) {
+            return err;
+        }
+    }
+    sink->batch[sink->buffered++] = shape;
+    return error_none();
+}
+
+#ifndef FIGSEARCH_NO_MAIN
+
+/** @brief writes the collected ties to the output (in order of discovery) */
+static Error tie_sink_emit(TieSink *sink) {
+    if (sink->spilled > 0) {
+        Error err = tie_sink_flush(sink);
+        if (err.code != ERR_NONE) {
+            return err;
+        }
+        rewind(sink->spill);
+        for (uint64_t left = sink->spilled; left > 0;) {
+            size_t chunk = left < TIE_SINK_BATCH ? left : TIE_SINK_BATCH;
+            if (fread(sink->batch, sizeof(*sink->batch), chunk, sink->spill) !=
+                chunk) {
+                return error_ctor(ERR_INTERNAL, "Failed to read spilled ties!");
+            }
+            for (size_t i = 0; i < chunk; i++) {
+                shape_geometry_fprint(sink->out, sink->batch[i]);
+            }
+            left -= chunk;
+        }
+        return error_none();
+    }
+    for (size_t i = 0; i < sink->buffered; i++) {
+        shape_geometry_fprint(sink->out, sink->batch[i]);
+    }
+    return error_none();
+}
+
+#endif /* FIGSEARCH_NO_MAIN */
+
+/** @brief state shared by a single shape search */
+typedef struct SearchContext {
+    SearchStats stats;
+    /** @brief first error an engine ran into (engines return invalid shape
+     * in such case) */
+    Error err;
+    /** @brief receives every maximal shape when ties were requested (engines
+     * supporting ties must not prune shapes equal to the maximum) */
+    TieSink *ties;
+    /** @brief when non-zero, any shape of at least this size is enough, the
+     * engines supporting it return the first such shape they come across */
+    uint32_t at_least;
+    /** @brief set when the search is no longer wanted, the rowmajor and the
+     * skip scans check it once per row/column (NULL when it cannot be cancelled)
+     * @see search_context_cancelled */
+    const atomic_bool *cancel;
+} SearchContext;
+
+/** @brief constructs empty search context */
+static inline SearchContext search_context_ctor(void) {
+    return (SearchContext){.stats = {0},
+                           .err = error_none(),
+                           .ties = NULL,
+                           .at_least = 0,
+                           .cancel = NULL};
+}
+
+/**
+ * @brief records `err` into the context (only the first error is kept)
+ * @return true when `err` is an error and the search should be abandoned */
+static bool search_context_fail(SearchContext *ctx, Error err) {
+    if (err.code == ERR_NONE) {
+        return false;
+    }
+    if (ctx->err.code == ERR_NONE) {
+        ctx->err = err;
+    } else {
+        error_dtor(&err);
+    }
+    return true;
+}
+
+/**
+ * @brief checks whether the search was cancelled, the context fails with
+ * ERR_CANCELLED then
+ * @return true when the search should be abandoned */
+static inline bool search_context_cancelled(SearchContext *ctx) {
+    if (ctx->cancel == NULL ||
+        !atomic_load_explicit(ctx->cancel, memory_order_relaxed)) {
+        return false;
+    }
+    search_context_fail(ctx,
+                        error_ctor(ERR_CANCELLED, "Search was cancelled!"));
+    return true;
+}
+
+/** @brief reports `shape` of `size` to the tie sink (if there is one) */
+static inline void search_context_tie(SearchContext *ctx, ShapeGeometry shape,
+                                      uint32_t size) {
+    if (ctx->ties != NULL) {
+        search_context_fail(ctx, tie_sink_add(ctx->ties, shape, size));
+    }
+}
+
+/* =========================================
+ *                 Pyramid
+ * ========================================= */
+
+/** @brief pyramid cell flag: some pixel of the block is filled (OR) */
+#define PYRAMID_ANY (0x1)
+/** @brief pyramid cell flag: every pixel of the block is filled (AND) */
+#define PYRAMID_ALL (0x2)
+/** @brief the coarsest level has blocks of 2^PYRAMID_MAX_LEVELS pixels */
+#define PYRAMID_MAX_LEVELS (16)
+/** @brief cell rows handed to a single thread while building the first level */
+#define PYRAMID_MIN_SLICE (64)
+/** @brief the pyramid is built only when at least 1/PYRAMID_EMPTY_SHARE of the
+ * rows of the bitmap are empty */
+#define PYRAMID_EMPTY_SHARE (16)
+
+/** @brief single level of the pyramid, level `l` (counted from 1) reduces
+ * blocks of 2^l x 2^l pixels (blocks on the right/bottom edge are clipped) */
+typedef struct PyramidLevel {
+    BitmapSize dimensions;
+    /** @brief PYRAMID_ANY/PYRAMID_ALL flags of each block (row-major) */
+    uint8_t *cells;
+    /** @brief longest horizontal line possible in each band of block rows */
+    uint32_t *row_bounds;
+    /** @brief longest vertical line possible in each band of block columns */
+    uint32_t *col_bounds;
+} PyramidLevel;
+
+/** @brief AND/OR pyramid of 2x2 reductions, coarse levels bound the shapes of
+ * whole bands of rows/columns so the searches descend only into the bands
+ * which can still beat the best shape found so far */
+typedef struct Pyramid {
+    BitmapSize   dimensions;
+    uint32_t     count;
+    PyramidLevel levels[PYRAMID_MAX_LEVELS];
+    /** @brief lengths of lines/squares known to exist (from PYRAMID_ALL) */
+    uint32_t hline_lower;
+    uint32_t vline_lower;
+    uint32_t square_lower;
+} Pyramid;
+
+/** @brief shared state of the parallel build of the first level */
+typedef struct PyramidBuild {
+    const Bitmap *bmp;
+    PyramidLevel *level;
+} PyramidBuild;
+
+#define pyramid_cell(level, row, col) \
+    ((level)->cells[(size_t)(row) * (level)->dimensions.width + (col)])
+
+/** @brief reduces pixels of the bitmap into cell rows [begin, end) of the
+ * first level */
+static void pyramid_build_first(void *arg, uint32_t begin, uint32_t end) {
+    const PyramidBuild *build = arg;
+    const Bitmap       *bmp = build->bmp;
+    PyramidLevel       *level = build->level;
+    const uint32_t      width = bmp->dimensions.width;
+    for (uint32_t row = begin; row < end; row++) {
+        const Pixel *top = &bmp_at(bmp, 2 * row, 0);
+        const Pixel *bottom = 2 * row + 1 < bmp->dimensions.height
+                                  ? top + width
+                                  : top; /* clipped block */
+        for (uint32_t col = 0; col < level->dimensions.width; col++) {
+            const uint32_t left = 2 * col;
+            const uint32_t right = left + 1 < width ? left + 1 : left;
+            const uint32_t filled =
+                (top[left] == PXL_FILLED) + (top[right] == PXL_FILLED) +
+                (bottom[left] == PXL_FILLED) + (bottom[right] == PXL_FILLED);
+            pyramid_cell(level, row, col) =
+                (filled > 0 ? PYRAMID_ANY : 0) |
+                (filled == 4 ? PYRAMID_ALL : 0);
+        }
+    }
+}
+
+/** @brief reduces 2x2 cells of `fine` level into `coarse` level */
+static void pyramid_build_coarse(const PyramidLevel *fine,
+                                 const PyramidLevel *coarse) {
+    for (uint32_t row = 0; row < coarse->dimensions.height; row++) {
+        const uint32_t top = 2 * row;
+        const uint32_t bottom =
+            top + 1 < fine->dimensions.height ? top + 1 : top;
+        for (uint32_t col = 0; col < coarse->dimensions.width; col++) {
+            const uint32_t left = 2 * col;
+            const uint32_t right =
+                left + 1 < fine->dimensions.width ? left + 1 : left;
+            const uint8_t any = pyramid_cell(fine, top, left) |
+                                pyramid_cell(fine, top, right) |
+                                pyramid_cell(fine, bottom, left) |
+                                pyramid_cell(fine, bottom, right);
+            const uint8_t all = pyramid_cell(fine, top, left) &
+                                pyramid_cell(fine, top, right) &
+                                pyramid_cell(fine, bottom, left) &
+                                pyramid_cell(fine, bottom, right);
+            pyramid_cell(coarse, row, col) =
+                (any & PYRAMID_ANY) | (all & PYRAMID_ALL);
+        }
+    }
+}
+
+/** @return number of pixels covered by `count` blocks of `block` pixels
+ * ending with block `last` (inclusive), clipped at `limit` pixels */
+static inline uint32_t pyramid_span(uint32_t last, uint32_t count,
+                                    uint32_t block, uint32_t limit) {
+    const uint64_t end = ((uint64_t)last + 1) * block;
+    const uint64_t begin = ((uint64_t)last + 1 - count) * block;
+    return (uint32_t)((end < limit ? end : limit) - begin);
+}
+
+/**
+ * @brief computes line bounds of each band of `level` (blocks of `block`
+ * pixels) and raises the lower bounds of `pyr` by its PYRAMID_ALL blocks
+ * @return ERR_ALLOCATION_FAILURE when the column runs could not be allocated */
+static Error pyramid_level_bounds(Pyramid *pyr, PyramidLevel *level,
+                                  uint32_t block) {
+    const BitmapSize cells = level->dimensions;
+    const uint32_t   width = pyr->dimensions.width;
+    const uint32_t   height = pyr->dimensions.height;
+    /* runs of ANY/ALL cells ending in the current row of each column */
+    uint32_t *any_runs = mem_calloc(cells.width, sizeof(uint32_t));
+    uint32_t *all_runs = mem_calloc(cells.width, sizeof(uint32_t));
+    if (any_runs == NULL || all_runs == NULL) {
+        mem_free(any_runs);
+        mem_free(all_runs);
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate pyramid!\n");
+    }
+    for (uint32_t row = 0; row < cells.height; row++) {
+        uint32_t any_run = 0, all_run = 0, bound = 0;
+        const uint32_t block_height = pyramid_span(row, 1, block, height);
+        for (uint32_t col = 0; col < cells.width; col++) {
+            const uint8_t cell = pyramid_cell(level, row, col);
+            const bool    any = cell & PYRAMID_ANY, all = cell & PYRAMID_ALL;
+            any_run = any ? any_run + 1 : 0;
+            all_run = all ? all_run + 1 : 0;
+            any_runs[col] = any ? any_runs[col] + 1 : 0;
+            all_runs[col] = all ? all_runs[col] + 1 : 0;
+            if (any_run > 0) {
+                const uint32_t span = pyramid_span(col, any_run, block, width);
+                bound = span > bound ? span : bound;
+            }
+            if (any_runs[col] > 0) {
+                const uint32_t span =
+                    pyramid_span(row, any_runs[col], block, height);
+                if (span > level->col_bounds[col]) {
+                    level->col_bounds[col] = span;
+                }
+            }
+            if (!all) {
+                continue;
+            }
+            /* every pixel of an ALL block is filled, so each of its rows
+             * (columns) holds the whole span and the block a square frame */
+            const uint32_t hspan = pyramid_span(col, all_run, block, width);
+            const uint32_t vspan =
+                pyramid_span(row, all_runs[col], block, height);
+            const uint32_t block_width = pyramid_span(col, 1, block, width);
+            const uint32_t side =
+                block_width < block_height ? block_width : block_height;
+            if (hspan > pyr->hline_lower) {
+                pyr->hline_lower = hspan;
+            }
+            if (vspan > pyr->vline_lower) {
+                pyr->vline_lower = vspan;
+            }
+            if (side > pyr->square_lower) {
+                pyr->square_lower = side;
+            }
+        }
+        level->row_bounds[row] = bound;
+    }
+    mem_free(any_runs);
+    mem_free(all_runs);
+    return error_none();
+}
+
+/** @brief destroys pyramid's allocated memory */
+static void pyramid_dtor(Pyramid *pyr) {
+    for (uint32_t i = 0; i < pyr->count; i++) {
+        mem_free(pyr->levels[i].cells);
+        mem_free(pyr->levels[i].row_bounds);
+        mem_free(pyr->levels[i].col_bounds);
+    }
+    *pyr = (Pyramid){0};
+}
+
+/**
+ * @brief builds levels of the pyramid until a level reduces into single block
+ * @return ERR_ALLOCATION_FAILURE when a level could not be allocated */
+static Error pyramid_ctor(const Bitmap *bmp, Pyramid *out_pyr) {
+    *out_pyr = (Pyramid){.dimensions = bmp->dimensions};
+    BitmapSize cells = bmp->dimensions;
+    while (out_pyr->count < PYRAMID_MAX_LEVELS &&
+           (out_pyr->count == 0 || cells.width > 1 || cells.height > 1)) {
+        cells = (BitmapSize){(cells.width + 1) / 2, (cells.height + 1) / 2};
+        PyramidLevel *level = &out_pyr->levels[out_pyr->count++];
+        *level = (PyramidLevel){
+            .dimensions = cells,
+            .cells = mem_malloc(bmp_size_raw(cells)),
+            .row_bounds = mem_malloc(sizeof(uint32_t) * cells.height),
+            .col_bounds = mem_calloc(cells.width, sizeof(uint32_t)),
+        };
+        if (level->cells == NULL || level->row_bounds == NULL ||
+            level->col_bounds == NULL) {
+            pyramid_dtor(out_pyr);
+            return error_ctor(ERR_ALLOCATION_FAILURE,
+                              "Failed to allocate pyramid!\n");
+        }
+        if (out_pyr->count == 1) {
+            PyramidBuild build = {bmp, level};
+            parallel_for(cells.height, PYRAMID_MIN_SLICE, pyramid_build_first,
+                         &build);
+        } else {
+            pyramid_build_coarse(level - 1, level);
+        }
+        Error err =
+            pyramid_level_bounds(out_pyr, level, UINT32_C(1) << out_pyr->count);
+        if (err.code != ERR_NONE) {
+            pyramid_dtor(out_pyr);
+            return err;
+        }
+    }
+    return error_none();
+}
+
+/**
+ * @brief checks whether the pyramid may rule out whole bands, which needs
+ * empty blocks and so empty rows
+ *
+ * Each row is read only up to its first filled pixel, so a dense bitmap costs
+ * a few pixels per row and only the empty rows are read whole. Bitmaps with
+ * no empty band pay for building the pyramid and never skip a row.
+ * @return true if at least 1/PYRAMID_EMPTY_SHARE of the rows are empty */
+static bool pyramid_worthwhile(const Bitmap *bmp) {
+    const uint32_t width = bmp->dimensions.width;
+    const uint32_t height = bmp->dimensions.height;
+    const uint32_t needed = height / PYRAMID_EMPTY_SHARE;
+    uint32_t       empty = 0;
+    for (uint32_t row = 0; row < height; row++) {
+        const Pixel *pixels = &bmp_at(bmp, row, 0);
+        uint32_t     col = 0;
+        while (col < width && pixels[col] != PXL_FILLED) {
+            col++;
+        }
+        if (col == width && ++empty > needed) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief retrieves pyramid of the bitmap, builds it on first use
+ * @note pyramid is NULL when the bitmap is not worth it @see
+ * pyramid_worthwhile
+ * @return ERR_ALLOCATION_FAILURE when the pyramid could not be built */
+static Error pyramid_cached(const Bitmap *bmp, const Pyramid **out_pyr) {
+    if (bmp->cache->pyramid == NULL && !bmp->cache->pyramid_rejected &&
+        !pyramid_worthwhile(bmp)) {
+        bmp->cache->pyramid_rejected = true;
+    }
+    if (bmp->cache->pyramid == NULL && !bmp->cache->pyramid_rejected) {
+        Pyramid *pyr = mem_malloc(sizeof(Pyramid));
+        if (pyr == NULL) {
+            return error_ctor(ERR_ALLOCATION_FAILURE,
+                              "Failed to allocate pyramid!\n");
+        }
+        Error err = pyramid_ctor(bmp, pyr);
+        if (err.code != ERR_NONE) {
+            mem_free(pyr);
+            return err;
+        }
+        bmp->cache->pyramid = pyr;
+    }
+    *out_pyr = bmp->cache->pyramid;
+    return error_none();
+}
+
+/**
+ * @brief walks the pyramid coarse-to-fine, skipping every band whose bound is
+ * below `needed`, skipped rows (columns) are counted into `stats`
+ * @param rows true to walk rows (horizontal lines), false to walk columns
+ * @return first row (column) from `index` on which may hold a line of
+ * `needed` pixels, number of rows (columns) when there is none, `index`
+ * itself without a pyramid */
+static uint32_t pyramid_next(const Pyramid *pyr, bool rows, uint32_t index,
+                             uint32_t needed, SearchStats *stats) {
+    if (pyr == NULL) {
+        return index;
+    }
+    const uint32_t limit =
+        rows ? pyr->dimensions.height : pyr->dimensions.width;
+    const uint32_t start = index;
+    uint32_t       level = pyr->count;
+    while (index < limit && level > 0) {
+        const PyramidLevel *lvl = &pyr->levels[level - 1];
+        const uint32_t      band = index >> level;
+        if ((rows ? lvl->row_bounds : lvl->col_bounds)[band] >= needed) {
+            level--; /* descend into the band */
+            continue;
+        }
+        const uint64_t next = ((uint64_t)band + 1) << level;
+        index = next < limit ? (uint32_t)next : limit;
+        /* climb back while the next band starts a coarser band as well */
+        while (level < pyr->count &&
+               (index & ((UINT32_C(2) << level) - 1)) == 0) {
+            level++;
+        }
+    }
+    stats->pyramid_skipped += index - start;
+    return index;
+}
+
+/* =========================================
+ *                  Line
+ * ========================================= */
+
+/** @brief defines a line by its begin and end point */
+typedef ShapeGeometry Line;
+typedef Line          VLine;  // [V]ertical
+typedef Line          HLine;  // [H]orizontal
+
+#define line_ctor(start, end) shape_geometry_ctor((start), (end))
+#define line_invalid_ctor()   shape_geometry_invalid_ctor()
+#define line_is_invalid(line) shape_geometry_is_invalid((line))
+#define line_print(line)      shape_geometry_print((line))
+#define hline_cmp(lhs, rhs)   shape_geometry_cmp((lhs), (rhs), hline_length)
+#define vline_cmp(lhs, rhs)   shape_geometry_cmp((lhs), (rhs), vline_length)
+
+/** @brief calculates length of horizontal line */
+static inline uint32_t hline_length(HLine line) {
+    return line.end.x - line.start.x + 1;
+}
+/** @brief calculates length of vertical line */
+static inline uint32_t vline_length(VLine line) {
+    return line.end.y - line.start.y + 1;
+}
+
+/**
+ * @brief searches for a vertical line from `begin` in bitmap
+ * @return invalid horizontal line if given point is not set */
+static inline HLine line_find_hline(const Bitmap *bmp, const Point begin) {
+    if (bmp_at(bmp, begin.y, begin.x) == PXL_FILLED) {
+        /* iterate until hit empty pixel or end of row */
+        uint32_t x_track = begin.x + 1;
+        for (; x_track < bmp->dimensions.width &&
+               bmp_at(bmp, begin.y, x_track) == PXL_FILLED;
+             x_track++)
+            ;
+        return line_ctor(begin, point_ctor(x_track - 1, begin.y));
+    }
+    return line_invalid_ctor();
+}
+
+/** @see line_find_hline */
+static inline VLine line_find_vline(const Bitmap *bmp, const Point begin) {
+    if (bmp_at(bmp, begin.y, begin.x) == PXL_FILLED) {
+        /* iterate until hit empty pixel or end of column */
+        uint32_t y_track = begin.y + 1;
+        for (; y_track < bmp->dimensions.height &&
+               bmp_at(bmp, y_track, begin.x) == PXL_FILLED;
+             y_track++) {
+        }
+        return line_ctor(begin, point_ctor(begin.x, y_track - 1));
+    }
+    return line_invalid_ctor();
+}
+
+/** @brief scans for longest horizontal line */
+static HLine line_find_longest_hline(const Bitmap *bmp, SearchContext *ctx) {
+    /* with ties lines as long as the maximum have to be scanned too */
+    const Pyramid *pyr;
+    if (search_context_fail(ctx, pyramid_cached(bmp, &pyr))) {
+        return line_invalid_ctor();
+    }
+    const uint32_t ties = ctx->ties != NULL;
+    HLine          max = line_invalid_ctor(), temp = {0};
+    /* starts which cannot reach a known lower bound are not worth a scan */
+    uint32_t max_length =
+        bmp_bound_line_lower(bmp, bmp->cache->bounds.hline);
+    if (pyr != NULL && pyr->hline_lower > max_length) {
+        max_length = pyr->hline_lower;
+    }
+    if (ctx->at_least != 0) {
+        max_length = ctx->at_least;
+    }
+    max_length = max_length > 0 ? max_length - 1 : 0;
+    /* iterate over rows whose band may still hold a longer line */
+    ctx->stats.pyramid_lines = pyr != NULL ? bmp->dimensions.height : 0;
+    for (uint32_t row =
+             pyramid_next(pyr, true, 0, max_length + 1 - ties, &ctx->stats);
+         row < bmp->dimensions.height;
+         row = pyramid_next(pyr, true, row + 1, max_length + 1 - ties,
+                            &ctx->stats)) {
+        if (search_context_cancelled(ctx)) {
+            return line_invalid_ctor();
+        }
+        /* scan each line for any horizontal line matches */
+        for (uint32_t col = 0; col < bmp->dimensions.width &&
+                               col + max_length < bmp->dimensions.width + ties;
+             col++) {
+            temp = line_find_hline(bmp, (Point){col, row});
+            if (line_is_invalid(temp)) {
+                continue;
+            }
+            col = temp.end.x;
+            if (ctx->at_least != 0) {
+                if (hline_length(temp) >= ctx->at_least) {
+                    return temp;
+                }
+                continue;
+            }
+            search_context_tie(ctx, temp, hline_length(temp));
+            if (line_is_invalid(max) || hline_cmp(max, temp) < 0) {
+                max = temp;
+                max_length = hline_length(max);
+            }
+        }
+    }
+    return max;
+}
+
+/** @brief scans for longest vertical line */
+static VLine line_find_longest_vline(const Bitmap *bmp, SearchContext *ctx) {
+    const Pyramid *pyr;
+    if (search_context_fail(ctx, pyramid_cached(bmp, &pyr))) {
+        return line_invalid_ctor();
+    }
+    const uint32_t ties = ctx->ties != NULL;
+    VLine          max = line_invalid_ctor(), temp = {0};
+    /* @see line_find_longest_hline */
+    uint32_t max_length =
+        bmp_bound_line_lower(bmp, bmp->cache->bounds.vline);
+    if (pyr != NULL && pyr->vline_lower > max_length) {
+        max_length = pyr->vline_lower;
+    }
+    if (ctx->at_least != 0) {
+        max_length = ctx->at_least;
+    }
+    max_length = max_length > 0 ? max_length - 1 : 0;
+    /* iterate over columns whose band may still hold a line as long as the
+     * longest one (it wins when it starts on an upper row), a witness has to
+     * be longer */
+    const uint32_t witness = ctx->at_least != 0;
+    ctx->stats.pyramid_lines = pyr != NULL ? bmp->dimensions.width : 0;
+    for (uint32_t col = pyramid_next(pyr, false, 0, max_length + witness,
+                                     &ctx->stats);
+         col < bmp->dimensions.width;
+         col = pyramid_next(pyr, false, col + 1, max_length + witness,
+                            &ctx->stats)) {
+        if (search_context_cancelled(ctx)) {
+            return line_invalid_ctor();
+        }
+        /* scan each line for any vertical line matches */
+        for (uint32_t row = 0; row < bmp->dimensions.height &&
+                               row + max_length < bmp->dimensions.height + ties;
+             row++) {
+            temp = line_find_vline(bmp, (Point){col, row});
+            if (line_is_invalid(temp)) {
+                continue;
+            }
+            row = temp.end.y;
+            if (ctx->at_least != 0) {
+                if (vline_length(temp) >= ctx->at_least) {
+                    return temp;
+                }
+                continue;
+            }
+            search_context_tie(ctx, temp, vline_length(temp));
+            if (line_is_invalid(max) || vline_cmp(max, temp) < 0) {
+                max = temp;
+                max_length = vline_length(max);
+            }
+        }
+    }
+    return max;
+}
+
+/* =========================================
+ *               Corner Masks
+ * ========================================= */
+
+/** @brief rows handed to a single thread while building corner masks */
+#define CORNER_MASKS_MIN_SLICE (256)
+/** @brief masks are kept only while at most this percentage of the filled
+ * pixels are top-left corners */
+#define CORNER_MASKS_MAX_PERCENT (75)
+
+/**
+ * @brief packed rows (@see bmp_row_pack) of the pixels which can be corners
+ * of a square larger than a single pixel
+ *
+ * Top-left corner has its right and its lower neighbour filled, bottom-right
+ * corner its left and its upper one. Both masks are built by shifts and ANDs
+ * of whole words of the neighbouring rows.
+ * @note masks of dense bitmaps keep nearly every filled pixel, walking their
+ * bits costs more than it skips, so they are dropped (NULL) and only the
+ * counts are kept @see CORNER_MASKS_MAX_PERCENT */
+typedef struct CornerMasks {
+    /** @brief number of words of each row */
+    uint32_t  words;
+    uint64_t *top_left;
+    uint64_t *bottom_right;
+    /** @brief number of set bits of `top_left` @see SearchStats */
+    uint64_t  corners;
+    uint64_t  filled;
+} CornerMasks;
+
+/** @brief shared state of the parallel build of the masks */
+typedef struct CornerMasksBuild {
+    const Bitmap *bmp;
+    CornerMasks  *corners;
+    /** @brief rows of the bitmap packed as they are */
+    uint64_t *rows;
+} CornerMasksBuild;
+
+#define corner_masks_row(corners, mask, row) \
+    (&(corners)->mask[(size_t)(row) * (corners)->words])
+#define corner_masks_bit(corners, mask, row, col)                        \
+    ((corner_masks_row((corners), mask, (row))[(col) / BMP_ROW_WORD_BITS] >> \
+      ((col) % BMP_ROW_WORD_BITS)) &                                         \
+     1)
+
+/** @brief packs rows [begin, end) of the bitmap */
+static void corner_masks_build_rows(void *arg, uint32_t begin, uint32_t end) {
+    const CornerMasksBuild *build = arg;
+    for (uint32_t row = begin; row < end; row++) {
+        bmp_row_pack(&bmp_at(build->bmp, row, 0), build->bmp->dimensions.width,
+                     &build->rows[(size_t)row * build->corners->words]);
+    }
+}
+
+/** @brief masks corners of rows [begin, end), neighbours outside of the
+ * bitmap are empty */
+static void corner_masks_build_masks(void *arg, uint32_t begin, uint32_t end) {
+    const CornerMasksBuild *build = arg;
+    CornerMasks            *corners = build->corners;
+    const uint32_t          words = corners->words;
+    const uint32_t          height = build->bmp->dimensions.height;
+    for (uint32_t row = begin; row < end; row++) {
+        const uint64_t *pixels = &build->rows[(size_t)row * words];
+        const uint64_t *up =
+            row > 0 ? &build->rows[(size_t)(row - 1) * words] : NULL;
+        const uint64_t *down =
+            row + 1 < height ? &build->rows[(size_t)(row + 1) * words] : NULL;
+        uint64_t *top_left = corner_masks_row(corners, top_left, row);
+        uint64_t *bottom_right = corner_masks_row(corners, bottom_right, row);
+        for (uint32_t word = 0; word < words; word++) {
+            const uint64_t right =
+                pixels[word] >> 1 |
+                (word + 1 < words ? pixels[word + 1] << 63 : 0);
+            const uint64_t left =
+                pixels[word] << 1 | (word > 0 ? pixels[word - 1] >> 63 : 0);
+            top_left[word] =
+                down != NULL ? pixels[word] & right & down[word] : 0;
+            bottom_right[word] =
+                up != NULL ? pixels[word] & left & up[word] : 0;
+        }
+    }
+}
+
+static void corner_masks_dtor(CornerMasks *corners) {
+    mem_free(corners->top_left);
+    *corners = (CornerMasks){0};
+}
+
+/**
+ * @brief builds corner masks of the bitmap, rows are packed in parallel
+ * first, then masked in parallel
+ * @return ERR_ALLOCATION_FAILURE when the masks could not be allocated */
+static Error corner_masks_ctor(const Bitmap *bmp, CornerMasks *out_corners) {
+    const uint32_t height = bmp->dimensions.height;
+    const uint32_t words =
+        (bmp->dimensions.width + BMP_ROW_WORD_BITS - 1) / BMP_ROW_WORD_BITS;
+    const size_t size = (size_t)height * words;
+    uint64_t    *masks = mem_malloc(sizeof(uint64_t) * 2 * size + 1);
+    uint64_t    *rows = mem_malloc(sizeof(uint64_t) * size + 1);
+    if (masks == NULL || rows == NULL) {
+        mem_free(masks);
+        mem_free(rows);
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate corner masks!\n");
+    }
+    *out_corners = (CornerMasks){words, masks, masks + size, 0, 0};
+    CornerMasksBuild build = {bmp, out_corners, rows};
+    parallel_for(height, CORNER_MASKS_MIN_SLICE, corner_masks_build_rows,
+                 &build);
+    parallel_for(height, CORNER_MASKS_MIN_SLICE, corner_masks_build_masks,
+                 &build);
+    for (size_t i = 0; i < size; i++) {
+        out_corners->corners += bits_popcount64(out_corners->top_left[i]);
+        out_corners->filled += bits_popcount64(rows[i]);
+    }
+    mem_free(rows);
+    if (out_corners->corners * 100 >
+        out_corners->filled * CORNER_MASKS_MAX_PERCENT) {
+        mem_free(masks);
+        out_corners->top_left = out_corners->bottom_right = NULL;
+    }
+    return error_none();
+}
+
+/**
+ * @brief retrieves corner masks of the bitmap, builds them on first use
+ * @return ERR_ALLOCATION_FAILURE when the masks could not be built */
+static Error corner_masks_cached(const Bitmap       *bmp,
+                                 const CornerMasks **out_corners) {
+    if (bmp->cache->corners == NULL) {
+        CornerMasks *corners = mem_malloc(sizeof(CornerMasks));
+        if (corners == NULL) {
+            return error_ctor(ERR_ALLOCATION_FAILURE,
+                              "Failed to allocate corner masks!\n");
+        }
+        Error err = corner_masks_ctor(bmp, corners);
+        if (err.code != ERR_NONE) {
+            mem_free(corners);
+            return err;
+        }
+        bmp->cache->corners = corners;
+    }
+    *out_corners = bmp->cache->corners;
+    return error_none();
+}
+
+/**
+ * @brief finds the first top-left corner of `row` from `col` on, the set bits
+ * are iterated by counting trailing zeros
+ * @return width of the bitmap if there is no such corner */
+static uint32_t corner_masks_next(const CornerMasks *corners, uint32_t width,
+                                  uint32_t row, uint32_t col) {
+    const uint64_t *words = corner_masks_row(corners, top_left, row);
+    for (uint32_t word = col / BMP_ROW_WORD_BITS; word < corners->words;
+         word++) {
+        uint64_t bits = words[word];
+        if (word == col / BMP_ROW_WORD_BITS) {
+            bits &= ~UINT64_C(0) << (col % BMP_ROW_WORD_BITS);
+        }
+        if (bits != 0) {
+            const uint32_t found = word * BMP_ROW_WORD_BITS + bits_ctz64(bits);
+            return found < width ? found : width;
+        }
+    }
+    return width;
+}
+
+/* =========================================
+ *                  Square
+ * ========================================= */
+
+/** @brief Square is defined by its "top_left" point (ShapeGeometry::start) and
+ * its "bottom_right" point (ShapeGeometry::end) */
+typedef ShapeGeometry Square;
+
+#define square_ctor(start, end)   shape_geometry_ctor(start, end)
+#define square_invalid_ctor()     shape_geometry_invalid_ctor()
+#define square_is_invalid(square) shape_geometry_is_invalid(square)
+#define square_print(square)      shape_geometry_print(square)
+#define square_cmp(lhs, rhs)      shape_geometry_cmp(lhs, rhs, square_side_length)
+
+static inline uint32_t square_side_length(const Square s) {
+    return s.end.x - s.start.x + 1;
+}
+#define square_find_vertical_side(bmp, row, col) \
+    (line_find_vline((bmp), (Point){(col), (row)}))
+#define square_find_horizontal_side(bmp, row, col) \
+    (line_find_hline((bmp), (Point){(col), (row)}))
+
+/** @brief determines whether there exists valid square composed of `top_left`
+ * and `bottom_right` corner */
+static inline bool square_found_valid_square(const Bitmap *bmp, Point top_left,
+                                             Point bottom_right) {
+    HLine hline = square_find_horizontal_side(bmp, bottom_right.y, top_left.x);
+    VLine vline = square_find_vertical_side(bmp, top_left.y, bottom_right.x);
+
+    return hline.end.x >= bottom_right.x && vline.end.y >= bottom_right.y;
+}
+
+static inline void square_set_max_square(Square *max, uint32_t *max_length,
+                                         Square rhs) {
+    if (square_is_invalid(*max) || square_cmp(*max, rhs) < 0) {
+        *max = rhs;
+        *max_length = square_side_length(rhs);
+    }
+}
+
+/** @brief moves from `top_left` point horizontally and vertically, stops at the
+ * the nearest end or nearest empty pixel
+ * @note it is assumed that `top_left` is non-empty pixel
+ * @return point of ended iteration (from `top_left`) */
+static Point square_move_along_orthogonals(const Bitmap *bmp,
+                                           const Point   top_left) {
+    uint32_t x_track = top_left.x, y_track = top_left.y;
+    /* move horizontally and vertically until hit end / empty pixel */
+    for (;;) {
+        if (x_track >= bmp->dimensions.width ||
+            bmp_at(bmp, top_left.y, x_track) == PXL_EMPTY) {
+            break;
+        }
+
+        if (y_track >= bmp->dimensions.height ||
+            bmp_at(bmp, y_track, top_left.x) == PXL_EMPTY) {
+            break;
+        }
+
+        x_track++;
+        y_track++;
+    }
+    return (Point){x_track - 1, y_track - 1};
+}
+
+/** @brief square_found_valid_square preceded by the corner mask check of
+ * `bottom_right` (squares larger than a pixel end at a bottom-right corner),
+ * if the masks were kept */
+static inline bool square_found_valid_corners(const Bitmap      *bmp,
+                                              const CornerMasks *corners,
+                                              Point top_left, Point bottom_right) {
+    if (corners->bottom_right != NULL && bottom_right.x > top_left.x &&
+        !corner_masks_bit(corners, bottom_right, bottom_right.y,
+                          bottom_right.x)) {
+        return false;
+    }
+    return square_found_valid_square(bmp, top_left, bottom_right);
+}
+
+/**
+ * @return the first column of `row` from `col` on which may anchor a square,
+ * only top-left corners once the square has to be larger than a pixel
+ * @note width of the bitmap if there is no such column */
+static inline uint32_t square_next_anchor(const Bitmap      *bmp,
+                                          const CornerMasks *corners,
+                                          uint32_t row, uint32_t col,
+                                          bool corners_only) {
+    if (corners_only) {
+        return corner_masks_next(corners, bmp->dimensions.width, row, col);
+    }
+    while (col < bmp->dimensions.width && bmp_at(bmp, row, col) == PXL_EMPTY) {
+        col++;
+    }
+    return col;
+}
+
+/**
+ * @brief scans for the largest square in a bitmap, anchors are the set bits
+ * of the top-left corner mask (@see CornerMasks)
+ * @return invalid square if no square was found */
+static Square square_find_largest_square(const Bitmap    *bmp,
+                                         SearchContext *ctx) {
+    const Pyramid *pyr;
+    if (search_context_fail(ctx, pyramid_cached(bmp, &pyr))) {
+        return square_invalid_ctor();
+    }
+    const CornerMasks *corners = NULL;
+    if (search_context_fail(ctx, corner_masks_cached(bmp, &corners))) {
+        return square_invalid_ctor();
+    }
+    const bool ties = ctx->ties != NULL;
+    /* squares of the size anchored only at corners (larger than a pixel),
+     * every filled pixel is an anchor when the masks were dropped */
+    const uint32_t cornered =
+        corners->top_left != NULL ? 1 + (uint32_t)ties : UINT32_MAX;
+    Square     max = square_invalid_ctor();
+    /* a square at least as large as a fully filled block exists, with
+     * `at_least` only squares of that size are searched for */
+    uint32_t max_length =
+        pyr != NULL && pyr->square_lower > 0 ? pyr->square_lower - 1 : 0;
+    if (ctx->at_least != 0) {
+        max_length = ctx->at_least - 1;
+    }
+    /* no square can be larger than the bound known from previous searches */
+    const uint32_t upper = bmp_bound_square_upper(bmp);
+    const uint32_t height = bmp->dimensions.height;
+    ctx->stats.pyramid_lines = pyr != NULL ? height : 0;
+    ctx->stats.corners = corners->corners;
+    ctx->stats.corners_dropped = corners->top_left == NULL;
+    ctx->stats.filled = corners->filled;
+    for (uint32_t row = 0; row < height; row++) {
+        if (search_context_cancelled(ctx)) {
+            return square_invalid_ctor();
+        }
+        /* the top side of a square is a line of its side length, skip the
+         * bands which cannot hold a line long enough */
+        row = pyramid_next(pyr, true, row, max_length + !ties, &ctx->stats);
+        if (row >= height) {
+            break;
+        }
+        /* for every anchor, check whether it extends to orthogonal sides of a
+         * square (or itself in case of 1x1), a square larger than the current
+         * one (or as large with ties) needs more than one pixel from the
+         * first square on */
+        for (uint32_t col = square_next_anchor(bmp, corners, row, 0,
+                                               max_length >= cornered);
+             col < bmp->dimensions.width;
+             col = square_next_anchor(bmp, corners, row, col + 1,
+                                      max_length >= cornered)) {
+            /* check if the remaining scan area is still larger than the
+             * largest square we have found */
+            uint32_t remaining_area = (height - row) * bmp->dimensions.width;
+            if (ties ? max_length > height - row
+                     : max_length * max_length >= remaining_area ||
+                           max_length >= upper) {
+                return max;
+            }
+
+            /* determine the expected bottom point and check for the square,
+             * if parallel sides were not found, check for each square
+             * "inside" the range of left_up to the expected_bottom_right
+             * point */
+            const Point top_left = {col, row};
+            Point       expected_bottom_right =
+                square_move_along_orthogonals(bmp, top_left);
+
+            /* if (potential) square side length is lower than the current,
+             * no reason to continue */
+            if (max_length > expected_bottom_right.x - col + 1) {
+                continue;
+            }
+            if (expected_bottom_right.x - col + 1 > upper) {
+                expected_bottom_right =
+                    point_ctor(col + upper - 1, row + upper - 1);
+            }
+
+            /* if (potential) square is indeed valid square set it to max (if
+             * larger) */
+            if (square_found_valid_corners(bmp, corners, top_left,
+                                           expected_bottom_right)) {
+                const Square square =
+                    square_ctor(top_left, expected_bottom_right);
+                if (ctx->at_least != 0) {
+                    if (square_side_length(square) >= ctx->at_least) {
+                        return square;
+                    }
+                    continue;
+                }
+                search_context_tie(ctx, square, square_side_length(square));
+                square_set_max_square(&max, &max_length, square);
+                continue;
+            }
+
+            /* check each (potential) square inside the orthogonals, a
+             * witness cannot be smaller than `at_least` */
+            const uint32_t smallest =
+                ctx->at_least != 0 ? ctx->at_least - 1 : 0;
+            for (; expected_bottom_right.x >= col + smallest;
+                 expected_bottom_right.x--, expected_bottom_right.y--) {
+                if (square_found_valid_corners(bmp, corners, top_left,
+                                               expected_bottom_right)) {
+                    const Square square =
+                        square_ctor(top_left, expected_bottom_right);
+                    if (ctx->at_least != 0) {
+                        return square;
+                    }
+                    search_context_tie(ctx, square,
+                                       square_side_length(square));
+                    square_set_max_square(&max, &max_length, square);
+                    break;
+                }
+            }
+        }
+    }
+    return max;
+}
+
+/* =========================================
+ *                 Diamond
+ * ========================================= */
+
+#ifndef FIGSEARCH_NO_MAIN
+
+/** @brief Diamond is a square rotated by 45 degrees (its sides are diagonal
+ * lines) defined by its "top" vertex (ShapeGeometry::start) and its "bottom"
+ * vertex (ShapeGeometry::end), both vertices lie in the same column */
+typedef ShapeGeometry Diamond;
+
+#define diamond_ctor(top, bottom) shape_geometry_ctor(top, bottom)
+#define diamond_invalid_ctor()    shape_geometry_invalid_ctor()
+
+/** @brief lengths of the diagonal runs of filled pixels starting at every
+ * pixel, the runs go downwards so a diamond is checked from its top */
+typedef struct DiagonalRuns {
+    uint32_t  width;
+    /** @brief run towards the bottom right (diagonal) */
+    uint32_t *down_right;
+    /** @brief run towards the bottom left (anti-diagonal) */
+    uint32_t *down_left;
+} DiagonalRuns;
+
+#define diagonal_runs_at(runs, array, row, col) \
+    ((runs)->array[(size_t)(row) * (runs)->width + (col)])
+
+static void diagonal_runs_dtor(DiagonalRuns *runs) {
+    mem_free(runs->down_right);
+    runs->down_right = NULL;
+    runs->down_left = NULL;
+}
+
+/**
+ * @brief sweeps the rows from the bottom one upwards, the runs of a row
+ * extend the runs of the row below it
+ * @return error when the runs cannot be allocated */
+static Error diagonal_runs_ctor(const Bitmap *bmp, DiagonalRuns *out_runs) {
+    const uint32_t width = bmp->dimensions.width;
+    const uint32_t height = bmp->dimensions.height;
+    const size_t   pixels = (size_t)width * height;
+    uint32_t      *runs = mem_calloc(pixels, 2 * sizeof(uint32_t));
+    if (runs == NULL) {
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate diagonal runs!\n");
+    }
+    *out_runs = (DiagonalRuns){width, runs, runs + pixels};
+    for (uint32_t row = height; row-- > 0;) {
+        const bool below = row + 1 < height;
+        for (uint32_t col = 0; col < width; col++) {
+            if (bmp_at(bmp, row, col) != PXL_FILLED) {
+                continue;
+            }
+            diagonal_runs_at(out_runs, down_right, row, col) =
+                1 + (below && col + 1 < width
+                         ? diagonal_runs_at(out_runs, down_right, row + 1,
+                                            col + 1)
+                         : 0);
+            diagonal_runs_at(out_runs, down_left, row, col) =
+                1 + (below && col > 0 ? diagonal_runs_at(out_runs, down_left,
+                                                         row + 1, col - 1)
+                                      : 0);
+        }
+    }
+    return error_none();
+}
+
+/** @brief determines whether the lower sides of the diamond with `top` vertex
+ * and sides of `side` pixels are filled, the upper sides leaving `top` are
+ * assumed to be filled
+ * @note the lower sides leave the left and the right vertex, so only the runs
+ * of these two pixels are checked */
+static inline bool diamond_found_valid_diamond(const DiagonalRuns *runs,
+                                               Point top, uint32_t side) {
+    const uint32_t row = top.y + side - 1;
+    return diagonal_runs_at(runs, down_right, row, top.x - (side - 1)) >=
+               side &&
+           diagonal_runs_at(runs, down_left, row, top.x + (side - 1)) >= side;
+}
+
+/**
+ * @brief scans for the largest hollow diamond in a bitmap, the upper sides
+ * leaving a top vertex bound its size and every smaller size is checked in
+ * O(1) by the lower sides
+ * @return invalid diamond if there is no filled pixel */
+static Diamond diamond_find_largest_diamond(const Bitmap  *bmp,
+                                            SearchContext *ctx) {
+    DiagonalRuns runs = {0};
+    if (search_context_fail(ctx, diagonal_runs_ctor(bmp, &runs))) {
+        return diamond_invalid_ctor();
+    }
+    const uint32_t height = bmp->dimensions.height;
+    Diamond        max = diamond_invalid_ctor();
+    uint32_t       max_side = 0;
+    /* a larger diamond spans at least 2 * max_side + 1 rows from its top */
+    for (uint32_t row = 0; row < height && 2 * max_side < height - row;
+         row++) {
+        const uint32_t fit = (height - row + 1) / 2;
+        for (uint32_t col = 0; col < bmp->dimensions.width; col++) {
+            const uint32_t right = diagonal_runs_at(&runs, down_right, row, col);
+            const uint32_t left = diagonal_runs_at(&runs, down_left, row, col);
+            uint32_t       side = right < left ? right : left;
+            side = side < fit ? side : fit;
+            /* pixels are scanned in row-major order, so only a strictly
+             * larger diamond replaces the first one of the size */
+            const Point top = point_ctor(col, row);
+            for (; side > max_side; side--) {
+                if (diamond_found_valid_diamond(&runs, top, side)) {
+                    max = diamond_ctor(top,
+                                       point_ctor(col, row + 2 * (side - 1)));
+                    max_side = side;
+                    break;
+                }
+            }
+        }
+    }
+    diagonal_runs_dtor(&runs);
+    return max;
+}
+
+#endif /* FIGSEARCH_NO_MAIN */
+
+/* =========================================
+ *                 Segment
+ * ========================================= */
+
+#ifndef FIGSEARCH_NO_MAIN
+
+/** @brief number of directions searched by the segment command by default */
+#define SEGMENT_ANGLES_DEFAULT (8)
+/** @brief fixed point scale of the direction vectors */
+#define SEGMENT_DIRECTION_SCALE (1 << 20)
+#define SEGMENT_PI              (3.14159265358979323846)
+
+/** @brief digital straight segment is defined by its end pixels, the start is
+ * the one with the smaller row (then column)
+ * @note segment is rasterised from its upper end: its `i`-th pixel is `i`
+ * pixels further along the major axis of its direction and the rounded
+ * `i * slope` pixels further along the other one, so the same segment is
+ * found wherever it starts */
+typedef ShapeGeometry Segment;
+
+/** @brief the longest segment found in a single direction */
+typedef struct SegmentSweep {
+    Segment  best;
+    /** @brief number of pixels of the best segment (0 if there is none) */
+    uint32_t length;
+    /** @brief the sweep could not allocate its starts */
+    bool failed;
+} SegmentSweep;
+
+/** @brief shared state of the parallel sweeps over all directions */
+typedef struct SegmentSearch {
+    const Bitmap *bmp;
+    uint32_t      angles;
+    /** @brief number of words of each packed row */
+    uint32_t words;
+    /** @brief rows of the bitmap packed (@see bmp_row_pack) */
+    uint64_t *rows;
+    /** @brief result of each direction */
+    SegmentSweep *sweeps;
+} SegmentSearch;
+
+/** @return `index * num / den` rounded half away from zero */
+static inline int64_t segment_shift(uint32_t index, int64_t num, int64_t den) {
+    const int64_t magnitude =
+        ((int64_t)index * (num < 0 ? -num : num) + den / 2) / den;
+    return num < 0 ? -magnitude : magnitude;
+}
+
+/** @return column offset of the `index`-th pixel of a segment of direction
+ * (`dx`, `dy`) from its first pixel, the direction points downwards */
+static inline int64_t segment_offset_x(uint32_t index, int64_t dx,
+                                       int64_t dy) {
+    if (dy <= (dx < 0 ? -dx : dx)) {
+        return dx < 0 ? -(int64_t)index : (int64_t)index;
+    }
+    return segment_shift(index, dx, dy);
+}
+
+/** @return row offset of the `index`-th pixel @see segment_offset_x */
+static inline uint32_t segment_offset_y(uint32_t index, int64_t dx,
+                                        int64_t dy) {
+    const int64_t width = dx < 0 ? -dx : dx;
+    return dy <= width ? (uint32_t)segment_shift(index, dy, width) : index;
+}
+
+/** @return 64 pixels of packed `row` from column `col` on, pixels outside of
+ * the row are empty */
+static inline uint64_t segment_gather(const uint64_t *row, uint32_t words,
+                                      int64_t col) {
+    const int64_t bit = col & (BMP_ROW_WORD_BITS - 1);
+    const int64_t word = (col - bit) / BMP_ROW_WORD_BITS;
+    uint64_t      bits = 0;
+    if (word >= 0 && word < words) {
+        bits = row[word] >> bit;
+    }
+    if (bit != 0 && word + 1 >= 0 && word + 1 < words) {
+        bits |= row[word + 1] << (BMP_ROW_WORD_BITS - bit);
+    }
+    return bits;
+}
+
+/** @return true when segment `lhs` of `lhs_length` pixels is preferred over
+ * `rhs` (longer, then the smaller start, then the smaller end wins) */
+static bool segment_is_better(uint32_t lhs_length, Segment lhs,
+                              uint32_t rhs_length, Segment rhs) {
+    if (lhs_length != rhs_length) {
+        return lhs_length > rhs_length;
+    }
+    const uint32_t lhs_key[4] = {lhs.start.y, lhs.start.x, lhs.end.y,
+                                 lhs.end.x};
+    const uint32_t rhs_key[4] = {rhs.start.y, rhs.start.x, rhs.end.y,
+                                 rhs.end.x};
+    for (size_t i = 0; i < 4; i++) {
+        if (lhs_key[i] != rhs_key[i]) {
+            return lhs_key[i] < rhs_key[i];
+        }
+    }
+    return false;
+}
+
+/** @brief word of packed starts of segments which are still extendable */
+typedef struct SegmentStarts {
+    uint32_t row;
+    uint32_t word;
+    uint64_t bits;
+} SegmentStarts;
+
+/**
+ * @brief finds the longest segment of direction (`dx`, `dy`)
+ *
+ * Starts of segments of `length` pixels are kept as the non-zero words of
+ * packed rows. Starts of segments one pixel longer are those whose next pixel
+ * is filled too, so each word is ANDed with the row of the bitmap shifted by
+ * the offset of that pixel and the words left empty are dropped, until no
+ * start is left. Each start is measured with its own rounding and the cost is
+ * proportional to the starts still alive.
+ */
+static void segment_sweep(const SegmentSearch *search, int64_t dx, int64_t dy,
+                          SegmentSweep *out) {
+    const uint32_t height = search->bmp->dimensions.height;
+    const uint32_t words = search->words;
+    /* segments are walked downwards (rightwards when horizontal) */
+    if (dy < 0 || (dy == 0 && dx < 0)) {
+        dx = -dx;
+        dy = -dy;
+    }
+    *out = (SegmentSweep){.best = shape_geometry_invalid_ctor()};
+    SegmentStarts *starts =
+        mem_malloc(sizeof(SegmentStarts) * ((size_t)height * words + 1));
+    if (starts == NULL) {
+        out->failed = true;
+        return;
+    }
+    size_t count = 0;
+    for (uint32_t row = 0; row < height; row++) {
+        for (uint32_t word = 0; word < words; word++) {
+            const uint64_t bits = search->rows[(size_t)row * words + word];
+            if (bits != 0) {
+                starts[count++] = (SegmentStarts){row, word, bits};
+            }
+        }
+    }
+    for (uint32_t length = 1; count > 0; length++) {
+        const int64_t  next_x = segment_offset_x(length, dx, dy);
+        const uint32_t next_y = segment_offset_y(length, dx, dy);
+        /* starts are compacted in place, so the words are kept as they were
+         * when no start is extendable */
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++) {
+            const uint64_t below = (uint64_t)starts[i].row + next_y;
+            if (below >= height) {
+                continue;
+            }
+            const uint64_t bits =
+                starts[i].bits &
+                segment_gather(&search->rows[below * words], words,
+                               (int64_t)starts[i].word * BMP_ROW_WORD_BITS +
+                                   next_x);
+            if (bits != 0) {
+                starts[kept] = starts[i];
+                starts[kept++].bits = bits;
+            }
+        }
+        if (kept > 0) {
+            count = kept;
+            continue;
+        }
+        /* the first start left is the best one, the segments of the length
+         * differ only by their position */
+        const Point start =
+            point_ctor(starts[0].word * BMP_ROW_WORD_BITS +
+                           bits_ctz64(starts[0].bits),
+                       starts[0].row);
+        const Point end = point_ctor(
+            (uint32_t)(start.x + segment_offset_x(length - 1, dx, dy)),
+            start.y + segment_offset_y(length - 1, dx, dy));
+        out->best = start.y == end.y && start.x > end.x
+                        ? shape_geometry_ctor(end, start)
+                        : shape_geometry_ctor(start, end);
+        out->length = length;
+        break;
+    }
+    mem_free(starts);
+}
+
+/** @brief sweeps directions [begin, end), direction `i` makes angle of
+ * `180 * i / angles` degrees with the rows (clockwise, rows grow downwards) */
+static void segment_sweep_directions(void *arg, uint32_t begin, uint32_t end) {
+    const SegmentSearch *search = arg;
+    for (uint32_t i = begin; i < end; i++) {
+        const double angle = SEGMENT_PI * i / search->angles;
+        segment_sweep(search, llround(cos(angle) * SEGMENT_DIRECTION_SCALE),
+                      llround(sin(angle) * SEGMENT_DIRECTION_SCALE),
+                      &search->sweeps[i]);
+    }
+}
+
+/**
+ * @brief scans for the longest digital straight segment (in pixels) over
+ * `angles` directions evenly covering the half turn, directions are swept in
+ * parallel
+ * @return invalid segment if there is no filled pixel */
+static Segment segment_find_longest(const Bitmap *bmp, uint32_t angles,
+                                    SearchContext *ctx) {
+    const uint32_t words =
+        (bmp->dimensions.width + BMP_ROW_WORD_BITS - 1) / BMP_ROW_WORD_BITS;
+    SegmentSearch search = {
+        bmp, angles, words,
+        mem_malloc(sizeof(uint64_t) * bmp->dimensions.height * words + 1),
+        mem_calloc(angles, sizeof(SegmentSweep))};
+    if (search.rows == NULL || search.sweeps == NULL) {
+        mem_free(search.rows);
+        mem_free(search.sweeps);
+        search_context_fail(ctx, error_ctor(ERR_ALLOCATION_FAILURE,
+                                            "Failed to allocate segment "
+                                            "sweeps!\n"));
+        return shape_geometry_invalid_ctor();
+    }
+    for (uint32_t row = 0; row < bmp->dimensions.height; row++) {
+        bmp_row_pack(&bmp_at(bmp, row, 0), bmp->dimensions.width,
+                     &search.rows[(size_t)row * words]);
+    }
+    parallel_for(angles, 1, segment_sweep_directions, &search);
+    Segment  max = shape_geometry_invalid_ctor();
+    uint32_t max_length = 0;
+    for (uint32_t i = 0; i < angles; i++) {
+        const SegmentSweep *sweep = &search.sweeps[i];
+        if (sweep->failed) {
+            search_context_fail(ctx, error_ctor(ERR_ALLOCATION_FAILURE,
+                                                "Failed to allocate segment "
+                                                "sweep!\n"));
+            break;
+        }
+        if (sweep->length > 0 &&
+            segment_is_better(sweep->length, sweep->best, max_length, max)) {
+            max = sweep->best;
+            max_length = sweep->length;
+        }
+    }
+    mem_free(search.rows);
+    mem_free(search.sweeps);
+    return ctx->err.code == ERR_NONE ? max : shape_geometry_invalid_ctor();
+}
+
+#endif /* FIGSEARCH_NO_MAIN */
+
+/* =========================================
+ *                Row Store
+ * ========================================= */
+
+/** @brief initial value of the row hash */
+#define ROW_STORE_HASH_SEED  (0xCBF29CE484222325ULL)
+/** @brief multiplier mixing each 8-pixel word into the row hash */
+#define ROW_STORE_HASH_PRIME (0x9E3779B97F4A7C15ULL)
+/** @brief marks an empty slot of the row store's hash table */
+#define ROW_STORE_SLOT_EMPTY (UINT32_MAX)
+
+/** @brief content-addressed row store, every distinct bitmap row is stored
+ * only once and bitmap rows refer to it by its id */
+typedef struct RowStore {
+    BitmapSize dimensions;
+    /** @brief distinct rows stored linearly @see row_store_row */
+    BitmapData rows;
+    /** @brief number of distinct rows */
+    uint32_t unique_count;
+    /** @brief distinct row id of each bitmap row */
+    uint32_t *row_ids;
+    /** @brief first bitmap row of each run of identical consecutive rows,
+     * terminated by the bitmap height (run_count + 1 items) */
+    uint32_t *run_starts;
+    /** @brief number of runs of identical consecutive rows */
+    uint32_t run_count;
+} RowStore;
+
+#define row_store_row(store, id) \
+    ((store)->rows + (size_t)(id) * (store)->dimensions.width)
+#define row_store_run_length(store, run) \
+    ((store)->run_starts[(run) + 1] - (store)->run_starts[(run)])
+
+/** @brief hashes a single row of pixels, 8 pixels at a time */
+static uint64_t row_store_hash(const Pixel *row, uint32_t width) {
+    uint64_t hash = ROW_STORE_HASH_SEED;
+    uint32_t col = 0;
+    for (; col + sizeof(uint64_t) <= width; col += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, row + col, sizeof(word));
+        hash = (hash ^ word) * ROW_STORE_HASH_PRIME;
+        hash ^= hash >> 29;
+    }
+    for (; col < width; col++) {
+        hash = (hash ^ (uint8_t)row[col]) * ROW_STORE_HASH_PRIME;
+    }
+    return hash ^ (hash >> 32);
+}
+
+/** @brief destroys row store's allocated memory */
+static void row_store_dtor(RowStore *store) {
+    mem_free(store->rows);
+    mem_free(store->row_ids);
+    mem_free(store->run_starts);
+    *store = (RowStore){0};
+}
+
+/**
+ * @brief builds row store from a loaded bitmap by hashing each of its rows,
+ * distinct rows are copied into the store exactly once
+ * @return ERR_ALLOCATION_FAILURE when store could not be allocated */
+static Error row_store_ctor(const Bitmap *bmp, RowStore *out_store) {
+    const uint32_t width = bmp->dimensions.width;
+    const uint32_t height = bmp->dimensions.height;
+    /* hash table has to be at least twice as large as the number of rows to
+     * keep the linear probing short */
+    size_t capacity = 1;
+    while (capacity < (size_t)height * 2) {
+        capacity <<= 1;
+    }
+    *out_store = (RowStore){.dimensions = bmp->dimensions};
+    out_store->rows = mem_malloc(sizeof(Pixel) * bmp_size_raw(bmp->dimensions));
+    out_store->row_ids = mem_malloc(sizeof(uint32_t) * height);
+    out_store->run_starts = mem_malloc(sizeof(uint32_t) * ((size_t)height + 1));
+    uint32_t *slots = mem_malloc(sizeof(uint32_t) * capacity);
+    uint64_t *hashes = mem_malloc(sizeof(uint64_t) * height);
+    if (out_store->rows == NULL || out_store->row_ids == NULL ||
+        out_store->run_starts == NULL || slots == NULL || hashes == NULL) {
+        mem_free(slots);
+        mem_free(hashes);
+        row_store_dtor(out_store);
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate row store buffers!\n");
+    }
+    memset(slots, 0xFF, sizeof(uint32_t) * capacity);
+
+    for (uint32_t row = 0; row < height; row++) {
+        const Pixel   *pixels = &bmp_at(bmp, row, 0);
+        const uint64_t hash = row_store_hash(pixels, width);
+        size_t         slot = hash & (capacity - 1);
+        /* probe until we hit either the same row or an empty slot */
+        for (; slots[slot] != ROW_STORE_SLOT_EMPTY;
+             slot = (slot + 1) & (capacity - 1)) {
+            const uint32_t id = slots[slot];
+            if (hashes[id] == hash &&
+                memcmp(row_store_row(out_store, id), pixels, width) == 0) {
+                break;
+            }
+        }
+        if (slots[slot] == ROW_STORE_SLOT_EMPTY) {
+            const uint32_t id = out_store->unique_count++;
+            memcpy(row_store_row(out_store, id), pixels, width);
+            hashes[id] = hash;
+            slots[slot] = id;
+        }
+        out_store->row_ids[row] = slots[slot];
+        /* track runs of identical consecutive rows */
+        if (row == 0 ||
+            out_store->row_ids[row] != out_store->row_ids[row - 1]) {
+            out_store->run_starts[out_store->run_count++] = row;
+        }
+    }
+    out_store->run_starts[out_store->run_count] = height;
+    mem_free(slots);
+    mem_free(hashes);
+
+    /* release the space of duplicate rows (keep the buffer on failure) */
+    BitmapData shrunk = mem_realloc(
+        out_store->rows, sizeof(Pixel) * out_store->unique_count * width);
+    if (shrunk != NULL) {
+        out_store->rows = shrunk;
+    }
+    return error_none();
+}
+
+/**
+ * @brief retrieves row store of the bitmap, builds it on first use
+ * @return ERR_ALLOCATION_FAILURE when the store could not be built */
+static Error row_store_cached(const Bitmap *bmp, const RowStore **out_store) {
+    if (bmp->cache->row_store == NULL) {
+        RowStore *store = mem_malloc(sizeof(RowStore));
+        if (store == NULL) {
+            return error_ctor(ERR_ALLOCATION_FAILURE,
+                              "Failed to allocate row store!\n");
+        }
+        Error err = row_store_ctor(bmp, store);
+        if (err.code != ERR_NONE) {
+            mem_free(store);
+            return err;
+        }
+        bmp->cache->row_store = store;
+    }
+    *out_store = bmp->cache->row_store;
+    return error_none();
+}
+
+/** @brief retrieves row store and records its dedup statistics into `ctx`
+ * @return false when the store could not be built (error kept in `ctx`) */
+static bool row_store_cached_stats(const Bitmap    *bmp,
+                                   const RowStore **out_store,
+                                   SearchContext   *ctx) {
+    if (search_context_fail(ctx, row_store_cached(bmp, out_store))) {
+        return false;
+    }
+    ctx->stats.rows = (*out_store)->dimensions.height;
+    ctx->stats.unique_rows = (*out_store)->unique_count;
+    ctx->stats.row_runs = (*out_store)->run_count;
+    return true;
+}
+
+/**
+ * @brief scans for longest horizontal line, each distinct row is scanned only
+ * once and its result is shared by all of its copies */
+static HLine row_store_find_longest_hline(const Bitmap  *bmp,
+                                          SearchContext *ctx) {
+    const RowStore *store;
+    if (!row_store_cached_stats(bmp, &store, ctx)) {
+        return line_invalid_ctor();
+    }
+    const uint32_t width = store->dimensions.width;
+    uint32_t      *starts =
+        mem_malloc(sizeof(uint32_t) * 2 * store->unique_count);
+    if (starts == NULL) {
+        search_context_fail(
+            ctx, error_ctor(ERR_ALLOCATION_FAILURE,
+                            "Failed to allocate row store scratch buffer!\n"));
+        return line_invalid_ctor();
+    }
+    uint32_t *lengths = starts + store->unique_count;
+    /* leftmost longest run of every distinct row */
+    for (uint32_t id = 0; id < store->unique_count; id++) {
+        const Pixel *pixels = row_store_row(store, id);
+        starts[id] = 0;
+        lengths[id] = 0;
+        for (uint32_t col = 0; col < width; col++) {
+            if (pixels[col] == PXL_EMPTY) {
+                continue;
+            }
+            uint32_t end = col;
+            for (; end < width && pixels[end] == PXL_FILLED; end++) {
+            }
+            if (end - col > lengths[id]) {
+                starts[id] = col;
+                lengths[id] = end - col;
+            }
+            col = end;
+        }
+    }
+    /* the first row of a run is the only candidate of the run */
+    HLine max = line_invalid_ctor();
+    for (uint32_t run = 0; run < store->run_count; run++) {
+        const uint32_t row = store->run_starts[run];
+        const uint32_t id = store->row_ids[row];
+        if (lengths[id] == 0) {
+            continue;
+        }
+        HLine temp = line_ctor(point_ctor(starts[id], row),
+                               point_ctor(starts[id] + lengths[id] - 1, row));
+        if (line_is_invalid(max) || hline_cmp(max, temp) < 0) {
+            max = temp;
+        }
+    }
+    mem_free(starts);
+    return max;
+}
+
+/**
+ * @brief scans for longest vertical line, a run of identical rows extends the
+ * vertical runs of all of its filled columns at once */
+static VLine row_store_find_longest_vline(const Bitmap  *bmp,
+                                          SearchContext *ctx) {
+    const RowStore *store;
+    if (!row_store_cached_stats(bmp, &store, ctx)) {
+        return line_invalid_ctor();
+    }
+    const uint32_t width = store->dimensions.width;
+    /* current vertical run (start row and length) of every column */
+    uint32_t *starts = mem_calloc((size_t)width * 2, sizeof(uint32_t));
+    if (starts == NULL) {
+        search_context_fail(
+            ctx, error_ctor(ERR_ALLOCATION_FAILURE,
+                            "Failed to allocate row store scratch buffer!\n"));
+        return line_invalid_ctor();
+    }
+    uint32_t *lengths = starts + width;
+    VLine     max = line_invalid_ctor();
+    for (uint32_t run = 0; run <= store->run_count; run++) {
+        /* the extra iteration terminates all of the runs still open */
+        const Pixel *pixels =
+            run < store->run_count
+                ? row_store_row(store, store->row_ids[store->run_starts[run]])
+                : NULL;
+        for (uint32_t col = 0; col < width; col++) {
+            if (pixels != NULL && pixels[col] == PXL_FILLED) {
+                if (lengths[col] == 0) {
+                    starts[col] = store->run_starts[run];
+                }
+                lengths[col] += row_store_run_length(store, run);
+                continue;
+            }
+            if (lengths[col] == 0) {
+                continue;
+            }
+            VLine temp =
+                line_ctor(point_ctor(col, starts[col]),
+                          point_ctor(col, starts[col] + lengths[col] - 1));
+            if (line_is_invalid(max) || vline_cmp(max, temp) < 0) {
+                max = temp;
+            }
+            lengths[col] = 0;
+        }
+    }
+    mem_free(starts);
+    return max;
+}
+
+/**
+ * @brief scans for the largest square using run lengths derived from the row
+ * store: rightward runs are computed once per distinct row, downward runs once
+ * per run of identical rows
+ * @return invalid square if no square was found */
+static Square row_store_find_largest_square(const Bitmap  *bmp,
+                                            SearchContext *ctx) {
+    const RowStore *store;
+    if (!row_store_cached_stats(bmp, &store, ctx)) {
+        return square_invalid_ctor();
+    }
+    const uint32_t width = store->dimensions.width;
+    const uint32_t height = store->dimensions.height;
+    /* rightward run length of each pixel of each distinct row */
+    uint32_t *right =
+        mem_malloc(sizeof(uint32_t) * store->unique_count * width);
+    /* downward run length from the first row of each run (the extra zeroed
+     * row terminates the last run) */
+    uint32_t *down =
+        mem_calloc(((size_t)store->run_count + 1) * width, sizeof(uint32_t));
+    /* run index of each bitmap row */
+    uint32_t *run_of_row = mem_malloc(sizeof(uint32_t) * height);
+    if (right == NULL || down == NULL || run_of_row == NULL) {
+        mem_free(right);
+        mem_free(down);
+        mem_free(run_of_row);
+        search_context_fail(
+            ctx, error_ctor(ERR_ALLOCATION_FAILURE,
+                            "Failed to allocate row store scratch buffer!\n"));
+        return square_invalid_ctor();
+    }
+    for (uint32_t id = 0; id < store->unique_count; id++) {
+        const Pixel *pixels = row_store_row(store, id);
+        uint32_t    *runs = right + (size_t)id * width;
+        uint32_t     length = 0;
+        for (uint32_t col = width; col-- > 0;) {
+            length = pixels[col] == PXL_FILLED ? length + 1 : 0;
+            runs[col] = length;
+        }
+    }
+    for (uint32_t run = store->run_count; run-- > 0;) {
+        const Pixel *pixels =
+            row_store_row(store, store->row_ids[store->run_starts[run]]);
+        uint32_t *runs = down + (size_t)run * width;
+        for (uint32_t col = 0; col < width; col++) {
+            runs[col] = pixels[col] == PXL_FILLED
+                            ? row_store_run_length(store, run) + runs[width + col]
+                            : 0;
+        }
+        for (uint32_t row = store->run_starts[run];
+             row < store->run_starts[run + 1]; row++) {
+            run_of_row[row] = run;
+        }
+    }
+#define row_store_right(row, col) \
+    (right[(size_t)store->row_ids[(row)] * width + (col)])
+#define row_store_down(row, col)                                         \
+    (down[(size_t)run_of_row[(row)] * width + (col)] == 0                \
+         ? 0                                                             \
+         : down[(size_t)run_of_row[(row)] * width + (col)] -             \
+               ((row) - store->run_starts[run_of_row[(row)]]))
+
+    Square         max = square_invalid_ctor();
+    uint32_t       max_length = 0;
+    const uint32_t upper = bmp_bound_square_upper(bmp);
+    /* no square larger than max can begin max_length rows from the bottom */
+    for (uint32_t row = 0; row + max_length < height && max_length < upper;
+         row++) {
+        for (uint32_t col = 0; col + max_length < width; col++) {
+            uint32_t side = row_store_right(row, col);
+            if (side <= max_length) {
+                continue;
+            }
+            uint32_t down_side = row_store_down(row, col);
+            side = side < down_side ? side : down_side;
+            side = side < upper ? side : upper;
+            /* largest valid square at this anchor (if larger than max) */
+            for (; side > max_length; side--) {
+                if (row_store_right(row + side - 1, col) >= side &&
+                    row_store_down(row, col + side - 1) >= side) {
+                    square_set_max_square(
+                        &max, &max_length,
+                        square_ctor(point_ctor(col, row),
+                                    point_ctor(col + side - 1,
+                                               row + side - 1)));
+                    break;
+                }
+            }
+        }
+    }
+#undef row_store_right
+#undef row_store_down
+
+    mem_free(right);
+    mem_free(down);
+    mem_free(run_of_row);
+    return max;
+}
+
+/* =========================================
+ *               Tiled Bitmap
+ * ========================================= */
+
+/** @brief side of a tile in pixels (a tile is packed into single Tile) */
+#define TILE_SIDE (8)
+/** @brief selects the lowest bit of every byte of a tile */
+#define TILE_COLUMN_MASK (0x0101010101010101ULL)
+/** @brief gathers the lowest bits of all bytes into the top byte, so that
+ * bit `i` of the result holds the bit of the `i`-th byte */
+#define TILE_COLUMN_GATHER (0x0102040810204080ULL)
+
+/** @brief 8x8 pixels packed into bits, bit (row * TILE_SIDE + col) is set
+ * when the pixel is filled */
+typedef uint64_t Tile;
+
+/** @brief bitmap stored as packed tiles, tiles are grouped into square blocks
+ * laid out row by row and tiles inside a block follow Z-order (Morton) curve,
+ * so that both horizontal and vertical neighbours are close in memory */
+typedef struct TiledBitmap {
+    BitmapSize dimensions;
+    /** @brief number of tiles per row/column of the bitmap */
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    /** @brief a block is (1 << block_shift) tiles wide and high */
+    uint32_t block_shift;
+    /** @brief number of blocks per row of blocks */
+    uint32_t blocks_x;
+    /** @note padding pixels (outside of the bitmap) are always empty */
+    Tile *tiles;
+} TiledBitmap;
+
+/** @brief spreads lower 32 bits of `value` into even bits */
+static inline uint64_t bits_spread_even(uint64_t value) {
+    value &= 0xFFFFFFFFULL;
+    value = (value | (value << 16)) & 0x0000FFFF0000FFFFULL;
+    value = (value | (value << 8)) & 0x00FF00FF00FF00FFULL;
+    value = (value | (value << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    value = (value | (value << 2)) & 0x3333333333333333ULL;
+    value = (value | (value << 1)) & 0x5555555555555555ULL;
+    return value;
+}
+
+/** @return linear index of the tile at tile coordinates `tx`, `ty` */
+static inline size_t tiled_index(const TiledBitmap *tb, uint32_t tx,
+                                 uint32_t ty) {
+    const uint32_t shift = tb->block_shift;
+    const uint32_t mask = (1U << shift) - 1;
+    const size_t   block = (size_t)(ty >> shift) * tb->blocks_x + (tx >> shift);
+    return (block << (2 * shift)) | (bits_spread_even(tx & mask) |
+                                     (bits_spread_even(ty & mask) << 1));
+}
+
+/** @return 8 pixels of bitmap `row` stored in tile column `tx` (bit `i` is
+ * the pixel at column tx * TILE_SIDE + i) */
+static inline uint32_t tiled_row_bits(const TiledBitmap *tb, uint32_t row,
+                                      uint32_t tx) {
+    const Tile tile = tb->tiles[tiled_index(tb, tx, row / TILE_SIDE)];
+    return (uint32_t)(tile >> (row % TILE_SIDE * TILE_SIDE)) & 0xFF;
+}
+
+/** @return 8 pixels of column `col` of the `tile` (bit `i` is tile row i) */
+static inline uint32_t tile_column_bits(Tile tile, uint32_t col) {
+    return (uint32_t)((((tile >> col) & TILE_COLUMN_MASK) *
+                       TILE_COLUMN_GATHER) >>
+                      56);
+}
+
+/** @return 8 pixels of bitmap `col` stored in tile row `ty` */
+static inline uint32_t tiled_column_bits(const TiledBitmap *tb, uint32_t col,
+                                         uint32_t ty) {
+    return tile_column_bits(tb->tiles[tiled_index(tb, col / TILE_SIDE, ty)],
+                            col % TILE_SIDE);
+}
+
+/** @brief destroys tiled bitmap's allocated memory */
+static void tiled_dtor(TiledBitmap *tb) {
+    mem_free(tb->tiles);
+    *tb = (TiledBitmap){0};
+}
+
+/**
+ * @brief packs loaded bitmap into tiles
+ * @return ERR_ALLOCATION_FAILURE when tiles could not be allocated */
+static Error tiled_ctor(const Bitmap *bmp, TiledBitmap *out_tb) {
+    const uint32_t tiles_x = (bmp->dimensions.width + TILE_SIDE - 1) / TILE_SIDE;
+    const uint32_t tiles_y =
+        (bmp->dimensions.height + TILE_SIDE - 1) / TILE_SIDE;
+    /* the largest block which still fits into both dimensions */
+    uint32_t shift = 0;
+    const uint32_t shorter = tiles_x < tiles_y ? tiles_x : tiles_y;
+    while ((2U << shift) <= shorter) {
+        shift++;
+    }
+    const uint32_t block = 1U << shift;
+    const uint32_t blocks_x = (tiles_x + block - 1) / block;
+    const uint32_t blocks_y = (tiles_y + block - 1) / block;
+    *out_tb = (TiledBitmap){
+        .dimensions = bmp->dimensions,
+        .tiles_x = tiles_x,
+        .tiles_y = tiles_y,
+        .block_shift = shift,
+        .blocks_x = blocks_x,
+        .tiles = mem_calloc((size_t)blocks_x * blocks_y << (2 * shift),
+                            sizeof(Tile)),
+    };
+    if (out_tb->tiles == NULL) {
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate tiled bitmap buffer!\n");
+    }
+    /* assemble each tile in a register and store it just once */
+    for (uint32_t ty = 0; ty < tiles_y; ty++) {
+        const uint32_t first_row = ty * TILE_SIDE;
+        uint32_t       last_row = first_row + TILE_SIDE;
+        if (last_row > bmp->dimensions.height) {
+            last_row = bmp->dimensions.height;
+        }
+        for (uint32_t tx = 0; tx < tiles_x; tx++) {
+            const uint32_t first_col = tx * TILE_SIDE;
+            uint32_t       last_col = first_col + TILE_SIDE;
+            if (last_col > bmp->dimensions.width) {
+                last_col = bmp->dimensions.width;
+            }
+            Tile tile = 0;
+            for (uint32_t row = first_row; row < last_row; row++) {
+                const Pixel *pixels = &bmp_at(bmp, row, 0);
+                Tile         bits = 0;
+                for (uint32_t col = first_col; col < last_col; col++) {
+                    bits |= (Tile)(pixels[col] == PXL_FILLED)
+                            << (col - first_col);
+                }
+                tile |= bits << ((row - first_row) * TILE_SIDE);
+            }
+            out_tb->tiles[tiled_index(out_tb, tx, ty)] = tile;
+        }
+    }
+    return error_none();
+}
+
+/**
+ * @brief retrieves tiled layout of the bitmap, builds it on first use
+ * @return ERR_ALLOCATION_FAILURE when the tiles could not be built */
+static Error tiled_cached(const Bitmap *bmp, const TiledBitmap **out_tb) {
+    if (bmp->cache->tiled == NULL) {
+        TiledBitmap *tb = mem_malloc(sizeof(TiledBitmap));
+        if (tb == NULL) {
+            return error_ctor(ERR_ALLOCATION_FAILURE,
+                              "Failed to allocate tiled bitmap!\n");
+        }
+        Error err = tiled_ctor(bmp, tb);
+        if (err.code != ERR_NONE) {
+            mem_free(tb);
+            return err;
+        }
+        bmp->cache->tiled = tb;
+    }
+    *out_tb = bmp->cache->tiled;
+    return error_none();
+}
+
+/**
+ * @brief counts filled pixels from (`row`, `col`) to the right, whole tile row
+ * (8 pixels) at a time
+ * @note stops as soon as `limit` pixels were counted */
+static uint32_t tiled_run_right(const TiledBitmap *tb, uint32_t row,
+                                uint32_t col, uint32_t limit) {
+    uint32_t length = 0;
+    while (length < limit && col < tb->dimensions.width) {
+        const uint32_t offset = col % TILE_SIDE;
+        const uint32_t bits = tiled_row_bits(tb, row, col / TILE_SIDE) >> offset;
+        const uint32_t ones = bits_ctz64(~(uint64_t)bits);
+        length += ones;
+        if (ones < TILE_SIDE - offset) {
+            break;
+        }
+        col += ones;
+    }
+    return length < limit ? length : limit;
+}
+
+/** @see tiled_run_right */
+static uint32_t tiled_run_down(const TiledBitmap *tb, uint32_t row,
+                               uint32_t col, uint32_t limit) {
+    uint32_t length = 0;
+    while (length < limit && row < tb->dimensions.height) {
+        const uint32_t offset = row % TILE_SIDE;
+        const uint32_t bits =
+            tiled_column_bits(tb, col, row / TILE_SIDE) >> offset;
+        const uint32_t ones = bits_ctz64(~(uint64_t)bits);
+        length += ones;
+        if (ones < TILE_SIDE - offset) {
+            break;
+        }
+        row += ones;
+    }
+    return length < limit ? length : limit;
+}
+
+/** @brief scans for longest horizontal line in the tiled layout */
+static HLine tiled_find_longest_hline(const Bitmap *bmp, SearchContext *ctx) {
+    const TiledBitmap *tb;
+    if (search_context_fail(ctx, tiled_cached(bmp, &tb))) {
+        return line_invalid_ctor();
+    }
+    HLine    max = line_invalid_ctor();
+    uint32_t max_length = 0;
+    for (uint32_t row = 0; row < tb->dimensions.height; row++) {
+        for (uint32_t col = 0; col + max_length < tb->dimensions.width;) {
+            /* skip whole empty tile rows at once */
+            if (col % TILE_SIDE == 0 &&
+                tiled_row_bits(tb, row, col / TILE_SIDE) == 0) {
+                col += TILE_SIDE;
+                continue;
+            }
+            const uint32_t length = tiled_run_right(tb, row, col, UINT32_MAX);
+            if (length == 0) {
+                col++;
+                continue;
+            }
+            HLine temp = line_ctor(point_ctor(col, row),
+                                   point_ctor(col + length - 1, row));
+            if (line_is_invalid(max) || hline_cmp(max, temp) < 0) {
+                max = temp;
+                max_length = length;
+            }
+            col += length;
+        }
+    }
+    return max;
+}
+
+/**
+ * @brief scans for longest vertical line in the tiled layout, a single tile
+ * load advances the runs of 8 columns by 8 rows */
+static VLine tiled_find_longest_vline(const Bitmap *bmp, SearchContext *ctx) {
+    const TiledBitmap *tb;
+    if (search_context_fail(ctx, tiled_cached(bmp, &tb))) {
+        return line_invalid_ctor();
+    }
+    VLine max = line_invalid_ctor();
+    /* current run (start and length) of each column of the tile column */
+    uint32_t starts[TILE_SIDE] = {0}, lengths[TILE_SIDE] = {0};
+#define tiled_close_run(col, c)                                            \
+    do {                                                                   \
+        VLine temp = line_ctor(point_ctor((col), starts[(c)]),             \
+                               point_ctor((col), starts[(c)] +             \
+                                                     lengths[(c)] - 1));   \
+        if (line_is_invalid(max) || vline_cmp(max, temp) < 0) {           \
+            max = temp;                                                    \
+        }                                                                  \
+        lengths[(c)] = 0;                                                  \
+    } while (0)
+
+    for (uint32_t tx = 0; tx < tb->tiles_x; tx++) {
+        for (uint32_t ty = 0; ty < tb->tiles_y; ty++) {
+            const Tile tile = tb->tiles[tiled_index(tb, tx, ty)];
+            for (uint32_t c = 0; c < TILE_SIDE; c++) {
+                const uint32_t col = tx * TILE_SIDE + c;
+                uint32_t       bits = tile_column_bits(tile, c);
+                if (bits == 0xFF) {
+                    if (lengths[c] == 0) {
+                        starts[c] = ty * TILE_SIDE;
+                    }
+                    lengths[c] += TILE_SIDE;
+                    continue;
+                }
+                /* walk the alternating runs of ones and zeros */
+                for (uint32_t r = 0; r < TILE_SIDE;) {
+                    const uint32_t ones = bits_ctz64(~(uint64_t)(bits >> r));
+                    if (ones > 0) {
+                        if (lengths[c] == 0) {
+                            starts[c] = ty * TILE_SIDE + r;
+                        }
+                        lengths[c] += ones;
+                        r += ones;
+                        continue;
+                    }
+                    if (lengths[c] != 0) {
+                        tiled_close_run(col, c);
+                    }
+                    r += bits >> r == 0 ? TILE_SIDE : bits_ctz64(bits >> r);
+                }
+            }
+        }
+        /* runs reaching the bottom of the bitmap */
+        for (uint32_t c = 0; c < TILE_SIDE; c++) {
+            if (lengths[c] != 0) {
+                tiled_close_run(tx * TILE_SIDE + c, c);
+            }
+        }
+    }
+#undef tiled_close_run
+
+    return max;
+}
+
+/**
+ * @brief scans for the largest square in the tiled layout, side checks are
+ * done 8 pixels at a time in both directions
+ * @return invalid square if no square was found */
+static Square tiled_find_largest_square(const Bitmap  *bmp,
+                                        SearchContext *ctx) {
+    const TiledBitmap *tb;
+    if (search_context_fail(ctx, tiled_cached(bmp, &tb))) {
+        return square_invalid_ctor();
+    }
+    Square         max = square_invalid_ctor();
+    uint32_t       max_length = 0;
+    const uint32_t upper = bmp_bound_square_upper(bmp);
+    for (uint32_t row = 0;
+         row + max_length < tb->dimensions.height && max_length < upper;
+         row++) {
+        for (uint32_t col = 0; col + max_length < tb->dimensions.width; col++) {
+            /* skip whole empty tile rows at once */
+            if (col % TILE_SIDE == 0 &&
+                tiled_row_bits(tb, row, col / TILE_SIDE) == 0) {
+                col += TILE_SIDE - 1;
+                continue;
+            }
+            uint32_t side = tiled_run_right(tb, row, col, upper);
+            if (side <= max_length) {
+                continue;
+            }
+            side = tiled_run_down(tb, row, col, side);
+            /* largest valid square at this anchor (if larger than max) */
+            for (; side > max_length; side--) {
+                if (tiled_run_right(tb, row + side - 1, col, side) == side &&
+                    tiled_run_down(tb, row, col + side - 1, side) == side) {
+                    square_set_max_square(
+                        &max, &max_length,
+                        square_ctor(point_ctor(col, row),
+                                    point_ctor(col + side - 1,
+                                               row + side - 1)));
+                    break;
+                }
+            }
+        }
+    }
+    return max;
+}
+
+/* =========================================
+ *            Summed Area Table
+ * ========================================= */
+
+/** @brief rows/columns handed to a single thread while building the table */
+#define SAT_MIN_SLICE (64)
+
+/** @brief 2D prefix sums of filled pixels, answers rectangle density and "is
+ * segment fully filled" queries in O(1) */
+typedef struct SummedAreaTable {
+    BitmapSize dimensions;
+    /** @brief cells are 64-bit when the pixel count does not fit 32 bits */
+    bool wide;
+    /** @brief (height + 1) x (width + 1) cells, cell (r, c) holds the number
+     * of filled pixels in rows < r and columns < c */
+    void *cells;
+} SummedAreaTable;
+
+/** @brief shared state of the parallel table build */
+typedef struct SatBuild {
+    const Bitmap    *bmp;
+    SummedAreaTable *sat;
+} SatBuild;
+
+#define sat_stride(sat) ((size_t)(sat)->dimensions.width + 1)
+
+/** @return cell (`row`, `col`) of the table */
+static inline uint64_t sat_cell(const SummedAreaTable *sat, uint32_t row,
+                                uint32_t col) {
+    const size_t i = (size_t)row * sat_stride(sat) + col;
+    return sat->wide ? ((const uint64_t *)sat->cells)[i]
+                     : ((const uint32_t *)sat->cells)[i];
+}
+
+/** @brief first pass: prefix sums of each row in [begin, end) */
+static void sat_build_rows(void *arg, uint32_t begin, uint32_t end) {
+    const SatBuild *build = arg;
+    const uint32_t  width = build->bmp->dimensions.width;
+    for (uint32_t row = begin; row < end; row++) {
+        const Pixel *pixels = &bmp_at(build->bmp, row, 0);
+        const size_t offset = (size_t)(row + 1) * sat_stride(build->sat) + 1;
+        if (build->sat->wide) {
+            uint64_t *cells = (uint64_t *)build->sat->cells + offset;
+            uint64_t  sum = 0;
+            for (uint32_t col = 0; col < width; col++) {
+                sum += pixels[col] == PXL_FILLED;
+                cells[col] = sum;
+            }
+        } else {
+            uint32_t *cells = (uint32_t *)build->sat->cells + offset;
+            uint32_t  sum = 0;
+            for (uint32_t col = 0; col < width; col++) {
+                sum += pixels[col] == PXL_FILLED;
+                cells[col] = sum;
+            }
+        }
+    }
+}
+
+/** @brief second pass: accumulates columns [begin, end) downwards, walking
+ * the rows in order so that each thread streams through memory */
+static void sat_build_columns(void *arg, uint32_t begin, uint32_t end) {
+    const SatBuild *build = arg;
+    const size_t    stride = sat_stride(build->sat);
+    for (uint32_t row = 2; row <= build->bmp->dimensions.height; row++) {
+        const size_t offset = (size_t)row * stride + 1;
+        if (build->sat->wide) {
+            uint64_t *cells = (uint64_t *)build->sat->cells + offset;
+            for (uint32_t col = begin; col < end; col++) {
+                cells[col] += cells[col - stride];
+            }
+        } else {
+            uint32_t *cells = (uint32_t *)build->sat->cells + offset;
+            for (uint32_t col = begin; col < end; col++) {
+                cells[col] += cells[col - stride];
+            }
+        }
+    }
+}
+
+/** @brief destroys table's allocated memory */
+static void sat_dtor(SummedAreaTable *sat) {
+    mem_free(sat->cells);
+    *sat = (SummedAreaTable){0};
+}
+
+/**
+ * @brief builds summed area table of the bitmap in two parallel passes (rows
+ * then columns)
+ * @return ERR_ALLOCATION_FAILURE when table could not be allocated */
+static Error sat_ctor(const Bitmap *bmp, SummedAreaTable *out_sat) {
+    const size_t cell_count =
+        ((size_t)bmp->dimensions.height + 1) * (bmp->dimensions.width + 1);
+    const bool wide = bmp_size_raw(bmp->dimensions) > UINT32_MAX;
+    *out_sat = (SummedAreaTable){
+        .dimensions = bmp->dimensions,
+        .wide = wide,
+        .cells = mem_calloc(cell_count,
+                            wide ? sizeof(uint64_t) : sizeof(uint32_t)),
+    };
+    if (out_sat->cells == NULL) {
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate summed area table!\n");
+    }
+    SatBuild build = {bmp, out_sat};
+    parallel_for(bmp->dimensions.height, SAT_MIN_SLICE, sat_build_rows, &build);
+    parallel_for(bmp->dimensions.width, SAT_MIN_SLICE, sat_build_columns,
+                 &build);
+    return error_none();
+}
+
+/**
+ * @brief retrieves summed area table of the bitmap, builds it on first use
+ * @return ERR_ALLOCATION_FAILURE when the table could not be built */
+static Error sat_cached(const Bitmap *bmp, const SummedAreaTable **out_sat) {
+    if (bmp->cache->sat == NULL) {
+        SummedAreaTable *sat = mem_malloc(sizeof(SummedAreaTable));
+        if (sat == NULL) {
+            return error_ctor(ERR_ALLOCATION_FAILURE,
+                              "Failed to allocate summed area table!\n");
+        }
+        Error err = sat_ctor(bmp, sat);
+        if (err.code != ERR_NONE) {
+            mem_free(sat);
+            return err;
+        }
+        bmp->cache->sat = sat;
+    }
+    *out_sat = bmp->cache->sat;
+    return error_none();
+}
+
+/**
+ * @return number of filled pixels in the rectangle spanned by (inclusive)
+ * corners `top_left` and `bottom_right` */
+static inline uint64_t sat_count(const SummedAreaTable *sat, Point top_left,
+                                 Point bottom_right) {
+    /* modular arithmetic yields the right (non-negative) result */
+    return sat_cell(sat, bottom_right.y + 1, bottom_right.x + 1) -
+           sat_cell(sat, top_left.y, bottom_right.x + 1) -
+           sat_cell(sat, bottom_right.y + 1, top_left.x) +
+           sat_cell(sat, top_left.y, top_left.x);
+}
+
+/** @brief checks in O(1) whether all pixels of the rectangle are filled */
+static inline bool sat_is_filled(const SummedAreaTable *sat, Point top_left,
+                                 Point bottom_right) {
+    const uint64_t area = (uint64_t)(bottom_right.x - top_left.x + 1) *
+                          (bottom_right.y - top_left.y + 1);
+    return sat_count(sat, top_left, bottom_right) == area;
+}
+
+/**
+ * @brief finds the length of filled run starting at `begin` in direction
+ * (`dx`, `dy`) by galloping over O(1) filled segment checks
+ * @note result is capped by `limit` */
+static uint32_t sat_run(const SummedAreaTable *sat, Point begin, uint32_t dx,
+                        uint32_t dy, uint32_t limit) {
+    const uint32_t room = dx ? sat->dimensions.width - begin.x
+                             : sat->dimensions.height - begin.y;
+    if (limit > room) {
+        limit = room;
+    }
+#define sat_run_filled(length)                                           \
+    sat_is_filled(sat, begin,                                            \
+                  point_ctor(begin.x + dx * ((length) - 1),              \
+                             begin.y + dy * ((length) - 1)))
+    if (limit == 0 || !sat_run_filled(1)) {
+        return 0;
+    }
+    /* double the length while filled, then bisect the last step */
+    uint32_t low = 1, high = limit;
+    while (low < limit) {
+        const uint32_t next = low <= limit / 2 ? low * 2 : limit;
+        if (!sat_run_filled(next)) {
+            high = next;
+            break;
+        }
+        low = next;
+    }
+    /* invariant: `low` is filled, `high` is not (unless low == limit) */
+    while (high - low > 1) {
+        const uint32_t mid = low + (high - low) / 2;
+        if (sat_run_filled(mid)) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+#undef sat_run_filled
+    return low;
+}
+
+/** @brief scans for longest horizontal line, each run costs O(log length) */
+static HLine sat_find_longest_hline(const Bitmap *bmp, SearchContext *ctx) {
+    const SummedAreaTable *sat;
+    if (search_context_fail(ctx, sat_cached(bmp, &sat))) {
+        return line_invalid_ctor();
+    }
+    HLine    max = line_invalid_ctor();
+    uint32_t max_length = 0;
+    for (uint32_t row = 0; row < bmp->dimensions.height; row++) {
+        for (uint32_t col = 0; col + max_length < bmp->dimensions.width;
+             col++) {
+            const uint32_t length =
+                sat_run(sat, point_ctor(col, row), 1, 0, UINT32_MAX);
+            if (length == 0) {
+                continue;
+            }
+            HLine temp = line_ctor(point_ctor(col, row),
+                                   point_ctor(col + length - 1, row));
+            if (line_is_invalid(max) || hline_cmp(max, temp) < 0) {
+                max = temp;
+                max_length = length;
+            }
+            col += length;
+        }
+    }
+    return max;
+}
+
+/** @see sat_find_longest_hline */
+static VLine sat_find_longest_vline(const Bitmap *bmp, SearchContext *ctx) {
+    const SummedAreaTable *sat;
+    if (search_context_fail(ctx, sat_cached(bmp, &sat))) {
+        return line_invalid_ctor();
+    }
+    VLine    max = line_invalid_ctor();
+    uint32_t max_length = 0;
+    for (uint32_t col = 0; col < bmp->dimensions.width; col++) {
+        for (uint32_t row = 0; row + max_length < bmp->dimensions.height;
+             row++) {
+            const uint32_t length =
+                sat_run(sat, point_ctor(col, row), 0, 1, UINT32_MAX);
+            if (length == 0) {
+                continue;
+            }
+            VLine temp = line_ctor(point_ctor(col, row),
+                                   point_ctor(col, row + length - 1));
+            if (line_is_invalid(max) || vline_cmp(max, temp) < 0) {
+                max = temp;
+                max_length = length;
+            }
+            row += length;
+        }
+    }
+    return max;
+}
+
+/**
+ * @brief scans for the largest square, every candidate is validated by two
+ * O(1) filled segment checks (bottom and right side)
+ * @return invalid square if no square was found */
+static Square sat_find_largest_square(const Bitmap *bmp, SearchContext *ctx) {
+    const SummedAreaTable *sat;
+    if (search_context_fail(ctx, sat_cached(bmp, &sat))) {
+        return square_invalid_ctor();
+    }
+    Square         max = square_invalid_ctor();
+    uint32_t       max_length = 0;
+    const uint32_t upper = bmp_bound_square_upper(bmp);
+    for (uint32_t row = 0;
+         row + max_length < bmp->dimensions.height && max_length < upper;
+         row++) {
+        for (uint32_t col = 0; col + max_length < bmp->dimensions.width;
+             col++) {
+            const Point top_left = point_ctor(col, row);
+            uint32_t    side = sat_run(sat, top_left, 1, 0, upper);
+            if (side <= max_length) {
+                continue;
+            }
+            side = sat_run(sat, top_left, 0, 1, side);
+            /* largest valid square at this anchor (if larger than max) */
+            for (; side > max_length; side--) {
+                const Point bottom_right =
+                    point_ctor(col + side - 1, row + side - 1);
+                if (sat_is_filled(sat, point_ctor(col, bottom_right.y),
+                                  bottom_right) &&
+                    sat_is_filled(sat, point_ctor(bottom_right.x, row),
+                                  bottom_right)) {
+                    square_set_max_square(&max, &max_length,
+                                          square_ctor(top_left, bottom_right));
+                    break;
+                }
+            }
+        }
+    }
+    return max;
+}
+
+/* =========================================
+ *                Run Arrays
+ * ========================================= */
+
+/** @brief rows/columns handed to a single thread while building run arrays */
+#define RUN_ARRAYS_MIN_SLICE (64)
+
+/** @brief length of the filled run starting at each pixel in both directions,
+ * shared by all three searches (lines are the runs themselves, squares check
+ * their sides in O(1)) */
+typedef struct RunArrays {
+    BitmapSize dimensions;
+    /** @brief rightward run length of each pixel (row-major) */
+    uint32_t *right;
+    /** @brief downward run length of each pixel (row-major) */
+    uint32_t *down;
+} RunArrays;
+
+/** @brief shared state of the parallel run arrays build */
+typedef struct RunArraysBuild {
+    const Bitmap *bmp;
+    RunArrays    *runs;
+} RunArraysBuild;
+
+#define run_arrays_right(runs, row, col) \
+    ((runs)->right[(size_t)(row) * (runs)->dimensions.width + (col)])
+#define run_arrays_down(runs, row, col) \
+    ((runs)->down[(size_t)(row) * (runs)->dimensions.width + (col)])
+
+/** @brief rightward runs of rows [begin, end) */
+static void run_arrays_build_right(void *arg, uint32_t begin, uint32_t end) {
+    const RunArraysBuild *build = arg;
+    const uint32_t        width = build->bmp->dimensions.width;
+    for (uint32_t row = begin; row < end; row++) {
+        const Pixel *pixels = &bmp_at(build->bmp, row, 0);
+        uint32_t    *runs = &run_arrays_right(build->runs, row, 0);
+        uint32_t     length = 0;
+        for (uint32_t col = width; col-- > 0;) {
+            length = pixels[col] == PXL_FILLED ? length + 1 : 0;
+            runs[col] = length;
+        }
+    }
+}
+
+/** @brief downward runs of columns [begin, end), rows are walked bottom-up
+ * one after another, so the columns are never accessed with a stride */
+static void run_arrays_build_down(void *arg, uint32_t begin, uint32_t end) {
+    const RunArraysBuild *build = arg;
+    const uint32_t        width = build->bmp->dimensions.width;
+    for (uint32_t row = build->bmp->dimensions.height; row-- > 0;) {
+        const Pixel    *pixels = &bmp_at(build->bmp, row, 0);
+        uint32_t       *runs = &run_arrays_down(build->runs, row, 0);
+        const uint32_t *below = runs + width;
+        const bool      last = row + 1 == build->bmp->dimensions.height;
+        for (uint32_t col = begin; col < end; col++) {
+            runs[col] = pixels[col] == PXL_FILLED
+                            ? (last ? 0 : below[col]) + 1
+                            : 0;
+        }
+    }
+}
+
+/** @brief destroys run arrays' allocated memory */
+static void run_arrays_dtor(RunArrays *runs) {
+    mem_free(runs->right);
+    mem_free(runs->down);
+    *runs = (RunArrays){0};
+}
+
+/**
+ * @brief builds run arrays of the bitmap (rows and columns in parallel)
+ * @return ERR_ALLOCATION_FAILURE when arrays could not be allocated */
+static Error run_arrays_ctor(const Bitmap *bmp, RunArrays *out_runs) {
+    const size_t size = bmp_size_raw(bmp->dimensions);
+    *out_runs = (RunArrays){
+        .dimensions = bmp->dimensions,
+        .right = mem_malloc(sizeof(uint32_t) * size),
+        .down = mem_malloc(sizeof(uint32_t) * size),
+    };
+    if (out_runs->right == NULL || out_runs->down == NULL) {
+        run_arrays_dtor(out_runs);
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate run arrays!\n");
+    }
+    RunArraysBuild build = {bmp, out_runs};
+    parallel_for(bmp->dimensions.height, RUN_ARRAYS_MIN_SLICE,
+                 run_arrays_build_right, &build);
+    parallel_for(bmp->dimensions.width, RUN_ARRAYS_MIN_SLICE,
+                 run_arrays_build_down, &build);
+    return error_none();
+}
+
+/**
+ * @brief retrieves run arrays of the bitmap, builds them on first use
+ * @return ERR_ALLOCATION_FAILURE when the arrays could not be built */
+static Error run_arrays_cached(const Bitmap *bmp, const RunArrays **out_runs) {
+    if (bmp->cache->runs == NULL) {
+        RunArrays *runs = mem_malloc(sizeof(RunArrays));
+        if (runs == NULL) {
+            return error_ctor(ERR_ALLOCATION_FAILURE,
+                              "Failed to allocate run arrays!\n");
+        }
+        Error err = run_arrays_ctor(bmp, runs);
+        if (err.code != ERR_NONE) {
+            mem_free(runs);
+            return err;
+        }
+        bmp->cache->runs = runs;
+    }
+    *out_runs = bmp->cache->runs;
+    return error_none();
+}
+
+/** @brief scans for longest horizontal line by jumping over whole runs */
+static HLine runs_find_longest_hline(const Bitmap *bmp, SearchContext *ctx) {
+    const RunArrays *runs;
+    if (search_context_fail(ctx, run_arrays_cached(bmp, &runs))) {
+        return line_invalid_ctor();
+    }
+    HLine max = line_invalid_ctor();
+    /* @see line_find_longest_hline */
+    uint32_t max_length =
+        bmp_bound_line_lower(bmp, bmp->cache->bounds.hline);
+    max_length = max_length > 0 ? max_length - 1 : 0;
+    for (uint32_t row = 0; row < bmp->dimensions.height; row++) {
+        for (uint32_t col = 0; col + max_length < bmp->dimensions.width;
+             col++) {
+            const uint32_t length = run_arrays_right(runs, row, col);
+            if (length == 0) {
+                continue;
+            }
+            HLine temp = line_ctor(point_ctor(col, row),
+                                   point_ctor(col + length - 1, row));
+            if (line_is_invalid(max) || hline_cmp(max, temp) < 0) {
+                max = temp;
+                max_length = length;
+            }
+            col += length;
+        }
+    }
+    return max;
+}
+
+/**
+ * @brief scans for longest vertical line, the run starts are found row by
+ * row, so the columns are never walked with a stride */
+static VLine runs_find_longest_vline(const Bitmap *bmp, SearchContext *ctx) {
+    const RunArrays *runs;
+    if (search_context_fail(ctx, run_arrays_cached(bmp, &runs))) {
+        return line_invalid_ctor();
+    }
+    VLine max = line_invalid_ctor();
+    /* @see line_find_longest_hline */
+    uint32_t max_length =
+        bmp_bound_line_lower(bmp, bmp->cache->bounds.vline);
+    max_length = max_length > 0 ? max_length - 1 : 0;
+    for (uint32_t row = 0; row + max_length < bmp->dimensions.height; row++) {
+        for (uint32_t col = 0; col < bmp->dimensions.width; col++) {
+            const uint32_t length = run_arrays_down(runs, row, col);
+            /* only the first pixel of a run starts a line */
+            if (length <= max_length ||
+                (row > 0 && run_arrays_down(runs, row - 1, col) != 0)) {
+                continue;
+            }
+            VLine temp = line_ctor(point_ctor(col, row),
+                                   point_ctor(col, row + length - 1));
+            if (line_is_invalid(max) || vline_cmp(max, temp) < 0) {
+                max = temp;
+                max_length = length;
+            }
+        }
+    }
+    return max;
+}
+
+/**
+ * @brief scans for the largest square, every side is checked in O(1) by a run
+ * array lookup
+ * @return invalid square if no square was found */
+static Square runs_find_largest_square(const Bitmap *bmp, SearchContext *ctx) {
+    const RunArrays *runs;
+    if (search_context_fail(ctx, run_arrays_cached(bmp, &runs))) {
+        return square_invalid_ctor();
+    }
+    Square         max = square_invalid_ctor();
+    uint32_t       max_length = 0;
+    const uint32_t upper = bmp_bound_square_upper(bmp);
+    for (uint32_t row = 0;
+         row + max_length < bmp->dimensions.height && max_length < upper;
+         row++) {
+        for (uint32_t col = 0; col + max_length < bmp->dimensions.width;
+             col++) {
+            uint32_t side = run_arrays_right(runs, row, col);
+            if (side <= max_length) {
+                continue;
+            }
+            if (side > run_arrays_down(runs, row, col)) {
+                side = run_arrays_down(runs, row, col);
+            }
+            if (side > upper) {
+                side = upper;
+            }
+            /* largest valid square at this anchor (if larger than max) */
+            for (; side > max_length; side--) {
+                if (run_arrays_right(runs, row + side - 1, col) >= side &&
+                    run_arrays_down(runs, row, col + side - 1) >= side) {
+                    square_set_max_square(
+                        &max, &max_length,
+                        square_ctor(point_ctor(col, row),
+                                    point_ctor(col + side - 1,
+                                               row + side - 1)));
+                    break;
+                }
+            }
+        }
+    }
+    return max;
+}
+
+/* =========================================
+ *               Complement
+ * ========================================= */
+
+/** @brief empty pixels of the bitmap listed per row and per column, near-full
+ * bitmaps are processed in time proportional to their few empty pixels (every
+ * line is a gap between two consecutive empty pixels) */
+typedef struct Complement {
+    BitmapSize dimensions;
+    /** @brief empty pixels of row `r` are `row_empties[row_starts[r] ..
+     * row_starts[r + 1])` (ascending column indices) */
+    uint32_t *row_starts;
+    uint32_t *row_empties;
+    /** @brief empty pixels of each column (ascending row indices)
+     * @see Complement::row_starts */
+    uint32_t *col_starts;
+    uint32_t *col_empties;
+} Complement;
+
+/** @brief destroys complement's allocated memory */
+static void complement_dtor(Complement *comp) {
+    mem_free(comp->row_starts);
+    mem_free(comp->row_empties);
+    mem_free(comp->col_starts);
+    mem_free(comp->col_empties);
+    *comp = (Complement){0};
+}
+
+/**
+ * @brief lists empty pixels of the bitmap, rows are searched with memchr so
+ * filled stretches are skipped in bulk
+ * @return ERR_ALLOCATION_FAILURE when the lists could not be allocated */
+static Error complement_ctor(const Bitmap *bmp, Complement *out_comp) {
+    const uint32_t width = bmp->dimensions.width;
+    const uint32_t height = bmp->dimensions.height;
+    *out_comp = (Complement){
+        .dimensions = bmp->dimensions,
+        .row_starts = mem_calloc((size_t)height + 1, sizeof(uint32_t)),
+        .col_starts = mem_calloc((size_t)width + 1, sizeof(uint32_t)),
+    };
+    if (out_comp->row_starts == NULL || out_comp->col_starts == NULL) {
+        complement_dtor(out_comp);
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate complement!\n");
+    }
+    /* count empty pixels of each row and column */
+    for (uint32_t row = 0; row < height; row++) {
+        const Pixel *pixels = &bmp_at(bmp, row, 0);
+        const Pixel *end = pixels + width;
+        uint32_t     count = 0;
+        for (const Pixel *p = pixels;
+             (p = memchr(p, PXL_EMPTY, end - p)) != NULL; p++) {
+            out_comp->col_starts[p - pixels + 1]++;
+            count++;
+        }
+        out_comp->row_starts[row + 1] = out_comp->row_starts[row] + count;
+    }
+    for (uint32_t col = 0; col < width; col++) {
+        out_comp->col_starts[col + 1] += out_comp->col_starts[col];
+    }
+    /* an empty bitmap still gets (zero sized) valid allocations */
+    const size_t empties = out_comp->row_starts[height];
+    out_comp->row_empties = mem_malloc(sizeof(uint32_t) * (empties + 1));
+    out_comp->col_empties = mem_malloc(sizeof(uint32_t) * (empties + 1));
+    uint32_t *col_fill = mem_malloc(sizeof(uint32_t) * ((size_t)width + 1));
+    if (out_comp->row_empties == NULL || out_comp->col_empties == NULL ||
+        col_fill == NULL) {
+        mem_free(col_fill);
+        complement_dtor(out_comp);
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate complement!\n");
+    }
+    memcpy(col_fill, out_comp->col_starts, sizeof(uint32_t) * width);
+    /* rows are visited in order, so both lists come out sorted */
+    uint32_t *row_fill = out_comp->row_empties;
+    for (uint32_t row = 0; row < height; row++) {
+        const Pixel *pixels = &bmp_at(bmp, row, 0);
+        const Pixel *end = pixels + width;
+        for (const Pixel *p = pixels;
+             (p = memchr(p, PXL_EMPTY, end - p)) != NULL; p++) {
+            const uint32_t col = p - pixels;
+            *row_fill++ = col;
+            out_comp->col_empties[col_fill[col]++] = row;
+        }
+    }
+    mem_free(col_fill);
+    return error_none();
+}
+
+/**
+ * @brief retrieves complement of the bitmap, builds it on first use
+ * @return ERR_ALLOCATION_FAILURE when the complement could not be built */
+static Error complement_cached(const Bitmap *bmp, const Complement **out_comp) {
+    if (bmp->cache->complement == NULL) {
+        Complement *comp = mem_malloc(sizeof(Complement));
+        if (comp == NULL) {
+            return error_ctor(ERR_ALLOCATION_FAILURE,
+                              "Failed to allocate complement!\n");
+        }
+        Error err = complement_ctor(bmp, comp);
+        if (err.code != ERR_NONE) {
+            mem_free(comp);
+            return err;
+        }
+        bmp->cache->complement = comp;
+    }
+    *out_comp = bmp->cache->complement;
+    return error_none();
+}
+
+/**
+ * @brief length of the filled run starting at `index` of a row (column) with
+ * sorted empty pixels `empties[0 .. count)`, found by binary search
+ * @param limit length of the row (column) */
+static uint32_t complement_run(const uint32_t *empties, uint32_t count,
+                               uint32_t index, uint32_t limit) {
+    uint32_t low = 0, high = count;
+    while (low < high) {
+        const uint32_t mid = low + (high - low) / 2;
+        if (empties[mid] < index) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return (low < count ? empties[low] : limit) - index;
+}
+
+#define complement_run_right(comp, row, col)                          \
+    complement_run(&(comp)->row_empties[(comp)->row_starts[(row)]],   \
+                   (comp)->row_starts[(row) + 1] -                    \
+                       (comp)->row_starts[(row)],                     \
+                   (col), (comp)->dimensions.width)
+#define complement_run_down(comp, row, col)                           \
+    complement_run(&(comp)->col_empties[(comp)->col_starts[(col)]],   \
+                   (comp)->col_starts[(col) + 1] -                    \
+                       (comp)->col_starts[(col)],                     \
+                   (row), (comp)->dimensions.height)
+
+/** @brief scans for longest horizontal line as the largest gap between two
+ * empty pixels of a row */
+static HLine complement_find_longest_hline(const Bitmap  *bmp,
+                                           SearchContext *ctx) {
+    const Complement *comp;
+    if (search_context_fail(ctx, complement_cached(bmp, &comp))) {
+        return line_invalid_ctor();
+    }
+    HLine max = line_invalid_ctor();
+    for (uint32_t row = 0; row < bmp->dimensions.height; row++) {
+        const uint32_t last = comp->row_starts[row + 1];
+        uint32_t       begin = 0;
+        /* gaps are delimited by the empty pixels and the row's ends */
+        for (uint32_t i = comp->row_starts[row]; i <= last; i++) {
+            const uint32_t stop =
+                i < last ? comp->row_empties[i] : bmp->dimensions.width;
+            if (stop > begin) {
+                HLine temp = line_ctor(point_ctor(begin, row),
+                                       point_ctor(stop - 1, row));
+                if (line_is_invalid(max) || hline_cmp(max, temp) < 0) {
+                    max = temp;
+                }
+            }
+            begin = stop + 1;
+        }
+    }
+    return max;
+}
+
+/** @brief scans for longest vertical line as the largest gap between two
+ * empty pixels of a column */
+static VLine complement_find_longest_vline(const Bitmap  *bmp,
+                                           SearchContext *ctx) {
+    const Complement *comp;
+    if (search_context_fail(ctx, complement_cached(bmp, &comp))) {
+        return line_invalid_ctor();
+    }
+    VLine max = line_invalid_ctor();
+    for (uint32_t col = 0; col < bmp->dimensions.width; col++) {
+        const uint32_t last = comp->col_starts[col + 1];
+        uint32_t       begin = 0;
+        for (uint32_t i = comp->col_starts[col]; i <= last; i++) {
+            const uint32_t stop =
+                i < last ? comp->col_empties[i] : bmp->dimensions.height;
+            if (stop > begin) {
+                VLine temp = line_ctor(point_ctor(col, begin),
+                                       point_ctor(col, stop - 1));
+                if (line_is_invalid(max) || vline_cmp(max, temp) < 0) {
+                    max = temp;
+                }
+            }
+            begin = stop + 1;
+        }
+    }
+    return max;
+}
+
+/**
+ * @brief scans for the largest square, anchors are taken from the gaps of
+ * each row and only those whose gap still exceeds the largest square found
+ * are tried, sides are checked by binary search in the empty pixel lists
+ * @return invalid square if no square was found */
+static Square complement_find_largest_square(const Bitmap  *bmp,
+                                             SearchContext *ctx) {
+    const Complement *comp;
+    if (search_context_fail(ctx, complement_cached(bmp, &comp))) {
+        return square_invalid_ctor();
+    }
+    Square         max = square_invalid_ctor();
+    uint32_t       max_length = 0;
+    const uint32_t upper = bmp_bound_square_upper(bmp);
+    for (uint32_t row = 0;
+         row + max_length < bmp->dimensions.height && max_length < upper;
+         row++) {
+        const uint32_t last = comp->row_starts[row + 1];
+        uint32_t       begin = 0;
+        for (uint32_t i = comp->row_starts[row]; i <= last; i++) {
+            const uint32_t stop =
+                i < last ? comp->row_empties[i] : bmp->dimensions.width;
+            /* the top side of a square anchored at `col` ends by `stop` */
+            for (uint32_t col = begin; col + max_length < stop; col++) {
+                uint32_t side = stop - col;
+                const uint32_t down = complement_run_down(comp, row, col);
+                if (side > down) {
+                    side = down;
+                }
+                if (side > upper) {
+                    side = upper;
+                }
+                for (; side > max_length; side--) {
+                    if (complement_run_right(comp, row + side - 1, col) >=
+                            side &&
+                        complement_run_down(comp, row, col + side - 1) >=
+                            side) {
+                        square_set_max_square(
+                            &max, &max_length,
+                            square_ctor(point_ctor(col, row),
+                                        point_ctor(col + side - 1,
+                                                   row + side - 1)));
+                        break;
+                    }
+                }
+            }
+            begin = stop + 1;
+        }
+    }
+    return max;
+}
+
+/* =========================================
+ *               Packed Rows
+ * ========================================= */
+
+/** @brief number of pixels packed into a single word */
+#define PACKED_WORD_BITS BMP_ROW_WORD_BITS
+/** @brief levels of AND doubling (runs are shorter than 2^PACKED_MAX_LEVELS) */
+#define PACKED_MAX_LEVELS (33)
+/** @brief rows handed to a single thread while building packed rows */
+#define PACKED_MIN_SLICE (256)
+
+/**
+ * @brief rows packed into words (bit `c % 64` of word `c / 64` stands for
+ * column `c`) and their AND doubling
+ *
+ * Level `k` holds the AND of 2^k consecutive rows starting at each row, so
+ * bit `c` of its row `r` is set iff a vertical run of at least 2^k pixels
+ * starts at [r, c]. Levels are built until no such run exists, whole rows are
+ * combined word by word. */
+typedef struct PackedRows {
+    BitmapSize dimensions;
+    /** @brief number of words of each row */
+    uint32_t words;
+    /** @brief number of built levels (level 0 are the rows themselves) */
+    uint32_t count;
+    /** @brief `height * words` words of each level, rows which 2^k rows do
+     * not fit below are zeroed */
+    uint64_t *levels[PACKED_MAX_LEVELS];
+} PackedRows;
+
+/** @brief shared state of the parallel build of a single level */
+typedef struct PackedRowsBuild {
+    const Bitmap *bmp;
+    PackedRows   *packed;
+    /** @brief level being built */
+    uint32_t level;
+} PackedRowsBuild;
+
+#define packed_row(packed, level, row) \
+    (&(packed)->levels[(level)][(size_t)(row) * (packed)->words])
+#define packed_bit(words, col) \
+    (((words)[(col) / PACKED_WORD_BITS] >> ((col) % PACKED_WORD_BITS)) & 1)
+
+/** @brief packs rows [begin, end) of the bitmap into level 0 */
+static void packed_rows_build_rows(void *arg, uint32_t begin, uint32_t end) {
+    const PackedRowsBuild *build = arg;
+    for (uint32_t row = begin; row < end; row++) {
+        bmp_row_pack(&bmp_at(build->bmp, row, 0), build->bmp->dimensions.width,
+                     packed_row(build->packed, 0, row));
+    }
+}
+
+/** @brief ANDs rows [begin, end) of the previous level with the rows 2^(k-1)
+ * below them */
+static void packed_rows_build_level(void *arg, uint32_t begin, uint32_t end) {
+    const PackedRowsBuild *build = arg;
+    const PackedRows      *packed = build->packed;
+    const uint32_t         offset = UINT32_C(1) << (build->level - 1);
+    for (uint32_t row = begin; row < end; row++) {
+        uint64_t *words = packed_row(packed, build->level, row);
+        if (row + 2 * offset > packed->dimensions.height) {
+            memset(words, 0, sizeof(uint64_t) * packed->words);
+            continue;
+        }
+        const uint64_t *top = packed_row(packed, build->level - 1, row);
+        const uint64_t *bottom =
+            packed_row(packed, build->level - 1, row + offset);
+        for (uint32_t word = 0; word < packed->words; word++) {
+            words[word] = top[word] & bottom[word];
+        }
+    }
+}
+
+/** @return true if any bit of `count` words is set */
+static inline bool packed_any(const uint64_t *words, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (words[i] != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** @brief destroys packed rows' allocated memory */
+static void packed_rows_dtor(PackedRows *packed) {
+    for (uint32_t i = 0; i < packed->count; i++) {
+        mem_free(packed->levels[i]);
+    }
+    *packed = (PackedRows){0};
+}
+
+/**
+ * @brief allocates level 0 of packed rows of `dimensions`, the rows are left
+ * to be filled by the caller
+ * @return ERR_ALLOCATION_FAILURE when the level could not be allocated */
+static Error packed_rows_init(BitmapSize dimensions, PackedRows *out_packed) {
+    *out_packed = (PackedRows){
+        .dimensions = dimensions,
+        .words = (dimensions.width + PACKED_WORD_BITS - 1) / PACKED_WORD_BITS,
+    };
+    const size_t size = (size_t)dimensions.height * out_packed->words;
+    uint64_t    *level = mem_malloc(sizeof(uint64_t) * size + 1);
+    if (level == NULL) {
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate packed rows!\n");
+    }
+    out_packed->levels[out_packed->count++] = level;
+    return error_none();
+}
+
+/**
+ * @brief doubles the AND of the rows of level 0 until no run is long enough
+ * for the next level
+ * @return ERR_ALLOCATION_FAILURE when a level could not be allocated, the
+ * packed rows are destroyed then */
+static Error packed_rows_double(PackedRows *packed) {
+    const uint32_t  height = packed->dimensions.height;
+    const size_t    size = (size_t)height * packed->words;
+    PackedRowsBuild build = {NULL, packed, 1};
+    /* keep level 0 even for an empty bitmap */
+    if (!packed_any(packed->levels[0], size)) {
+        return error_none();
+    }
+    for (; build.level < PACKED_MAX_LEVELS; build.level++) {
+        /* the first level too long to fit into the bitmap ends doubling */
+        if ((UINT64_C(1) << build.level) > (uint64_t)height) {
+            break;
+        }
+        uint64_t *level = mem_malloc(sizeof(uint64_t) * size + 1);
+        if (level == NULL) {
+            packed_rows_dtor(packed);
+            return error_ctor(ERR_ALLOCATION_FAILURE,
+                              "Failed to allocate packed rows!\n");
+        }
+        packed->levels[packed->count++] = level;
+        parallel_for(height, PACKED_MIN_SLICE, packed_rows_build_level,
+                     &build);
+        if (!packed_any(level, size)) {
+            mem_free(level);
+            packed->count--;
+            break;
+        }
+    }
+    return error_none();
+}
+
+/**
+ * @brief packs rows of the bitmap and doubles the AND of them until no run
+ * is long enough for the next level
+ * @return ERR_ALLOCATION_FAILURE when a level could not be allocated */
+static Error packed_rows_ctor(const Bitmap *bmp, PackedRows *out_packed) {
+    Error err = packed_rows_init(bmp->dimensions, out_packed);
+    if (err.code != ERR_NONE) {
+        return err;
+    }
+    PackedRowsBuild build = {bmp, out_packed, 0};
+    parallel_for(bmp->dimensions.height, PACKED_MIN_SLICE,
+                 packed_rows_build_rows, &build);
+    return packed_rows_double(out_packed);
+}
+
+/**
+ * @brief retrieves packed rows of the bitmap, builds them on first use
+ * @return ERR_ALLOCATION_FAILURE when the rows could not be built */
+static Error packed_rows_cached(const Bitmap      *bmp,
+                                const PackedRows **out_packed) {
+    if (bmp->cache->packed == NULL) {
+        PackedRows *packed = mem_malloc(sizeof(PackedRows));
+        if (packed == NULL) {
+            return error_ctor(ERR_ALLOCATION_FAILURE,
+                              "Failed to allocate packed rows!\n");
+        }
+        Error err = packed_rows_ctor(bmp, packed);
+        if (err.code != ERR_NONE) {
+            mem_free(packed);
+            return err;
+        }
+        bmp->cache->packed = packed;
+    }
+    *out_packed = bmp->cache->packed;
+    return error_none();
+}
+
+/**
+ * @brief finds the first column from `col` on whose bit equals `filled`
+ * @return width of the bitmap if there is no such column */
+static uint32_t packed_next(const PackedRows *packed, const uint64_t *words,
+                            uint32_t col, bool filled) {
+    const uint32_t width = packed->dimensions.width;
+    const uint64_t flip = filled ? 0 : ~UINT64_C(0);
+    for (uint32_t word = col / PACKED_WORD_BITS; word < packed->words;
+         word++) {
+        uint64_t bits = words[word] ^ flip;
+        if (word == col / PACKED_WORD_BITS) {
+            bits &= ~UINT64_C(0) << (col % PACKED_WORD_BITS);
+        }
+        if (bits != 0) {
+            const uint32_t found = word * PACKED_WORD_BITS + bits_ctz64(bits);
+            return found < width ? found : width;
+        }
+    }
+    return width;
+}
+
+/** @return length of the rightward run starting at [row, col] */
+#define packed_run_right(packed, row, col)                                  \
+    (packed_next((packed), packed_row((packed), 0, (row)), (col), false) - \
+     (col))
+
+/** @return length of the downward run starting at [row, col], composed from
+ * the doubling levels from the longest one */
+static uint32_t packed_run_down(const PackedRows *packed, uint32_t row,
+                                uint32_t col) {
+    uint32_t length = 0;
+    for (uint32_t level = packed->count; level-- > 0;) {
+        if (row + length < packed->dimensions.height &&
+            packed_bit(packed_row(packed, level, row + length), col)) {
+            length += UINT32_C(1) << level;
+        }
+    }
+    return length;
+}
+
+/** @brief scans for longest horizontal line, zero and full words are skipped
+ * at once */
+static HLine packed_find_longest_hline(const Bitmap *bmp, SearchContext *ctx) {
+    const PackedRows *packed;
+    if (search_context_fail(ctx, packed_rows_cached(bmp, &packed))) {
+        return line_invalid_ctor();
+    }
+    HLine max = line_invalid_ctor();
+    for (uint32_t row = 0; row < bmp->dimensions.height; row++) {
+        const uint64_t *words = packed_row(packed, 0, row);
+        for (uint32_t col = packed_next(packed, words, 0, true);
+             col < bmp->dimensions.width;) {
+            const uint32_t stop = packed_next(packed, words, col, false);
+            HLine temp = line_ctor(point_ctor(col, row),
+                                   point_ctor(stop - 1, row));
+            if (line_is_invalid(max) || hline_cmp(max, temp) < 0) {
+                max = temp;
+            }
+            col = packed_next(packed, words, stop, true);
+        }
+    }
+    return max;
+}
+
+/**
+ * @brief finds longest vertical run of set bits by AND doubling, the longest
+ * level with any run gives length 2^k, the lower bits of the length are
+ * refined from the highest one by ANDing the level shifted by the length
+ * found so far
+ * @return ERR_ALLOCATION_FAILURE (in `ctx`) when the refinement rows could not
+ * be allocated */
+static VLine packed_longest_run_down(const PackedRows *packed,
+                                     SearchContext    *ctx) {
+    const uint32_t height = packed->dimensions.height;
+    const size_t   size = (size_t)height * packed->words;
+    if (!packed_any(packed->levels[0], size)) {
+        return line_invalid_ctor();
+    }
+    uint64_t *runs = mem_malloc(sizeof(uint64_t) * size + 1);
+    uint64_t *next = mem_malloc(sizeof(uint64_t) * size + 1);
+    if (runs == NULL || next == NULL) {
+        mem_free(runs);
+        mem_free(next);
+        search_context_fail(ctx, error_ctor(ERR_ALLOCATION_FAILURE,
+                                            "Failed to allocate packed "
+                                            "rows!\n"));
+        return line_invalid_ctor();
+    }
+    /* runs of at least `length` pixels start at set bits of `runs` */
+    const uint32_t top = packed->count - 1;
+    uint32_t       length = UINT32_C(1) << top;
+    memcpy(runs, packed->levels[top], sizeof(uint64_t) * size);
+    for (uint32_t level = top; level-- > 0;) {
+        const uint32_t step = UINT32_C(1) << level;
+        if (length + step > height) {
+            continue;
+        }
+        bool any = false;
+        for (uint32_t row = 0; row + length + step <= height; row++) {
+            const uint64_t *head = &runs[(size_t)row * packed->words];
+            const uint64_t *tail = packed_row(packed, level, row + length);
+            uint64_t       *out = &next[(size_t)row * packed->words];
+            for (uint32_t word = 0; word < packed->words; word++) {
+                out[word] = head[word] & tail[word];
+                any |= out[word] != 0;
+            }
+        }
+        if (any) {
+            uint64_t *swap = runs;
+            runs = next;
+            next = swap;
+            length += step;
+        }
+    }
+    /* the first set bit is the line with the smallest row, then column */
+    VLine max = line_invalid_ctor();
+    for (uint32_t row = 0; row + length <= height; row++) {
+        const uint64_t *words = &runs[(size_t)row * packed->words];
+        uint32_t        word = 0;
+        while (word < packed->words && words[word] == 0) {
+            word++;
+        }
+        if (word < packed->words) {
+            const uint32_t col =
+                word * PACKED_WORD_BITS + bits_ctz64(words[word]);
+            max = line_ctor(point_ctor(col, row),
+                            point_ctor(col, row + length - 1));
+            break;
+        }
+    }
+    mem_free(runs);
+    mem_free(next);
+    return max;
+}
+
+static VLine packed_find_longest_vline(const Bitmap *bmp, SearchContext *ctx) {
+    const PackedRows *packed;
+    if (search_context_fail(ctx, packed_rows_cached(bmp, &packed))) {
+        return line_invalid_ctor();
+    }
+    return packed_longest_run_down(packed, ctx);
+}
+
+/**
+ * @brief scans for the largest square, anchors are the set bits of packed
+ * rows, rightward runs are measured by words and downward runs composed from
+ * the doubling levels
+ * @return invalid square if no square was found */
+static Square packed_find_largest_square(const Bitmap  *bmp,
+                                         SearchContext *ctx) {
+    const PackedRows *packed;
+    if (search_context_fail(ctx, packed_rows_cached(bmp, &packed))) {
+        return square_invalid_ctor();
+    }
+    Square         max = square_invalid_ctor();
+    uint32_t       max_length = 0;
+    const uint32_t upper = bmp_bound_square_upper(bmp);
+    for (uint32_t row = 0;
+         row + max_length < bmp->dimensions.height && max_length < upper;
+         row++) {
+        const uint64_t *words = packed_row(packed, 0, row);
+        for (uint32_t col = packed_next(packed, words, 0, true);
+             col + max_length < bmp->dimensions.width;
+             col = packed_next(packed, words, col + 1, true)) {
+            uint32_t side = packed_run_right(packed, row, col);
+            if (side <= max_length) {
+                continue;
+            }
+            const uint32_t down = packed_run_down(packed, row, col);
+            side = side < down ? side : down;
+            side = side < upper ? side : upper;
+            for (; side > max_length; side--) {
+                if (packed_run_right(packed, row + side - 1, col) >= side &&
+                    packed_run_down(packed, row, col + side - 1) >= side) {
+                    square_set_max_square(
+                        &max, &max_length,
+                        square_ctor(point_ctor(col, row),
+                                    point_ctor(col + side - 1,
+                                               row + side - 1)));
+                    break;
+                }
+            }
+        }
+    }
+    return max;
+}
+
+/* =========================================
+ *                  Bars
+ * ========================================= */
+
+#ifndef FIGSEARCH_NO_MAIN
+
+/** @brief Bar is a line `thickness` pixels thick defined by its top-left
+ * point (ShapeGeometry::start) and its bottom-right point
+ * (ShapeGeometry::end), hline_length/vline_length give its length */
+typedef ShapeGeometry Bar;
+
+/** @brief shared state of the parallel build of the column windows */
+typedef struct BarColumnsBuild {
+    const PackedRows *packed;
+    PackedRows       *windows;
+    uint32_t          thickness;
+} BarColumnsBuild;
+
+/**
+ * @brief fills `out` with the AND of `thickness` consecutive rows from `row`,
+ * the window is covered by two (overlapping) doubling levels, so it costs one
+ * AND per word for any thickness
+ * @note `row + thickness` must not exceed the height of the bitmap */
+static void bar_rows_window(const PackedRows *packed, uint32_t row,
+                            uint32_t thickness, uint64_t *out) {
+    uint32_t level = 0;
+    while ((UINT32_C(2) << level) <= thickness) {
+        level++;
+    }
+    /* the level is missing when no vertical run is that long */
+    if (level >= packed->count) {
+        memset(out, 0, sizeof(uint64_t) * packed->words);
+        return;
+    }
+    const uint64_t *top = packed_row(packed, level, row);
+    const uint64_t *bottom = packed_row(
+        packed, level, row + thickness - (UINT32_C(1) << level));
+    for (uint32_t word = 0; word < packed->words; word++) {
+        out[word] = top[word] & bottom[word];
+    }
+}
+
+/** @brief ANDs `words` of a row with the row shifted by `shift` columns
+ * towards the column 0, in place
+ * @note words are read only at and after the one being written */
+static void bar_shift_and(uint64_t *words, uint32_t count, uint32_t shift) {
+    const uint32_t skip = shift / PACKED_WORD_BITS;
+    const uint32_t bits = shift % PACKED_WORD_BITS;
+    for (uint32_t word = 0; word < count; word++) {
+        uint64_t shifted = 0;
+        if (word + skip < count) {
+            shifted = words[word + skip] >> bits;
+        }
+        if (bits != 0 && word + skip + 1 < count) {
+            shifted |= words[word + skip + 1] << (PACKED_WORD_BITS - bits);
+        }
+        words[word] &= shifted;
+    }
+}
+
+/** @brief sets bit `c` of rows [begin, end) of the windows iff columns
+ * [c, c + thickness) of the row are filled, the window is doubled by shifts
+ * as rows are by levels */
+static void bar_build_columns(void *arg, uint32_t begin, uint32_t end) {
+    const BarColumnsBuild *build = arg;
+    const uint32_t         words = build->packed->words;
+    for (uint32_t row = begin; row < end; row++) {
+        uint64_t *window = packed_row(build->windows, 0, row);
+        memcpy(window, packed_row(build->packed, 0, row),
+               sizeof(uint64_t) * words);
+        uint32_t span = 1;
+        for (; 2 * span <= build->thickness; span *= 2) {
+            bar_shift_and(window, words, span);
+        }
+        if (span < build->thickness) {
+            bar_shift_and(window, words, build->thickness - span);
+        }
+    }
+}
+
+/**
+ * @brief scans for the longest horizontal bar `thickness` rows thick, the
+ * windows of rows are scanned for runs as the rows by the packed engine
+ * @return invalid bar if no bar was found */
+static Bar bar_find_longest_hline(const Bitmap *bmp, uint32_t thickness,
+                                  SearchContext *ctx) {
+    const PackedRows *packed;
+    if (search_context_fail(ctx, packed_rows_cached(bmp, &packed))) {
+        return shape_geometry_invalid_ctor();
+    }
+    Bar max = shape_geometry_invalid_ctor();
+    if (thickness > bmp->dimensions.height) {
+        return max;
+    }
+    uint64_t *window = mem_malloc(sizeof(uint64_t) * packed->words + 1);
+    if (window == NULL) {
+        search_context_fail(ctx, error_ctor(ERR_ALLOCATION_FAILURE,
+                                            "Failed to allocate bar "
+                                            "window!\n"));
+        return max;
+    }
+    for (uint32_t row = 0; row + thickness <= bmp->dimensions.height; row++) {
+        bar_rows_window(packed, row, thickness, window);
+        for (uint32_t col = packed_next(packed, window, 0, true);
+             col < bmp->dimensions.width;) {
+            const uint32_t stop = packed_next(packed, window, col, false);
+            const Bar      temp =
+                shape_geometry_ctor(point_ctor(col, row),
+                                    point_ctor(stop - 1, row + thickness - 1));
+            if (shape_geometry_is_invalid(max) || hline_cmp(max, temp) < 0) {
+                max = temp;
+            }
+            col = packed_next(packed, window, stop, true);
+        }
+    }
+    mem_free(window);
+    return max;
+}
+
+/**
+ * @brief scans for the longest vertical bar `thickness` columns thick, the
+ * windows of columns are packed rows themselves and their longest vertical
+ * run is found by AND doubling
+ * @return invalid bar if no bar was found */
+static Bar bar_find_longest_vline(const Bitmap *bmp, uint32_t thickness,
+                                  SearchContext *ctx) {
+    const PackedRows *packed;
+    if (search_context_fail(ctx, packed_rows_cached(bmp, &packed))) {
+        return shape_geometry_invalid_ctor();
+    }
+    if (thickness > bmp->dimensions.width) {
+        return shape_geometry_invalid_ctor();
+    }
+    PackedRows windows;
+    if (search_context_fail(ctx, packed_rows_init(bmp->dimensions, &windows))) {
+        return shape_geometry_invalid_ctor();
+    }
+    BarColumnsBuild build = {packed, &windows, thickness};
+    parallel_for(bmp->dimensions.height, PACKED_MIN_SLICE, bar_build_columns,
+                 &build);
+    if (search_context_fail(ctx, packed_rows_double(&windows))) {
+        return shape_geometry_invalid_ctor();
+    }
+    Bar bar = packed_longest_run_down(&windows, ctx);
+    if (!shape_geometry_is_invalid(bar)) {
+        bar.end.x += thickness - 1;
+    }
+    packed_rows_dtor(&windows);
+    return bar;
+}
+
+#endif /* FIGSEARCH_NO_MAIN */
+
+/* =========================================
+ *               Fused Lines
+ * ========================================= */
+
+/** @brief longest hline and vline found together by a single row sweep */
+typedef struct FusedLines {
+    HLine hline;
+    VLine vline;
+} FusedLines;
+
+/**
+ * @brief sweeps the rows once: the per-column vertical runs (with the longest
+ * run of each column and the row it reached it at) are updated by a
+ * branchless loop the compiler vectorizes, the horizontal runs are tracked
+ * over the same row while it is still in cache, so the bitmap is read once
+ * instead of once per line kind
+ * @note strict comparisons keep the first maximal run of the sweep, which is
+ * the one hline_cmp/vline_cmp prefer
+ * @return error when the column counters cannot be allocated */
+static Error fused_lines_ctor(const Bitmap *bmp, FusedLines *out_fused) {
+    const uint32_t width = bmp->dimensions.width;
+    const uint32_t height = bmp->dimensions.height;
+    uint32_t      *runs = mem_calloc((size_t)width * 3, sizeof(uint32_t));
+    if (runs == NULL) {
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate fused column runs!\n");
+    }
+    uint32_t *best = runs + width;
+    uint32_t *best_row = best + width;
+
+    uint32_t hline_max = 0;
+    Point    hline_end = point_invalid_ctor();
+    for (uint32_t row = 0; row < height; row++) {
+        const Pixel *pixels = &bmp_at(bmp, row, 0);
+        for (uint32_t col = 0; col < width; col++) {
+            const uint32_t filled = pixels[col] == PXL_FILLED;
+            const uint32_t run = (runs[col] + 1) * filled;
+            const bool     longer = run > best[col];
+            runs[col] = run;
+            best[col] = longer ? run : best[col];
+            best_row[col] = longer ? row : best_row[col];
+        }
+        uint32_t run = 0;
+        for (uint32_t col = 0; col < width; col++) {
+            run = pixels[col] == PXL_FILLED ? run + 1 : 0;
+            if (run > hline_max) {
+                hline_max = run;
+                hline_end = point_ctor(col, row);
+            }
+        }
+    }
+
+    /* columns are visited left to right, the upper run wins inside of one */
+    uint32_t vline_max = 0, vline_col = 0;
+    for (uint32_t col = 0; col < width; col++) {
+        const uint32_t start = best_row[col] + 1 - best[col];
+        if (best[col] > vline_max ||
+            (best[col] == vline_max && best[col] != 0 &&
+             start < best_row[vline_col] + 1 - vline_max)) {
+            vline_max = best[col];
+            vline_col = col;
+        }
+    }
+    *out_fused = (FusedLines){
+        .hline = hline_max == 0
+                     ? line_invalid_ctor()
+                     : line_ctor(point_ctor(hline_end.x + 1 - hline_max,
+                                            hline_end.y),
+                                 hline_end),
+        .vline = vline_max == 0
+                     ? line_invalid_ctor()
+                     : line_ctor(point_ctor(vline_col, best_row[vline_col] +
+                                                           1 - vline_max),
+                                 point_ctor(vline_col, best_row[vline_col])),
+    };
+    mem_free(runs);
+    return error_none();
+}
+
+/** @brief builds fused lines of `bmp` on first use and caches them, the
+ * exact lengths of both lines are recorded into the bitmap bounds */
+static Error fused_lines_cached(const Bitmap      *bmp,
+                                const FusedLines **out_fused) {
+    if (bmp->cache->fused == NULL) {
+        FusedLines *fused = mem_malloc(sizeof(FusedLines));
+        if (fused == NULL) {
+            return error_ctor(ERR_ALLOCATION_FAILURE,
+                              "Failed to allocate fused lines!\n");
+        }
+        Error err = fused_lines_ctor(bmp, fused);
+        if (err.code != ERR_NONE) {
+            mem_free(fused);
+            return err;
+        }
+        bmp->cache->fused = fused;
+        BitmapBounds *bounds = &bmp->cache->bounds;
+        bounds->hline = line_is_invalid(fused->hline)
+                            ? 0
+                            : hline_length(fused->hline);
+        bounds->vline = line_is_invalid(fused->vline)
+                            ? 0
+                            : vline_length(fused->vline);
+    }
+    *out_fused = bmp->cache->fused;
+    return error_none();
+}
+
+static HLine fused_find_longest_hline(const Bitmap *bmp, SearchContext *ctx) {
+    const FusedLines *fused;
+    if (search_context_fail(ctx, fused_lines_cached(bmp, &fused))) {
+        return line_invalid_ctor();
+    }
+    return fused->hline;
+}
+
+static VLine fused_find_longest_vline(const Bitmap *bmp, SearchContext *ctx) {
+    const FusedLines *fused;
+    if (search_context_fail(ctx, fused_lines_cached(bmp, &fused))) {
+        return line_invalid_ctor();
+    }
+    return fused->vline;
+}
+
+/** @brief the sweep gives exact bounds of the square side, the rowmajor
+ * square search prunes by them */
+static Square fused_find_largest_square(const Bitmap  *bmp,
+                                        SearchContext *ctx) {
+    const FusedLines *fused;
+    if (search_context_fail(ctx, fused_lines_cached(bmp, &fused))) {
+        return square_invalid_ctor();
+    }
+    return square_find_largest_square(bmp, ctx);
+}
+
+/* =========================================
+ *                Skip Scan
+ * ========================================= */
+
+/** @return true if pixel `pos` of line `index` (a row when `rows`, a column
+ * otherwise) is filled, the read is counted as a probe */
+static inline bool skip_filled(const Bitmap *bmp, bool rows, uint32_t index,
+                               uint32_t pos, SearchStats *stats) {
+    stats->probed++;
+    return (rows ? bmp_at(bmp, index, pos) : bmp_at(bmp, pos, index)) ==
+           PXL_FILLED;
+}
+
+/**
+ * @brief finds the first run of line `index` starting at `from` or later
+ * which is longer than `length`
+ *
+ * Such a run covers the pixel `length` past its start, so that pixel is
+ * probed first. When it is empty, no run starting before it is long enough
+ * and the scan jumps past it. Otherwise the run is extended backward (up to
+ * the pixels already known to be filled) and, if it reaches the start,
+ * forward to its end.
+ * @return start of the run (its length in `out_length`) or COORD_INVALID */
+static uint32_t skip_scan_longer(const Bitmap *bmp, bool rows, uint32_t index,
+                                 uint32_t from, uint32_t length,
+                                 uint32_t *out_length, SearchStats *stats) {
+    const uint32_t count =
+        rows ? bmp->dimensions.width : bmp->dimensions.height;
+    /* pixels [start, known) are known to be filled */
+    uint32_t start = from, known = from;
+    /* `from` may lie past the end when the previous run ended there */
+    while (length < count && start < count - length) {
+        const uint32_t probe = start + length;
+        if (!skip_filled(bmp, rows, index, probe, stats)) {
+            start = known = probe + 1;
+            continue;
+        }
+        uint32_t back = probe;
+        while (back > known &&
+               skip_filled(bmp, rows, index, back - 1, stats)) {
+            back--;
+        }
+        if (back > known) {
+            /* pixel before `back` is empty */
+            start = back;
+            known = probe + 1;
+            continue;
+        }
+        uint32_t end = probe + 1;
+        while (end < count && skip_filled(bmp, rows, index, end, stats)) {
+            end++;
+        }
+        *out_length = end - start;
+        return start;
+    }
+    return COORD_INVALID;
+}
+
+/** @brief scans for longest horizontal line, rows are scanned by probes
+ * @see skip_scan_longer */
+static HLine skip_find_longest_hline(const Bitmap *bmp, SearchContext *ctx) {
+    HLine    max = line_invalid_ctor();
+    uint32_t max_length = bmp_bound_line_lower(bmp, bmp->cache->bounds.hline);
+    max_length = max_length > 0 ? max_length - 1 : 0;
+    if (ctx->at_least != 0) {
+        max_length = ctx->at_least - 1;
+    }
+    ctx->stats.pixels = bmp_size_raw(bmp->dimensions);
+    for (uint32_t row = 0; row < bmp->dimensions.height; row++) {
+        if (search_context_cancelled(ctx)) {
+            return line_invalid_ctor();
+        }
+        uint32_t length = 0;
+        for (uint32_t col = skip_scan_longer(bmp, true, row, 0, max_length,
+                                             &length, &ctx->stats);
+             col != COORD_INVALID;
+             col = skip_scan_longer(bmp, true, row, col + length + 1,
+                                    max_length, &length, &ctx->stats)) {
+            /* the first run longer than the maximum is the leftmost one */
+            max = line_ctor(point_ctor(col, row),
+                            point_ctor(col + length - 1, row));
+            max_length = length;
+            if (ctx->at_least != 0) {
+                return max;
+            }
+        }
+    }
+    return max;
+}
+
+/** @brief scans for longest vertical line, columns are scanned by probes
+ * @note a line as long as the longest one wins when it starts on an upper
+ * row, so runs of the maximal length are looked for as well */
+static VLine skip_find_longest_vline(const Bitmap *bmp, SearchContext *ctx) {
+    VLine    max = line_invalid_ctor();
+    uint32_t max_length = bmp_bound_line_lower(bmp, bmp->cache->bounds.vline);
+    if (ctx->at_least != 0) {
+        max_length = ctx->at_least;
+    }
+    ctx->stats.pixels = bmp_size_raw(bmp->dimensions);
+    for (uint32_t col = 0; col < bmp->dimensions.width; col++) {
+        if (search_context_cancelled(ctx)) {
+            return line_invalid_ctor();
+        }
+        uint32_t length = 0;
+        for (uint32_t row = skip_scan_longer(
+                 bmp, false, col, 0, max_length > 0 ? max_length - 1 : 0,
+                 &length, &ctx->stats);
+             row != COORD_INVALID;
+             row = skip_scan_longer(bmp, false, col, row + length + 1,
+                                    max_length > 0 ? max_length - 1 : 0,
+                                    &length, &ctx->stats)) {
+            const VLine temp = line_ctor(point_ctor(col, row),
+                                         point_ctor(col, row + length - 1));
+            if (ctx->at_least != 0) {
+                return temp;
+            }
+            if (line_is_invalid(max) || vline_cmp(max, temp) < 0) {
+                max = temp;
+                max_length = length;
+            }
+        }
+    }
+    return max;
+}
+
+/* =========================================
+ *               Top Squares
+ * ========================================= */
+
+#ifndef FIGSEARCH_NO_MAIN
+
+/** @brief the largest square anchored at a pixel, known to be valid or an
+ * upper bound of it (@see square_find_top) */
+typedef struct SquareCandidate {
+    uint32_t row;
+    uint32_t col;
+    uint32_t side;
+} SquareCandidate;
+
+/** @brief heap order of the candidates, the same as of square_cmp */
+static inline bool square_candidate_before(SquareCandidate lhs,
+                                           SquareCandidate rhs) {
+    if (lhs.side != rhs.side) {
+        return lhs.side > rhs.side;
+    }
+    return lhs.row != rhs.row ? lhs.row < rhs.row : lhs.col < rhs.col;
+}
+
+/** @brief restores the heap property below `index` */
+static void square_heap_sift_down(SquareCandidate *heap, size_t size,
+                                  size_t index) {
+    for (;;) {
+        size_t best = index;
+        for (size_t child = 2 * index + 1; child <= 2 * index + 2; child++) {
+            if (child < size &&
+                square_candidate_before(heap[child], heap[best])) {
+                best = child;
+            }
+        }
+        if (best == index) {
+            return;
+        }
+        SquareCandidate swap = heap[index];
+        heap[index] = heap[best];
+        heap[best] = swap;
+        index = best;
+    }
+}
+
+/** @return side of the largest valid square anchored at [row, col] with side
+ * of at most `cap` (0 if there is none) */
+static uint32_t square_largest_side(const RunArrays *runs, uint32_t row,
+                                    uint32_t col, uint32_t cap) {
+    uint32_t side = run_arrays_right(runs, row, col);
+    if (side > run_arrays_down(runs, row, col)) {
+        side = run_arrays_down(runs, row, col);
+    }
+    for (side = side < cap ? side : cap; side > 0; side--) {
+        if (run_arrays_right(runs, row + side - 1, col) >= side &&
+            run_arrays_down(runs, row, col + side - 1) >= side) {
+            return side;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief finds `count` largest squares anchored at distinct pixels, with
+ * `disjoint` every square is the largest one not intersecting (sharing no
+ * pixel with) the squares found before it
+ *
+ * Every anchor enters a heap ordered by square_cmp with its largest square.
+ * Keys never grow: when the top intersects a found square, its anchor is
+ * dropped (lies in the square) or re-keyed by the largest square that still
+ * fits, so a top which fits is exactly the square a rerun of the search
+ * without the found squares would return. Anchors covered by found squares
+ * are rejected in O(1) by an occupancy grid.
+ * @return number of squares written to `out_squares` */
+static uint32_t square_find_top(const Bitmap *bmp, uint32_t count,
+                                bool disjoint, Square *out_squares,
+                                SearchContext *ctx) {
+    const RunArrays *runs;
+    if (search_context_fail(ctx, run_arrays_cached(bmp, &runs))) {
+        return 0;
+    }
+    const size_t     pixels = bmp_size_raw(bmp->dimensions);
+    SquareCandidate *heap = mem_malloc(sizeof(SquareCandidate) * pixels);
+    uint8_t *occupied = disjoint ? mem_calloc(pixels, sizeof(uint8_t)) : NULL;
+    if (heap == NULL || (disjoint && occupied == NULL)) {
+        mem_free(heap);
+        mem_free(occupied);
+        search_context_fail(ctx, error_ctor(ERR_ALLOCATION_FAILURE,
+                                            "Failed to allocate square "
+                                            "candidates!\n"));
+        return 0;
+    }
+    size_t size = 0;
+    for (uint32_t row = 0; row < bmp->dimensions.height; row++) {
+        for (uint32_t col = 0; col < bmp->dimensions.width; col++) {
+            const uint32_t side =
+                square_largest_side(runs, row, col, UINT32_MAX);
+            if (side > 0) {
+                heap[size++] = (SquareCandidate){row, col, side};
+            }
+        }
+    }
+    for (size_t i = size / 2; i-- > 0;) {
+        square_heap_sift_down(heap, size, i);
+    }
+    uint32_t found = 0;
+    while (found < count && size > 0) {
+        SquareCandidate *top = &heap[0];
+        uint32_t         cap = top->side;
+        const size_t     anchor =
+            (size_t)top->row * bmp->dimensions.width + top->col;
+        if (disjoint && occupied[anchor]) {
+            cap = 0;
+        }
+        /* squares with a larger side would reach a found one */
+        for (uint32_t i = 0; disjoint && cap > 0 && i < found; i++) {
+            const Square *other = &out_squares[i];
+            if (top->row > other->end.y || top->col > other->end.x) {
+                continue;
+            }
+            const uint32_t below = other->start.y > top->row
+                                       ? other->start.y - top->row
+                                       : 0;
+            const uint32_t right = other->start.x > top->col
+                                       ? other->start.x - top->col
+                                       : 0;
+            const uint32_t limit = below > right ? below : right;
+            cap = limit < cap ? limit : cap;
+        }
+        if (cap == top->side) {
+            const Square square = square_ctor(
+                point_ctor(top->col, top->row),
+                point_ctor(top->col + cap - 1, top->row + cap - 1));
+            out_squares[found++] = square;
+            for (uint32_t row = square.start.y; disjoint && row <= square.end.y;
+                 row++) {
+                memset(&occupied[(size_t)row * bmp->dimensions.width +
+                                 square.start.x],
+                       1, cap);
+            }
+            heap[0] = heap[--size];
+        } else {
+            top->side =
+                cap > 0 ? square_largest_side(runs, top->row, top->col, cap)
+                        : 0;
+            if (top->side == 0) {
+                heap[0] = heap[--size];
+            }
+        }
+        square_heap_sift_down(heap, size, 0);
+    }
+    mem_free(heap);
+    mem_free(occupied);
+    return found;
+}
+
+#endif /* FIGSEARCH_NO_MAIN */
+
+/* =========================================
+ *               Bitmap Cache
+ * ========================================= */
+
+static void bmp_cache_dtor(BitmapCache *cache) {
+    if (cache->row_store != NULL) {
+        row_store_dtor(cache->row_store);
+        mem_free(cache->row_store);
+    }
+    if (cache->tiled != NULL) {
+        tiled_dtor(cache->tiled);
+        mem_free(cache->tiled);
+    }
+    if (cache->sat != NULL) {
+        sat_dtor(cache->sat);
+        mem_free(cache->sat);
+    }
+    if (cache->runs != NULL) {
+        run_arrays_dtor(cache->runs);
+        mem_free(cache->runs);
+    }
+    if (cache->pyramid != NULL) {
+        pyramid_dtor(cache->pyramid);
+        mem_free(cache->pyramid);
+    }
+    if (cache->complement != NULL) {
+        complement_dtor(cache->complement);
+        mem_free(cache->complement);
+    }
+    if (cache->packed != NULL) {
+        packed_rows_dtor(cache->packed);
+        mem_free(cache->packed);
+    }
+    mem_free(cache->fused);
+    if (cache->corners != NULL) {
+        corner_masks_dtor(cache->corners);
+        mem_free(cache->corners);
+    }
+    *cache = (BitmapCache){
+        .bounds = {BMP_BOUND_UNKNOWN, BMP_BOUND_UNKNOWN, BMP_BOUND_UNKNOWN},
+    };
+}
+
+/* =========================================
+ *                 Engine
+ * ========================================= */
+
+/** @brief signature shared by all shape search functions */
+typedef ShapeGeometry (*ShapeSearchFunc)(const Bitmap *bmp, SearchContext *ctx);
+
+/** @brief set of search functions working over the same bitmap
+ * representation, selected by `--engine` */
+typedef struct ShapeEngine {
+    const char     *name;
+    ShapeSearchFunc hline;
+    ShapeSearchFunc vline;
+    ShapeSearchFunc square;
+    /** @brief reports every maximal shape to SearchContext::ties */
+    bool ties;
+} ShapeEngine;
+
+/** @note the first engine is the default one */
+static const ShapeEngine SHAPE_ENGINES[] = {
+    {"rowmajor", line_find_longest_hline, line_find_longest_vline,
+     square_find_largest_square, true},
+    {"dedup", row_store_find_longest_hline, row_store_find_longest_vline,
+     row_store_find_largest_square, false},
+    {"tiled", tiled_find_longest_hline, tiled_find_longest_vline,
+     tiled_find_largest_square, false},
+    {"sat", sat_find_longest_hline, sat_find_longest_vline,
+     sat_find_largest_square, false},
+    {"runs", runs_find_longest_hline, runs_find_longest_vline,
+     runs_find_largest_square, false},
+    {"complement", complement_find_longest_hline,
+     complement_find_longest_vline, complement_find_largest_square, false},
+    {"packed", packed_find_longest_hline, packed_find_longest_vline,
+     packed_find_largest_square, false},
+    {"fused", fused_find_longest_hline, fused_find_longest_vline,
+     fused_find_largest_square, false},
+    {"skip", skip_find_longest_hline, skip_find_longest_vline,
+     square_find_largest_square, false},
+};
+
+#define SHAPE_ENGINES_COUNT (sizeof(SHAPE_ENGINES) / sizeof(*SHAPE_ENGINES))
+
+/**
+ * @brief searches for the largest shape of given `kind` with `engine` and
+ * remembers its size in the bitmap's bounds for the following searches
+ * @note a witness of SearchContext::at_least is not necessarily the largest
+ * shape, its size is not remembered */
+static ShapeGeometry shape_engine_search(const ShapeEngine *engine,
+                                         ShapeKind kind, const Bitmap *bmp,
+                                         SearchContext *ctx) {
+    BitmapBounds  ignored;
+    BitmapBounds *bounds = ctx->at_least != 0 ? &ignored : &bmp->cache->bounds;
+    switch (kind) {
+        case SHAPE_HLINE: {
+            HLine line = engine->hline(bmp, ctx);
+            if (ctx->err.code == ERR_NONE) {
+                bounds->hline = line_is_invalid(line) ? 0 : hline_length(line);
+            }
+            return line;
+        }
+        case SHAPE_VLINE: {
+            VLine line = engine->vline(bmp, ctx);
+            if (ctx->err.code == ERR_NONE) {
+                bounds->vline = line_is_invalid(line) ? 0 : vline_length(line);
+            }
+            return line;
+        }
+        case SHAPE_SQUARE: {
+            Square square = engine->square(bmp, ctx);
+            if (ctx->err.code == ERR_NONE) {
+                bounds->square =
+                    square_is_invalid(square) ? 0 : square_side_length(square);
+            }
+            return square;
+        }
+    }
+    return shape_geometry_invalid_ctor();
+}
+
+#ifndef FIGSEARCH_NO_MAIN
+
+/** @return size of `shape` of given `kind` (0 for invalid shape) */
+static uint32_t shape_kind_size(ShapeKind kind, ShapeGeometry shape) {
+    if (shape_geometry_is_invalid(shape)) {
+        return 0;
+    }
+    switch (kind) {
+        case SHAPE_HLINE:
+            return hline_length(shape);
+        case SHAPE_VLINE:
+            return vline_length(shape);
+        case SHAPE_SQUARE:
+            return square_side_length(shape);
+    }
+    return 0;
+}
+
+#endif /* FIGSEARCH_NO_MAIN */
+
+/** @return engine registered under `name` or NULL when there is none */
+static const ShapeEngine *shape_engine_find(const char *name) {
+    for (size_t i = 0; i < SHAPE_ENGINES_COUNT; i++) {
+        if (strcmp(SHAPE_ENGINES[i].name, name) == 0) {
+            return &SHAPE_ENGINES[i];
+        }
+    }
+    return NULL;
+}
+
+/* =========================================
+ *                   Jobs
+ * ========================================= */
+
+/*
+ * Asynchronous searches, the entry points are declared by figsearch.h. A
+ * cancelled job stops at the next row of the rowmajor and skip scans.
+ */
+
+struct Job {
+    /** @brief path to the bitmap (or expression), kept by the caller */
+    const char        *file_name;
+    uint32_t           threshold;
+    ShapeKind          kind;
+    const ShapeEngine *engine;
+    JobCallback        callback;
+    void              *callback_arg;
+    /** @brief found shape (invalid when not found or on error) */
+    ShapeGeometry shape;
+    Error         err;
+    /** @brief counters of the search @see SearchContext */
+    SearchStats stats;
+    /** @brief set by job_cancel, polled by the search @see SearchContext */
+    atomic_bool cancel;
+    /** @brief the job left the queue and its worker finished with it
+     * (guarded by the pool lock) */
+    bool done;
+    /** @brief a byte is written to [1] once done, [0] is the pollable end */
+    int  signal[2];
+    Job *next;
+};
+
+struct JobPool {
+    pthread_mutex_t lock;
+    /** @brief wakes the workers when a job is queued or the pool stops */
+    pthread_cond_t queued;
+    /** @brief wakes job_wait when a job is done */
+    pthread_cond_t finished;
+    Job           *head;
+    Job           *tail;
+    bool           stopping;
+    uint32_t       threads;
+    pthread_t      handles[PARALLEL_MAX_THREADS];
+};
+
+ErrorNum job_create(const char *file_name, ShapeKind kind, Job **out_job) {
+    Job *job = mem_malloc(sizeof(Job));
+    if (job == NULL) {
+        return ERR_ALLOCATION_FAILURE;
+    }
+    *job = (Job){
+        .file_name = file_name,
+        .threshold = BMP_LOADER_THRESHOLD_DEFAULT,
+        .kind = kind,
+        .engine = &SHAPE_ENGINES[0],
+        .shape = shape_geometry_invalid_ctor(),
+        .err = error_none(),
+    };
+    atomic_init(&job->cancel, false);
+    if (pipe(job->signal) != 0) {
+        mem_free(job);
+        return ERR_INTERNAL;
+    }
+    fcntl(job->signal[0], F_SETFD, FD_CLOEXEC);
+    fcntl(job->signal[1], F_SETFD, FD_CLOEXEC);
+    *out_job = job;
+    return ERR_NONE;
+}
+
+void job_destroy(Job *job) {
+    close(job->signal[0]);
+    close(job->signal[1]);
+    error_dtor(&job->err);
+    mem_free(job);
+}
+
+bool job_set_engine(Job *job, const char *engine) {
+    const ShapeEngine *found = shape_engine_find(engine);
+    if (found == NULL) {
+        return false;
+    }
+    job->engine = found;
+    return true;
+}
+
+void job_set_threshold(Job *job, uint32_t threshold) {
+    job->threshold = threshold;
+}
+
+void job_set_callback(Job *job, JobCallback callback, void *arg) {
+    job->callback = callback;
+    job->callback_arg = arg;
+}
+
+int job_fd(const Job *job) { return job->signal[0]; }
+
+void job_cancel(Job *job) {
+    atomic_store_explicit(&job->cancel, true, memory_order_relaxed);
+}
+
+ErrorNum job_result(const Job *job, ShapeGeometry *out_shape,
+                    const char **out_message) {
+    *out_shape = job->shape;
+    if (out_message != NULL) {
+        *out_message = job->err.msg;
+    }
+    return job->err.code;
+}
+
+/** @brief loads the bitmap of the job and searches it on the calling worker */
+static void job_run(Job *job) {
+    if (atomic_load_explicit(&job->cancel, memory_order_relaxed)) {
+        job->err = error_ctor(ERR_CANCELLED, "Search was cancelled!");
+        return;
+    }
+    Bitmap bmp = {0};
+    mem_phase_enter(MEM_PHASE_LOAD);
+    Error err = bmp_load(job->file_name, job->threshold, &bmp);
+    mem_phase_enter(MEM_PHASE_SEARCH);
+    if (err.code != ERR_NONE) {
+        job->err = err;
+        return;
+    }
+    SearchContext ctx = search_context_ctor();
+    ctx.cancel = &job->cancel;
+    job->shape = shape_engine_search(job->engine, job->kind, &bmp, &ctx);
+    job->err = ctx.err;
+    job->stats = ctx.stats;
+    bmp_dtor(&bmp);
+}
+
+/** @brief takes jobs from the queue until the pool stops, jobs still queued
+ * when it stops are cancelled */
+static void *job_pool_worker(void *arg) {
+    JobPool *pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->head == NULL && !pool->stopping) {
+            pthread_cond_wait(&pool->queued, &pool->lock);
+        }
+        Job *job = pool->head;
+        if (job == NULL) {
+            break;
+        }
+        pool->head = job->next;
+        if (pool->head == NULL) {
+            pool->tail = NULL;
+        }
+        if (pool->stopping) {
+            job_cancel(job);
+        }
+        pthread_mutex_unlock(&pool->lock);
+        job_run(job);
+        if (job->callback != NULL) {
+            job->callback(job, job->callback_arg);
+        }
+        /* the job may be destroyed as soon as the byte is read, so it is the
+         * last access to it */
+        /* a cancellation of this run does not carry over to the next
+         * submission */
+        atomic_store_explicit(&job->cancel, false, memory_order_relaxed);
+        pthread_mutex_lock(&pool->lock);
+        job->done = true;
+        pthread_cond_broadcast(&pool->finished);
+        const ssize_t written = write(job->signal[1], "", 1);
+        (void)written;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+void job_pool_destroy(JobPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->queued);
+    pthread_mutex_unlock(&pool->lock);
+    for (uint32_t i = 0; i < pool->threads; i++) {
+        pthread_join(pool->handles[i], NULL);
+    }
+    pthread_cond_destroy(&pool->finished);
+    pthread_cond_destroy(&pool->queued);
+    pthread_mutex_destroy(&pool->lock);
+    mem_free(pool);
+}
+
+ErrorNum job_pool_create(uint32_t threads, JobPool **out_pool) {
+    JobPool *pool = mem_malloc(sizeof(JobPool));
+    if (pool == NULL) {
+        return ERR_ALLOCATION_FAILURE;
+    }
+    *pool = (JobPool){.head = NULL};
+    if (threads == 0) {
+        threads = parallel_thread_count();
+    }
+    if (threads > PARALLEL_MAX_THREADS) {
+        threads = PARALLEL_MAX_THREADS;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->queued, NULL);
+    pthread_cond_init(&pool->finished, NULL);
+    for (; pool->threads < threads; pool->threads++) {
+        if (pthread_create(&pool->handles[pool->threads], NULL,
+                           job_pool_worker, pool) != 0) {
+            break;
+        }
+    }
+    if (pool->threads == 0) {
+        job_pool_destroy(pool);
+        return ERR_INTERNAL;
+    }
+    *out_pool = pool;
+    return ERR_NONE;
+}
+
+/** @brief reads the completion byte of the previous submission unless the
+ * caller already did, so that the descriptor waits for the next one */
+static void job_drain_signal(Job *job) {
+    struct pollfd ready = {.fd = job->signal[0], .events = POLLIN};
+    char          byte;
+    while (poll(&ready, 1, 0) > 0 && read(job->signal[0], &byte, 1) == 1) {
+    }
+}
+
+void job_submit(JobPool *pool, Job *job) {
+    /* a done job may be submitted again, the result of its previous
+     * submission is dropped */
+    job_drain_signal(job);
+    error_dtor(&job->err);
+    job->err = error_none();
+    job->shape = shape_geometry_invalid_ctor();
+    job->stats = (SearchStats){0};
+    pthread_mutex_lock(&pool->lock);
+    job->next = NULL;
+    job->done = false;
+    if (pool->tail != NULL) {
+        pool->tail->next = job;
+    } else {
+        pool->head = job;
+    }
+    pool->tail = job;
+    pthread_cond_signal(&pool->queued);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void job_wait(JobPool *pool, Job *job) {
+    pthread_mutex_lock(&pool->lock);
+    while (!job->done) {
+        pthread_cond_wait(&pool->finished, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+#ifndef FIGSEARCH_NO_MAIN
+
+/* =========================================
+ *                 Command
+ * ========================================= */
+
+/** @brief specifies the type of command the user can execute */
+typedef enum UserCommandAction {
+    HELP = 0,
+    TEST,
+    HLINE,
+    VLINE,
+    SQUARE,
+    DENSITY,
+    SEGMENT,
+    DIAMOND,
+    RUN,
+    INDEX_BUILD,
+    INDEX_QUERY
+} UserCommandAction;
+/** @brief optional switches modifying the command execution */
+typedef struct UserCommandOptions {
+    /** @brief PGM gray threshold @see BitmapLoader::threshold */
+    uint32_t threshold;
+    /** @brief engine executing the shape search @see SHAPE_ENGINES */
+    const ShapeEngine *engine;
+    /** @brief every engine executes the shape search ("--engine=all") */
+    bool all_engines;
+    /** @brief engines are compared instead of printing the shape alone */
+    bool compare;
+    /** @brief prints search statistics to stderr */
+    bool stats;
+    /** @brief prints every shape of the maximal size, not just the first */
+    bool ties;
+    /** @brief path to the rectangle query file (density command) */
+    const char *queries_file;
+    /** @brief MiB of bitmaps loaded at once by the run command (0 = no cap) */
+    uint32_t memory_cap;
+    /** @brief number of directions searched by the segment command */
+    uint32_t angles;
+    /** @brief number of largest squares to print (0 = just the largest) */
+    uint32_t top;
+    /** @brief squares printed with `top` must not intersect */
+    bool disjoint;
+    /** @brief any shape of at least this size is printed (0 = the largest)
+     * @see SearchContext::at_least */
+    uint32_t at_least;
+    /** @brief hline/vline is a bar of this many rows/columns @see Bar */
+    uint32_t thickness;
+    /** @brief milliseconds after which the search is cancelled (0 = never)
+     * @see cmd_execute_timed_search */
+    uint32_t timeout;
+    /** @brief index written by "index build" */
+    const char *index_file;
+    /** @brief minimal shape sizes of "index query" (BMP_BOUND_UNKNOWN when
+     * not given) */
+    BitmapBounds index_min;
+    /** @brief "index query" matches bitmaps passing any of the minimums */
+    bool index_any;
+} UserCommandOptions;
+/** @brief struct containing command information passed by the user */
+typedef struct UserCommand {
+    UserCommandAction action_type;
+    /** @brief path to the bitmap file */
+    const char        *file_name;
+    UserCommandOptions options;
+} UserCommand;
+
+static const char *HELP_MESSAGE =
+    "Figsearch Algorithm\n"
+    "===================\n"
+    "A tool to analyze bitmap images for specific geometric patterns.\n\n"
+    "USAGE:\n"
+    "    figsearch [command] [options] [bitmap location]\n\n"
+    "COMMANDS:\n"
+    "    --help       Displays this help message.\n"
+    "    test         Validates the specified bitmap file.\n"
+    "                 Requires: [bitmap location].\n"
+    "    hline        Finds the longest horizontal line in the bitmap.\n"
+    "                 Requires: [bitmap location].\n"
+    "    vline        Finds the longest vertical line in the bitmap.\n"
+    "                 Requires: [bitmap location].\n"
+    "    square       Detects the largest square in the bitmap.\n"
+    "                 Requires: [bitmap location].\n"
+    "    density      Prints the number of filled pixels of each rectangle\n"
+    "                 given as \"row col row col\" (top-left, bottom-right)\n"
+    "                 in the query file, one count per line.\n"
+    "                 Requires: --queries [file] [bitmap location].\n"
+    "    segment      Finds the longest digital straight segment (most\n"
+    "                 pixels) over N directions evenly covering 180\n"
+    "                 degrees (--angles N, 8 by default).\n"
+    "                 Requires: [bitmap location].\n"
+    "    diamond      Finds the largest hollow diamond (square rotated by\n"
+    "                 45 degrees, its sides are diagonal lines), printed\n"
+    "                 as its top and bottom vertex.\n"
+    "                 Requires: [bitmap location].\n"
+    "    run          Executes a plan, each of its lines is a query\n"
+    "                 \"[bitmap location] [command] [options]\". Every\n"
+    "                 bitmap is loaded once for all of its queries, bitmaps\n"
+    "                 are processed in parallel, results keep plan order.\n"
+    "                 Requires: [plan location].\n"
+    "    index build  Summarizes every bitmap of a directory (size,\n"
+    "                 density, longest hline/vline, largest square and\n"
+    "                 pixel hash) into an index. Summaries of unchanged\n"
+    "                 files are kept, changed files are refreshed in\n"
+    "                 parallel.\n"
+    "                 Requires: [directory] [index location].\n"
+    "    index query  Prints bitmaps of the index passing all of the\n"
+    "                 given minimums (--hline, --vline, --square).\n"
+    "                 Requires: [index location].\n\n";
+
+/** @brief options and notes parts of the help message, kept apart so none of
+ * the literals exceeds the length C compilers have to support */
+static const char *HELP_OPTIONS =
+    "OPTIONS:\n"
+    "    --threshold T  Gray value from which PGM pixels are filled.\n"
+    "                   Defaults to half of the PGM's maximal gray value.\n"
+    "    --engine NAME  Selects the search engine (hline, vline, square):\n"
+    "                   rowmajor  scans the bitmap as loaded, skipping\n"
+    "                             bands of rows/columns which an AND/OR\n"
+    "                             pyramid rules out, the pyramid is built\n"
+    "                             when 1/16 of the rows are empty (default).\n"
+    "                   dedup     stores each distinct row once and scans\n"
+    "                             distinct rows/runs of identical rows.\n"
+    "                   tiled     packs 8x8 pixel tiles in Z-order and scans\n"
+    "                             rows and columns 8 pixels at a time.\n"
+    "                   sat       checks segments in O(1) using summed area\n"
+    "                             table.\n"
+    "                   runs      looks up rightward/downward run length of\n"
+    "                             every pixel in O(1).\n"
+    "                   complement stores only the empty pixels of each\n"
+    "                             row/column and searches the gaps between\n"
+    "                             them (near-full bitmaps).\n"
+    "                   packed    packs rows into 64-bit words, vertical\n"
+    "                             runs are found by ANDing whole rows\n"
+    "                             with logarithmic doubling.\n"
+    "                   fused     finds the longest hline and vline\n"
+    "                             together by a single sweep of the rows.\n"
+    "                   skip      probes the pixel a longer line has to\n"
+    "                             cover first and jumps past it if empty\n"
+    "                             (hline and vline, square as rowmajor).\n"
+    "                   all       runs every engine above, requires\n"
+    "                             --compare.\n"
+    "    --compare      With --engine=all, runs each engine on the loaded\n"
+    "                   bitmap with none of the structures built by the\n"
+    "                   others, checks that all of them found the same\n"
+    "                   shape and prints the time each of them took.\n"
+    "    --stats        Prints search statistics and allocations (count,\n"
+    "                   bytes, peak of live bytes and the largest one) of\n"
+    "                   the setup, load and search phases to stderr.\n"
+    "    --ties         Prints every largest shape (hline, vline, square)\n"
+    "                   found by a single scan, one per line. Supported by\n"
+    "                   the rowmajor engine.\n"
+    "    --queries FILE Rectangle queries of the density command.\n"
+    "    --angles N     Number of directions of the segment command.\n"
+    "    --top K        Prints K largest squares (square command), each\n"
+    "                   anchored at a different pixel, from the largest.\n"
+    "    --disjoint     With --top, every square is the largest one which\n"
+    "                   shares no pixel with the squares printed before.\n"
+    "    --at-least N   Prints any shape (hline, vline, square) of size at\n"
+    "                   least N instead of the largest one. The rowmajor\n"
+    "                   engine stops at the first one it scans.\n"
+    "    --thickness K  Finds the longest bar K pixels thick instead of a\n"
+    "                   line (K rows of hline, K columns of vline), printed\n"
+    "                   as its top-left and bottom-right pixel. Windows of\n"
+    "                   K rows/columns of packed rows are searched.\n"
+    "    --timeout MS   Gives up the search (hline, vline, square) after MS\n"
+    "                   milliseconds, the rowmajor and skip engines stop\n"
+    "                   at the next row, others finish and their result\n"
+    "                   is dropped. Not supported in plans.\n"
+    "    --memory-cap M Caps MiB of bitmaps and derived structures the run\n"
+    "                   command holds at once (unlimited by default).\n"
+    "    --hline N      Index query: longest hline of at least N pixels.\n"
+    "    --vline N      Index query: longest vline of at least N pixels.\n"
+    "    --square N     Index query: largest square side of at least N.\n"
+    "    --any          Index query: passing any of the minimums suffices.\n\n";
+
+static const char *HELP_NOTES =
+    "NOTES:\n"
+    "    - All commands (except --help) require the [bitmap location] "
+    "argument.\n"
+    "    - hline, vline and square commands implicitly check the validity of "
+    "the file.\n"
+    "    - The bitmap location should be a valid path to a bitmap file.\n"
+    "    - Besides the figsearch text format, grayscale PGM (P2/P5) files "
+    "are\n      accepted and thresholded while loading.\n"
+    "    - The bitmap location may be an expression combining bitmaps of the\n"
+    "      same size with and(), or(), xor() and not(), e.g.\n"
+    "      figsearch square 'and(a.txt, not(b.txt))'.\n"
+    "    - A mosaic manifest (\"mosaic HEIGHT WIDTH\" followed by \"ROW COL\n"
+    "      PATH\" tile lines) is searched as one bitmap, tiles are loaded in\n"
+    "      parallel and pixels not covered by any tile are empty.\n"
+    "    - Example usage: figsearch hline my_image.bmp\n";
+
+/**
+ * @brief executes "--help" figsearch command by printing basic data about the
+ * command options */
+static inline Error cmd_display_help_message(void) {
+    printf("%s%s%s", HELP_MESSAGE, HELP_OPTIONS, HELP_NOTES);
+    return error_none();
+}
+
+/**
+ * @brief loads the bitmap the command refers to
+ * @return error of the loader when the bitmap file is not valid */
+static Error cmd_load_bitmap(const UserCommand *cmd, Bitmap *out_bmp) {
+    return bmp_load(cmd->file_name, cmd->options.threshold, out_bmp);
+}
+
+/** @brief prints search statistics gathered by the engine */
+static void cmd_print_search_stats(FILE *diag, const SearchStats *stats) {
+    if (stats->rows != 0) {
+        fprintf(diag,
+                "dedup: %" PRIu32 " distinct rows out of %" PRIu32
+                " (ratio %.2f), %" PRIu32 " runs of identical rows\n",
+                stats->unique_rows, stats->rows,
+                (double)stats->rows / stats->unique_rows, stats->row_runs);
+    }
+    if (stats->pyramid_lines != 0) {
+        fprintf(diag,
+                "pyramid: %" PRIu32 " of %" PRIu32
+                " rows/columns skipped\n",
+                stats->pyramid_skipped, stats->pyramid_lines);
+    }
+    if (stats->filled != 0) {
+        fprintf(diag,
+                "corners: %" PRIu64 " top-left corners out of %" PRIu64
+                " filled pixels%s\n",
+                stats->corners, stats->filled,
+                stats->corners_dropped ? ", every filled pixel walked" : "");
+    }
+    if (stats->pixels != 0) {
+        fprintf(diag,
+                "skip: %" PRIu64 " pixels probed out of %" PRIu64 "\n",
+                stats->probed, stats->pixels);
+    }
+}
+
+/** @return milliseconds elapsed since `start` */
+static double cmd_elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) * 1e3 +
+           (double)(now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/**
+ * @brief executes shape search of given `kind` with every engine on already
+ * loaded `bmp`, each engine gets a cache of its own so it neither reuses the
+ * structures nor the bounds found by the others
+ *
+ * The winner by shape_geometry_cmp over all results is the reference each
+ * engine has to match. A table of the engines, their times and results is
+ * printed to `out`.
+ * @return ERR_INTERNAL when an engine disagrees with the reference */
+static Error cmd_execute_engine_compare(const Bitmap *bmp, ShapeKind kind,
+                                        FILE *out) {
+    uint32_t (*const size_func)(const ShapeGeometry) =
+        kind == SHAPE_HLINE   ? hline_length
+        : kind == SHAPE_VLINE ? vline_length
+                              : square_side_length;
+    ShapeGeometry shapes[SHAPE_ENGINES_COUNT];
+    double        times[SHAPE_ENGINES_COUNT];
+    ShapeGeometry reference = shape_geometry_invalid_ctor();
+    for (size_t i = 0; i < SHAPE_ENGINES_COUNT; i++) {
+        BitmapCache cache = {
+            .bounds = {BMP_BOUND_UNKNOWN, BMP_BOUND_UNKNOWN, BMP_BOUND_UNKNOWN},
+        };
+        Bitmap        fresh = {bmp->dimensions, bmp->data, &cache};
+        SearchContext ctx = search_context_ctor();
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        shapes[i] = shape_engine_search(&SHAPE_ENGINES[i], kind, &fresh, &ctx);
+        times[i] = cmd_elapsed_ms(&start);
+        bmp_cache_dtor(&cache);
+        if (ctx.err.code != ERR_NONE) {
+            return ctx.err;
+        }
+        if (!shape_geometry_is_invalid(shapes[i]) &&
+            (shape_geometry_is_invalid(reference) ||
+             shape_geometry_cmp(reference, shapes[i], size_func) < 0)) {
+            reference = shapes[i];
+        }
+    }
+    /* print the table, the fastest engine is named below it */
+    size_t fastest = 0, disagree = 0;
+    fprintf(out, "%-12s %12s  %-8s %s\n", "engine", "time [ms]", "status",
+            "result");
+    for (size_t i = 0; i < SHAPE_ENGINES_COUNT; i++) {
+        const bool agrees =
+            shape_geometry_is_invalid(shapes[i])
+                ? shape_geometry_is_invalid(reference)
+                : !shape_geometry_is_invalid(reference) &&
+                      shapes[i].start.x == reference.start.x &&
+                      shapes[i].start.y == reference.start.y &&
+                      shapes[i].end.x == reference.end.x &&
+                      shapes[i].end.y == reference.end.y;
+        disagree += !agrees;
+        fastest = times[i] < times[fastest] ? i : fastest;
+        fprintf(out, "%-12s %12.3f  %-8s ", SHAPE_ENGINES[i].name, times[i],
+                agrees ? "ok" : "DIFFERS");
+        if (shape_geometry_is_invalid(shapes[i])) {
+            fprintf(out, "Not found\n");
+        } else {
+            shape_geometry_fprint(out, shapes[i]);
+        }
+    }
+    fprintf(out, "fastest: %s\n", SHAPE_ENGINES[fastest].name);
+    if (disagree != 0) {
+        return error_ctor(ERR_INTERNAL,
+                          "%zu engine(s) disagree with the reference "
+                          "result!",
+                          disagree);
+    }
+    return error_none();
+}
+
+/**
+ * @brief executes shape search of given `kind` with the selected engine on
+ * already loaded `bmp`, result is printed to `out`, statistics to `diag` */
+static Error cmd_execute_shape_search(const UserCommand *cmd,
+                                      const Bitmap *bmp, ShapeKind kind,
+                                      FILE *out, FILE *diag) {
+    if (cmd->options.compare) {
+        return cmd_execute_engine_compare(bmp, kind, out);
+    }
+    /* scan for largest shape */
+    SearchContext ctx = search_context_ctor();
+    TieSink       ties;
+    if (cmd->options.ties) {
+        /* the exact size of an earlier search lets ties stream directly */
+        const BitmapBounds *bounds = &bmp->cache->bounds;
+        tie_sink_init(&ties, out,
+                      kind == SHAPE_HLINE   ? bounds->hline
+                      : kind == SHAPE_VLINE ? bounds->vline
+                                            : bounds->square);
+        ctx.ties = &ties;
+    }
+    /* an exact size known from an earlier search may already rule out any
+     * witness of `at_least` */
+    const BitmapBounds *bounds = &bmp->cache->bounds;
+    const uint32_t      known = kind == SHAPE_HLINE   ? bounds->hline
+                                : kind == SHAPE_VLINE ? bounds->vline
+                                                      : bounds->square;
+    ctx.at_least = cmd->options.at_least;
+    ShapeGeometry shape = shape_geometry_invalid_ctor();
+    /* bars are not longer than lines, the bound rules them out as well */
+    const bool search = ctx.at_least == 0 || known == BMP_BOUND_UNKNOWN ||
+                        known >= ctx.at_least;
+    if (search && cmd->options.thickness > 1) {
+        shape = kind == SHAPE_HLINE
+                    ? bar_find_longest_hline(bmp, cmd->options.thickness, &ctx)
+                    : bar_find_longest_vline(bmp, cmd->options.thickness, &ctx);
+    } else if (search) {
+        shape = shape_engine_search(cmd->options.engine, kind, bmp, &ctx);
+    }
+    /* engines without early exit return the largest shape */
+    if (shape_kind_size(kind, shape) < ctx.at_least) {
+        shape = shape_geometry_invalid_ctor();
+    }
+    if (ctx.ties != NULL && ctx.err.code == ERR_NONE &&
+        !shape_geometry_is_invalid(shape)) {
+        search_context_fail(&ctx, tie_sink_emit(&ties));
+    }
+    if (ctx.ties != NULL) {
+        tie_sink_dtor(&ties);
+    }
+    if (ctx.err.code != ERR_NONE) {
+        return ctx.err;
+    }
+    if (cmd->options.stats) {
+        cmd_print_search_stats(diag, &ctx.stats);
+    }
+    /* print results */
+    if (shape_geometry_is_invalid(shape)) {
+        fprintf(out, "Not found\n");
+    } else if (!cmd->options.ties) {
+        shape_geometry_fprint(out, shape);
+    }
+    return error_none();
+}
+
+/** @brief prints `top` largest (disjoint) squares of already loaded `bmp`
+ * to `out`, one per line from the largest one */
+static Error cmd_execute_top_squares(const UserCommand *cmd, const Bitmap *bmp,
+                                     FILE *out) {
+    /* every pixel anchors a single square at most */
+    const size_t   pixels = bmp_size_raw(bmp->dimensions);
+    const uint32_t top =
+        cmd->options.top < pixels ? cmd->options.top : (uint32_t)pixels;
+    Square *squares = mem_malloc(sizeof(Square) * top + 1);
+    if (squares == NULL) {
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate squares!\n");
+    }
+    SearchContext  ctx = search_context_ctor();
+    const uint32_t found =
+        square_find_top(bmp, top, cmd->options.disjoint, squares, &ctx);
+    if (ctx.err.code != ERR_NONE) {
+        mem_free(squares);
+        return ctx.err;
+    }
+    if (found == 0) {
+        fprintf(out, "Not found\n");
+    }
+    for (uint32_t i = 0; i < found; i++) {
+        shape_geometry_fprint(out, squares[i]);
+    }
+    mem_free(squares);
+    return error_none();
+}
+
+/** @brief executes segment search over the directions of the command on
+ * already loaded `bmp`, result is printed to `out` */
+static Error cmd_execute_segment(const UserCommand *cmd, const Bitmap *bmp,
+                                 FILE *out) {
+    SearchContext ctx = search_context_ctor();
+    const Segment segment =
+        segment_find_longest(bmp, cmd->options.angles, &ctx);
+    if (ctx.err.code != ERR_NONE) {
+        return ctx.err;
+    }
+    if (shape_geometry_is_invalid(segment)) {
+        fprintf(out, "Not found\n");
+    } else {
+        shape_geometry_fprint(out, segment);
+    }
+    return error_none();
+}
+
+/** @brief executes diamond search on already loaded `bmp`, result is printed
+ * to `out` */
+static Error cmd_execute_diamond(const Bitmap *bmp, FILE *out) {
+    SearchContext ctx = search_context_ctor();
+    const Diamond diamond = diamond_find_largest_diamond(bmp, &ctx);
+    if (ctx.err.code != ERR_NONE) {
+        return ctx.err;
+    }
+    if (shape_geometry_is_invalid(diamond)) {
+        fprintf(out, "Not found\n");
+    } else {
+        shape_geometry_fprint(out, diamond);
+    }
+    return error_none();
+}
+
+/**
+ * @brief answers every rectangle query of `queries_file` in O(1) using the
+ * summed area table of already loaded `bmp`
+ * @return ERR_INVALID_QUERY_FILE when a query is malformed or out of range */
+static Error cmd_execute_density(const UserCommand *cmd, const Bitmap *bmp,
+                                 FILE *out) {
+    FILE *file = fopen(cmd->options.queries_file, "r");
+    if (file == NULL) {
+        return error_ctor(ERR_INVALID_QUERY_FILE,
+                          "Failed to open file [%s]! Os error: %s\n",
+                          cmd->options.queries_file, strerror(errno));
+    }
+    const SummedAreaTable *sat;
+    Error                  err = sat_cached(bmp, &sat);
+    /* answer queries one by one */
+    for (size_t query = 1; err.code == ERR_NONE; query++) {
+        uint32_t rect[4] = {0};
+        int      ret = fscanf(file,
+                              "%" SCNu32 " %" SCNu32 " %" SCNu32 " %" SCNu32,
+                              &rect[0], &rect[1], &rect[2], &rect[3]);
+        if (ret == EOF) {
+            break;
+        }
+        const Point top_left = point_ctor(rect[1], rect[0]);
+        const Point bottom_right = point_ctor(rect[3], rect[2]);
+        if (ret != 4 || top_left.x > bottom_right.x ||
+            top_left.y > bottom_right.y ||
+            bottom_right.x >= bmp->dimensions.width ||
+            bottom_right.y >= bmp->dimensions.height) {
+            err = error_ctor(ERR_INVALID_QUERY_FILE,
+                             "Invalid rectangle query #%zu in [%s]!", query,
+                             cmd->options.queries_file);
+            break;
+        }
+        fprintf(out, "%" PRIu64 "\n", sat_count(sat, top_left, bottom_right));
+    }
+    /* cleanup and return */
+    fclose(file);
+    return err;
+}
+
+/**
+ * @brief executes a bitmap query (test, hline, vline, square, density,
+ * segment or diamond) on
+ * already loaded `bmp`
+ * @note "test" query only confirms the bitmap, loading it was the test */
+static Error cmd_execute_query(const UserCommand *cmd, const Bitmap *bmp,
+                               FILE *out, FILE *diag) {
+    switch (cmd->action_type) {
+        case TEST:
+            fprintf(out, "Valid\n");
+            return error_none();
+        case HLINE:
+            return cmd_execute_shape_search(cmd, bmp, SHAPE_HLINE, out, diag);
+        case VLINE:
+            return cmd_execute_shape_search(cmd, bmp, SHAPE_VLINE, out, diag);
+        case SQUARE:
+            if (cmd->options.top > 0) {
+                return cmd_execute_top_squares(cmd, bmp, out);
+            }
+            return cmd_execute_shape_search(cmd, bmp, SHAPE_SQUARE, out, diag);
+        case DENSITY:
+            return cmd_execute_density(cmd, bmp, out);
+        case SEGMENT:
+            return cmd_execute_segment(cmd, bmp, out);
+        case DIAMOND:
+            return cmd_execute_diamond(bmp, out);
+        default:
+            break;
+    }
+    return error_ctor(ERR_INTERNAL, "Invalid control path executed on line: %d",
+                      __LINE__);
+}
+
+/**
+ * @brief loads the bitmap and executes the bitmap query on it
+ * @return ERR_INVALID_BITMAP_FILE with message "Invalid" when "test" command
+ * was given an invalid bitmap file */
+static Error cmd_execute_bitmap_command(const UserCommand *cmd) {
+    Bitmap bmp = {0};
+    /* tiny bitmaps skip the loader, most of their time is the startup */
+    char        tiny[BMP_TINY_MAX_SIZE + 1];
+    BitmapCache tiny_cache;
+    if (bmp_tiny_load(cmd->file_name, tiny, &tiny_cache, &bmp)) {
+        mem_phase_enter(MEM_PHASE_SEARCH);
+        Error err = cmd_execute_query(cmd, &bmp, stdout, stderr);
+        bmp_cache_dtor(&tiny_cache);
+        return err;
+    }
+    mem_phase_enter(MEM_PHASE_LOAD);
+    Error err = cmd_load_bitmap(cmd, &bmp);
+    mem_phase_enter(MEM_PHASE_SEARCH);
+    if (err.code != ERR_NONE) {
+        if (cmd->action_type == TEST) {
+            error_dtor(&err);
+            return error_ctor(ERR_INVALID_BITMAP_FILE, "%s", "Invalid");
+        }
+        return err;
+    }
+    err = cmd_execute_query(cmd, &bmp, stdout, stderr);
+    /* cleanup and return */
+    bmp_dtor(&bmp);
+    return err;
+}
+
+/**
+ * @brief executes shape search of the command as a job cancelled once
+ * `timeout` milliseconds pass without its descriptor becoming readable
+ * @note engines which do not check the cancellation finish the search, its
+ * result is dropped then
+ * @return ERR_CANCELLED when the search timed out */
+static Error cmd_execute_timed_search(const UserCommand *cmd) {
+    const ShapeKind kind = cmd->action_type == HLINE   ? SHAPE_HLINE
+                           : cmd->action_type == VLINE ? SHAPE_VLINE
+                                                       : SHAPE_SQUARE;
+    JobPool *pool;
+    Job     *job;
+    ErrorNum code = job_create(cmd->file_name, kind, &job);
+    if (code != ERR_NONE) {
+        return error_ctor(code, "Failed to create job! Os error: %s\n",
+                          strerror(errno));
+    }
+    job->threshold = cmd->options.threshold;
+    job->engine = cmd->options.engine;
+    if (job_pool_create(1, &pool) != ERR_NONE) {
+        job_destroy(job);
+        return error_ctor(ERR_INTERNAL, "Failed to start job workers!\n");
+    }
+    job_submit(pool, job);
+    struct pollfd ready = {.fd = job_fd(job), .events = POLLIN};
+    int           polled;
+    do {
+        polled = poll(&ready, 1,
+                      cmd->options.timeout > INT_MAX
+                          ? INT_MAX
+                          : (int)cmd->options.timeout);
+    } while (polled < 0 && errno == EINTR);
+    if (polled == 0) {
+        job_cancel(job);
+    }
+    job_wait(pool, job);
+    job_pool_destroy(pool);
+    const ShapeGeometry shape = job->shape;
+    const SearchStats   stats = job->stats;
+    Error               err = job->err;
+    job->err = error_none();
+    job_destroy(job);
+    if (polled == 0 || err.code == ERR_CANCELLED) {
+        error_dtor(&err);
+        return error_ctor(ERR_CANCELLED,
+                          "Search timed out after %" PRIu32 " ms!",
+                          cmd->options.timeout);
+    }
+    if (err.code != ERR_NONE) {
+        return err;
+    }
+    if (cmd->options.stats) {
+        cmd_print_search_stats(stderr, &stats);
+    }
+    if (shape_geometry_is_invalid(shape)) {
+        printf("Not found\n");
+    } else {
+        shape_geometry_print(shape);
+    }
+    return error_none();
+}
+
+/**
+ * @brief checks whether `argv[*index]` is option `name` taking a value, the
+ * value may be given either as "--name=value" or as "--name value"
+ * @note on match `*index` is moved past the consumed arguments
+ * @return true when matched, `out_value` is NULL when the value is missing */
+static bool cmd_match_option(int argc, char **argv, int *index,
+                             const char *name, const char **out_value) {
+    const char  *arg = argv[*index];
+    const size_t name_length = strlen(name);
+    if (strncmp(arg, name, name_length) != 0) {
+        return false;
+    }
+    if (arg[name_length] == '=') {
+        *out_value = arg + name_length + 1;
+        return true;
+    }
+    if (arg[name_length] != '\0') {
+        return false;
+    }
+    *out_value = *index + 1 < argc ? argv[++(*index)] : NULL;
+    return true;
+}
+
+/**
+ * @brief parses unsigned 32-bit option value
+ * @return ERR_INVALID_COMMAND when `value` is not a valid number */
+static Error cmd_parse_u32(const char *name, const char *value,
+                           uint32_t *out_value) {
+    if (value == NULL) {
+        return error_ctor(ERR_INVALID_COMMAND,
+                          "Option [%s] requires a value!", name);
+    }
+    char *end = NULL;
+    errno = 0;
+    unsigned long long parsed = strtoull(value, &end, 10);
+    if (!isdigit((unsigned char)*value) || *end != '\0' || errno != 0 ||
+        parsed > UINT32_MAX) {
+        return error_ctor(ERR_INVALID_COMMAND,
+                          "Option [%s] expects a non-negative number, but "
+                          "given: [%s]",
+                          name, value);
+    }
+    *out_value = (uint32_t)parsed;
+    return error_none();
+}
+
+/**
+ * @brief parses the options and the bitmap location following the command
+ * @return error with appropriate message on unknown option or missing file */
+static Error cmd_parse_options(int argc, char **argv, UserCommand *out_cmd) {
+    out_cmd->file_name = NULL;
+    out_cmd->options = (UserCommandOptions){
+        .threshold = BMP_LOADER_THRESHOLD_DEFAULT,
+        .engine = &SHAPE_ENGINES[0],
+        .all_engines = false,
+        .compare = false,
+        .stats = false,
+        .ties = false,
+        .queries_file = NULL,
+        .memory_cap = 0,
+        .angles = SEGMENT_ANGLES_DEFAULT,
+        .top = 0,
+        .disjoint = false,
+        .at_least = 0,
+        .thickness = 1,
+        .timeout = 0,
+        .index_file = NULL,
+        .index_min = {BMP_BOUND_UNKNOWN, BMP_BOUND_UNKNOWN, BMP_BOUND_UNKNOWN},
+        .index_any = false,
+    };
+    for (int i = 2; i < argc; i++) {
+        const char *value = NULL;
+        if (strncmp(argv[i], "--", 2) != 0) {
+            /* the only positional argument is the bitmap location, except
+             * for the index location following the directory to index */
+            if (out_cmd->file_name != NULL &&
+                out_cmd->action_type == INDEX_BUILD &&
+                out_cmd->options.index_file == NULL) {
+                out_cmd->options.index_file = argv[i];
+                continue;
+            }
+            if (out_cmd->file_name != NULL) {
+                return error_ctor(ERR_INVALID_COMMAND,
+                                  "Unexpected argument [%s]! Bitmap location "
+                                  "was already given: [%s].",
+                                  argv[i], out_cmd->file_name);
+            }
+            out_cmd->file_name = argv[i];
+            continue;
+        }
+        if (cmd_match_option(argc, argv, &i, "--threshold", &value)) {
+            Error err = cmd_parse_u32("--threshold", value,
+                                      &out_cmd->options.threshold);
+            if (err.code != ERR_NONE) {
+                return err;
+            }
+            continue;
+        }
+        if (cmd_match_option(argc, argv, &i, "--engine", &value)) {
+            if (value != NULL && strcmp(value, "all") == 0) {
+                out_cmd->options.all_engines = true;
+                continue;
+            }
+            out_cmd->options.engine =
+                value != NULL ? shape_engine_find(value) : NULL;
+            if (out_cmd->options.engine == NULL) {
+                return error_ctor(ERR_INVALID_COMMAND,
+                                  "Unknown engine given [%s]!",
+                                  value != NULL ? value : "");
+            }
+            continue;
+        }
+        if (cmd_match_option(argc, argv, &i, "--queries", &value)) {
+            if (value == NULL) {
+                return error_ctor(ERR_INVALID_COMMAND,
+                                  "Option [--queries] requires a value!");
+            }
+            out_cmd->options.queries_file = value;
+            continue;
+        }
+        if (cmd_match_option(argc, argv, &i, "--angles", &value)) {
+            Error err =
+                cmd_parse_u32("--angles", value, &out_cmd->options.angles);
+            if (err.code != ERR_NONE) {
+                return err;
+            }
+            if (out_cmd->options.angles == 0) {
+                return error_ctor(ERR_INVALID_COMMAND,
+                                  "Option [--angles] expects at least one "
+                                  "direction!");
+            }
+            continue;
+        }
+        if (cmd_match_option(argc, argv, &i, "--top", &value)) {
+            Error err = cmd_parse_u32("--top", value, &out_cmd->options.top);
+            if (err.code != ERR_NONE) {
+                return err;
+            }
+            if (out_cmd->options.top == 0) {
+                return error_ctor(ERR_INVALID_COMMAND,
+                                  "Option [--top] expects at least one "
+                                  "square!");
+            }
+            continue;
+        }
+        if (cmd_match_option(argc, argv, &i, "--at-least", &value)) {
+            Error err = cmd_parse_u32("--at-least", value,
+                                      &out_cmd->options.at_least);
+            if (err.code != ERR_NONE) {
+                return err;
+            }
+            if (out_cmd->options.at_least == 0) {
+                return error_ctor(ERR_INVALID_COMMAND,
+                                  "Option [--at-least] expects a positive "
+                                  "size!");
+            }
+            continue;
+        }
+        if (cmd_match_option(argc, argv, &i, "--thickness", &value)) {
+            Error err = cmd_parse_u32("--thickness", value,
+                                      &out_cmd->options.thickness);
+            if (err.code != ERR_NONE) {
+                return err;
+            }
+            if (out_cmd->options.thickness == 0) {
+                return error_ctor(ERR_INVALID_COMMAND,
+                                  "Option [--thickness] expects a positive "
+                                  "thickness!");
+            }
+            continue;
+        }
+        if (cmd_match_option(argc, argv, &i, "--timeout", &value)) {
+            Error err = cmd_parse_u32("--timeout", value,
+                                      &out_cmd->options.timeout);
+            if (err.code != ERR_NONE) {
+                return err;
+            }
+            continue;
+        }
+        if (cmd_match_option(argc, argv, &i, "--memory-cap", &value)) {
+            Error err = cmd_parse_u32("--memory-cap", value,
+                                      &out_cmd->options.memory_cap);
+            if (err.code != ERR_NONE) {
+                return err;
+            }
+            continue;
+        }
+        if (cmd_match_option(argc, argv, &i, "--hline", &value)) {
+            Error err = cmd_parse_u32("--hline", value,
+                                      &out_cmd->options.index_min.hline);
+            if (err.code != ERR_NONE) {
+                return err;
+            }
+            continue;
+        }
+        if (cmd_match_option(argc, argv, &i, "--vline", &value)) {
+            Error err = cmd_parse_u32("--vline", value,
+                                      &out_cmd->options.index_min.vline);
+            if (err.code != ERR_NONE) {
+                return err;
+            }
+            continue;
+        }
+        if (cmd_match_option(argc, argv, &i, "--square", &value)) {
+            Error err = cmd_parse_u32("--square", value,
+                                      &out_cmd->options.index_min.square);
+            if (err.code != ERR_NONE) {
+                return err;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "--any") == 0) {
+            out_cmd->options.index_any = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--stats") == 0) {
+            out_cmd->options.stats = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--ties") == 0) {
+            out_cmd->options.ties = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--disjoint") == 0) {
+            out_cmd->options.disjoint = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--compare") == 0) {
+            out_cmd->options.compare = true;
+            continue;
+        }
+        return error_ctor(ERR_INVALID_COMMAND,
+                          "Invalid option given [%s]!\nFor more info refer to "
+                          "the help info:\n%s",
+                          argv[i], HELP_MESSAGE);
+    }
+    if (out_cmd->file_name == NULL) {
+        return error_ctor(ERR_INVALID_NUMBER_ARGS,
+                          "Missing bitmap location for command [%s]!",
+                          argv[1]);
+    }
+    if (out_cmd->action_type == INDEX_BUILD &&
+        out_cmd->options.index_file == NULL) {
+        return error_ctor(ERR_INVALID_NUMBER_ARGS,
+                          "Missing index location for command [index "
+                          "build]!");
+    }
+    const BitmapBounds *index_min = &out_cmd->options.index_min;
+    if (out_cmd->action_type != INDEX_QUERY &&
+        (index_min->hline != BMP_BOUND_UNKNOWN ||
+         index_min->vline != BMP_BOUND_UNKNOWN ||
+         index_min->square != BMP_BOUND_UNKNOWN ||
+         out_cmd->options.index_any)) {
+        return error_ctor(ERR_INVALID_COMMAND,
+                          "Options [--hline], [--vline], [--square] and "
+                          "[--any] are supported only by command [index "
+                          "query]!");
+    }
+    if (out_cmd->action_type == DENSITY &&
+        out_cmd->options.queries_file == NULL) {
+        return error_ctor(ERR_INVALID_NUMBER_ARGS,
+                          "Missing --queries file for command [%s]!", argv[1]);
+    }
+    if ((out_cmd->options.top > 0 || out_cmd->options.disjoint) &&
+        (out_cmd->action_type != SQUARE || out_cmd->options.top == 0 ||
+         out_cmd->options.ties)) {
+        return error_ctor(ERR_INVALID_COMMAND,
+                          "Options [--top] and [--disjoint] are supported "
+                          "only by command [square], [--disjoint] requires "
+                          "[--top] and neither goes with [--ties]!");
+    }
+    if (out_cmd->options.at_least > 0 &&
+        ((out_cmd->action_type != HLINE && out_cmd->action_type != VLINE &&
+          out_cmd->action_type != SQUARE) ||
+         out_cmd->options.ties || out_cmd->options.top > 0)) {
+        return error_ctor(ERR_INVALID_COMMAND,
+                          "Option [--at-least] is supported only by commands "
+                          "[hline], [vline] and [square] and goes with "
+                          "neither [--ties] nor [--top]!");
+    }
+    if ((out_cmd->options.all_engines || out_cmd->options.compare) &&
+        (!out_cmd->options.all_engines || !out_cmd->options.compare ||
+         (out_cmd->action_type != HLINE && out_cmd->action_type != VLINE &&
+          out_cmd->action_type != SQUARE) ||
+         out_cmd->options.ties || out_cmd->options.top > 0 ||
+         out_cmd->options.at_least > 0 || out_cmd->options.thickness > 1)) {
+        return error_ctor(ERR_INVALID_COMMAND,
+                          "Options [--engine=all] and [--compare] go "
+                          "together, are supported only by commands "
+                          "[hline], [vline] and [square] and go with none of "
+                          "[--ties], [--top], [--at-least] and "
+                          "[--thickness]!");
+    }
+    if (out_cmd->options.timeout > 0 &&
+        ((out_cmd->action_type != HLINE && out_cmd->action_type != VLINE &&
+          out_cmd->action_type != SQUARE) ||
+         out_cmd->options.ties || out_cmd->options.top > 0 ||
+         out_cmd->options.at_least > 0 || out_cmd->options.thickness > 1 ||
+         out_cmd->options.compare)) {
+        return error_ctor(ERR_INVALID_COMMAND,
+                          "Option [--timeout] is supported only by commands "
+                          "[hline], [vline] and [square] and goes with none "
+                          "of [--ties], [--top], [--at-least], [--thickness] "
+                          "and [--compare]!");
+    }
+    if (out_cmd->options.thickness > 1 &&
+        ((out_cmd->action_type != HLINE && out_cmd->action_type != VLINE) ||
+         out_cmd->options.ties)) {
+        return error_ctor(ERR_INVALID_COMMAND,
+                          "Option [--thickness] is supported only by commands "
+                          "[hline] and [vline] and does not go with "
+                          "[--ties]!");
+    }
+    if (out_cmd->options.ties) {
+        if (out_cmd->action_type != HLINE && out_cmd->action_type != VLINE &&
+            out_cmd->action_type != SQUARE) {
+            return error_ctor(ERR_INVALID_COMMAND,
+                              "Option [--ties] is not supported by command "
+                              "[%s]!",
+                              argv[1]);
+        }
+        if (!out_cmd->options.engine->ties) {
+            return error_ctor(ERR_INVALID_COMMAND,
+                              "Engine [%s] does not support [--ties]!",
+                              out_cmd->options.engine->name);
+        }
+    }
+    return error_none();
+}
+
+/**
+ * @brief parses command input and validates it
+ * @return error with appropriate message if `out_cmd` param could not be
+ * populated because of invalid input data */
+static Error cmd_parse(int argc, char **argv, UserCommand *out_cmd) {
+    /* ensure that the command is of correct size */
+    if (argc < CMD_MIN_ARGS) {
+        return error_ctor(ERR_INVALID_NUMBER_ARGS,
+                          "Invalid number of arguments given! Expected at "
+                          "least 1 but given: %d.\nFor more info refer to "
+                          "the help info:\n%s",
+                          argc - 1, HELP_MESSAGE);
+    }
+
+    /* validate command args */
+    if (argc == CMD_MIN_ARGS) /* HELP command only */ {
+        if (strcmp(argv[1], "--help") == 0) {
+            out_cmd->action_type = HELP;
+            return error_none();
+        }
+        return error_ctor(ERR_INVALID_COMMAND,
+                          "Invalid command given [%s]! Expected: --help. Did "
+                          "you forget to add bitmap file name?",
+                          argv[1]);
+    }
+
+    /*
+     * convenient macro for command type check (cmd_parse
+     * function-only)
+     */
+#define register_command(cmd_input, cmd_name, reg_type)    \
+    do {                                                   \
+        if (strcmp((cmd_input), (cmd_name)) == 0) {        \
+            out_cmd->action_type = (reg_type);             \
+            return cmd_parse_options(argc, argv, out_cmd); \
+        }                                                  \
+    } while (0);
+
+    register_command(argv[1], "test", TEST);
+    register_command(argv[1], "hline", HLINE);
+    register_command(argv[1], "vline", VLINE);
+    register_command(argv[1], "square", SQUARE);
+    register_command(argv[1], "density", DENSITY);
+    register_command(argv[1], "segment", SEGMENT);
+    register_command(argv[1], "diamond", DIAMOND);
+    register_command(argv[1], "run", RUN);
+
+#undef register_command
+
+    /* index commands name their operation first, options follow it */
+    if (strcmp(argv[1], "index") == 0) {
+        if (strcmp(argv[2], "build") == 0 || strcmp(argv[2], "query") == 0) {
+            out_cmd->action_type =
+                strcmp(argv[2], "build") == 0 ? INDEX_BUILD : INDEX_QUERY;
+            return cmd_parse_options(argc - 1, argv + 1, out_cmd);
+        }
+        return error_ctor(ERR_INVALID_COMMAND,
+                          "Invalid index operation given [%s]! Expected one "
+                          "of: build, query.",
+                          argv[2]);
+    }
+
+    return error_ctor(ERR_INVALID_COMMAND,
+                      "Invalid command given [%s]! Expected one of: --help, "
+                      "test, hline, vline, sqaure, density, segment, "
+                      "diamond, run, index.",
+                      argv[1]);
+}
+
+/* =========================================
+ *                   Plan
+ * ========================================= */
+
+/** @brief maximal number of whitespace separated tokens of a plan line */
+#define PLAN_MAX_TOKENS (64)
+/** @brief number of bytes in MiB (--memory-cap unit) */
+#define PLAN_MIB (1024ULL * 1024ULL)
+
+/** @brief single (file, command, options) line of a plan */
+typedef struct PlanQuery {
+    UserCommand cmd;
+    /** @brief line number in the plan file */
+    size_t line;
+    /** @brief owned copy of the plan line, `cmd` points into it */
+    char *text;
+    /** @brief captured standard output/diagnostics of the query */
+    char  *out;
+    size_t out_size;
+    char  *diag;
+    size_t diag_size;
+    /** @brief error code of the query (ERR_NONE on success) */
+    ErrorNum code;
+} PlanQuery;
+
+/** @brief queries of a plan grouped by the bitmap they load */
+typedef struct Plan {
+    PlanQuery *queries;
+    size_t     count;
+    /** @brief queries sorted by bitmap, original order kept inside a group */
+    PlanQuery **order;
+    /** @brief first item of each group in `order` (group_count + 1 items) */
+    size_t *groups;
+    size_t  group_count;
+    /** @brief next group to be picked up by a worker */
+    size_t next_group;
+    /** @brief bytes of bitmaps and their derived structures allowed to be
+     * held at once (0 = no cap) @see plan_charge */
+    uint64_t        memory_cap;
+    uint64_t        memory_used;
+    pthread_mutex_t lock;
+    pthread_cond_t  memory_released;
+} Plan;
+
+/** @brief destroys plan's allocated memory */
+static void plan_dtor(Plan *plan) {
+    for (size_t i = 0; i < plan->count; i++) {
+        free(plan->queries[i].text);
+        free(plan->queries[i].out);
+        free(plan->queries[i].diag);
+    }
+    mem_free(plan->queries);
+    mem_free(plan->order);
+    mem_free(plan->groups);
+    plan->queries = NULL;
+    plan->order = NULL;
+    plan->groups = NULL;
+    plan->count = 0;
+}
+
+/**
+ * @brief parses single plan line "bitmap command [options]" into `out_query`
+ * @note the line is split in place, `out_query` takes its ownership
+ * @return error when the line is not a valid bitmap query */
+static Error plan_parse_query(char *text, size_t line, PlanQuery *out_query) {
+    char  *tokens[PLAN_MAX_TOKENS];
+    size_t count = 0;
+    for (char *c = text; *c != '\0';) {
+        while (*c != '\0' && isspace((unsigned char)*c)) {
+            *c++ = '\0';
+        }
+        if (*c == '\0') {
+            break;
+        }
+        if (count == PLAN_MAX_TOKENS) {
+            return error_ctor(ERR_INVALID_COMMAND,
+                              "Plan line %zu has too many arguments!", line);
+        }
+        tokens[count++] = c;
+        while (*c != '\0' && !isspace((unsigned char)*c)) {
+            c++;
+        }
+    }
+    if (count < 2) {
+        return error_ctor(ERR_INVALID_COMMAND,
+                          "Plan line %zu: expected \"bitmap command "
+                          "[options]\"!",
+                          line);
+    }
+    /* reorder into regular command line: command [options] bitmap */
+    char *argv[PLAN_MAX_TOKENS + 1] = {"figsearch", tokens[1]};
+    int   argc = 2;
+    for (size_t i = 2; i < count; i++) {
+        argv[argc++] = tokens[i];
+    }
+    argv[argc++] = tokens[0];
+    *out_query = (PlanQuery){.line = line, .text = text, .code = ERR_NONE};
+    Error err = cmd_parse(argc, argv, &out_query->cmd);
+    if (err.code != ERR_NONE) {
+        Error line_err = error_ctor(err.code, "Plan line %zu: %s", line,
+                                    err.msg != NULL ? err.msg : "");
+        error_dtor(&err);
+        return line_err;
+    }
+    if (out_query->cmd.action_type == HELP ||
+        out_query->cmd.action_type == RUN ||
+        out_query->cmd.action_type == INDEX_BUILD ||
+        out_query->cmd.action_type == INDEX_QUERY) {
+        return error_ctor(ERR_INVALID_COMMAND,
+                          "Plan line %zu: only bitmap queries can be "
+                          "planned!",
+                          line);
+    }
+    /* queries of a bitmap share its worker, so none of them can be given up
+     * on its own */
+    if (out_query->cmd.options.timeout > 0) {
+        return error_ctor(ERR_INVALID_COMMAND,
+                          "Plan line %zu: option [--timeout] cannot be "
+                          "planned!",
+                          line);
+    }
+    return error_none();
+}
+
+/** @brief orders queries by bitmap (file and threshold), then by plan line */
+static int plan_query_cmp(const void *lhs, const void *rhs) {
+    const PlanQuery *a = *(PlanQuery *const *)lhs;
+    const PlanQuery *b = *(PlanQuery *const *)rhs;
+    int file = strcmp(a->cmd.file_name, b->cmd.file_name);
+    if (file != 0) {
+        return file;
+    }
+    if (a->cmd.options.threshold != b->cmd.options.threshold) {
+        return a->cmd.options.threshold < b->cmd.options.threshold ? -1 : 1;
+    }
+    return (a > b) - (a < b);
+}
+
+/**
+ * @brief reads plan file and groups its queries by the bitmap they load
+ * @return error when plan cannot be read or contains an invalid line */
+static Error plan_ctor(const char *file_name, Plan *out_plan) {
+    *out_plan = (Plan){0};
+    FILE *file = fopen(file_name, "r");
+    if (file == NULL) {
+        return error_ctor(ERR_INVALID_COMMAND,
+                          "Failed to open file [%s]! Os error: %s\n",
+                          file_name, strerror(errno));
+    }
+    Error  err = error_none();
+    size_t capacity = 0;
+    char  *text = NULL;
+    size_t text_size = 0;
+    for (size_t line = 1; getline(&text, &text_size, file) != -1; line++) {
+        /* skip blank lines and comments */
+        const char *first = text;
+        while (isspace((unsigned char)*first)) {
+            first++;
+        }
+        if (*first == '\0' || *first == '#') {
+            continue;
+        }
+        if (out_plan->count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            PlanQuery *queries =
+                mem_realloc(out_plan->queries, sizeof(PlanQuery) * capacity);
+            if (queries == NULL) {
+                err = error_ctor(ERR_ALLOCATION_FAILURE,
+                                 "Failed to allocate plan queries!\n");
+                break;
+            }
+            out_plan->queries = queries;
+        }
+        PlanQuery *query = &out_plan->queries[out_plan->count];
+        err = plan_parse_query(text, line, query);
+        if (err.code != ERR_NONE) {
+            break;
+        }
+        /* the query took ownership of the line */
+        out_plan->count++;
+        text = NULL;
+        text_size = 0;
+    }
+    free(text);
+    fclose(file);
+    if (err.code != ERR_NONE) {
+        plan_dtor(out_plan);
+        return err;
+    }
+
+    /* group queries by bitmap */
+    out_plan->order = mem_malloc(sizeof(PlanQuery *) * (out_plan->count + 1));
+    out_plan->groups = mem_malloc(sizeof(size_t) * (out_plan->count + 1));
+    if (out_plan->order == NULL || out_plan->groups == NULL) {
+        plan_dtor(out_plan);
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate plan groups!\n");
+    }
+    for (size_t i = 0; i < out_plan->count; i++) {
+        out_plan->order[i] = &out_plan->queries[i];
+    }
+    qsort(out_plan->order, out_plan->count, sizeof(PlanQuery *),
+          plan_query_cmp);
+    for (size_t i = 0; i < out_plan->count; i++) {
+        if (i == 0 ||
+            strcmp(out_plan->order[i]->cmd.file_name,
+                   out_plan->order[i - 1]->cmd.file_name) != 0 ||
+            out_plan->order[i]->cmd.options.threshold !=
+                out_plan->order[i - 1]->cmd.options.threshold) {
+            out_plan->groups[out_plan->group_count++] = i;
+        }
+    }
+    out_plan->groups[out_plan->group_count] = out_plan->count;
+    return error_none();
+}
+
+/**
+ * @brief estimates bytes of the bitmap `cmd` loads from the dimensions in its
+ * header (of the operands of an expression, of the manifest of a mosaic),
+ * pixels are not read
+ * @return 0 when the header cannot be read, the load reports the error */
+static uint64_t plan_estimate_bitmap(const UserCommand *cmd) {
+    BitmapSize size = {0};
+    Error      err = error_none();
+    if (bmp_expr_is_expression(cmd->file_name)) {
+        BitmapExpr *expr = NULL;
+        const char *end = cmd->file_name;
+        bool        size_known = false;
+        err = bmp_expr_parse(&end, cmd->options.threshold, 0, &expr);
+        if (err.code == ERR_NONE) {
+            err = bmp_expr_prepare(expr, &size, &size_known);
+        }
+        bmp_expr_dtor(expr);
+        error_dtor(&err);
+        return bmp_size_raw(size) * sizeof(Pixel);
+    }
+    FILE *file = fopen(cmd->file_name, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    int magic[2] = {fgetc(file), fgetc(file)};
+    if (magic[0] == PGM_MAGIC &&
+        (magic[1] == PGM_MAGIC_ASCII || magic[1] == PGM_MAGIC_BINARY)) {
+        uint32_t max_value = 0, threshold = cmd->options.threshold;
+        err = bmp_loader_pgm_load_header(file, &size, &max_value, &threshold);
+    } else if (magic[0] == MOSAIC_MAGIC[0] && magic[1] == MOSAIC_MAGIC[1]) {
+        Mosaic mosaic;
+        rewind(file);
+        err = mosaic_parse(file, cmd->file_name, &mosaic);
+        size = mosaic.dimensions;
+        mosaic_dtor(&mosaic);
+    } else {
+        rewind(file);
+        err = bmp_loader_load_size(file, &size);
+    }
+    fclose(file);
+    if (error_dtor(&err) != ERR_NONE) {
+        return 0;
+    }
+    return bmp_size_raw(size) * sizeof(Pixel);
+}
+
+/**
+ * @brief charges the group the bytes its thread holds since `base` (the
+ * bitmap and the structures derived from it) instead of `*charged`, the
+ * waiting groups are woken when the charge drops */
+static void plan_charge(Plan *plan, int64_t base, uint64_t *charged) {
+    const int64_t  net = mem_thread_net - base;
+    const uint64_t bytes = net > 0 ? (uint64_t)net : 0;
+    pthread_mutex_lock(&plan->lock);
+    plan->memory_used = plan->memory_used - *charged + bytes;
+    if (bytes < *charged) {
+        pthread_cond_broadcast(&plan->memory_released);
+    }
+    pthread_mutex_unlock(&plan->lock);
+    *charged = bytes;
+}
+
+/** @brief executes single query of a group, captures its output */
+static void plan_execute_query(PlanQuery *query, const Bitmap *bmp,
+                               const Error *load_err) {
+    FILE *out = open_memstream(&query->out, &query->out_size);
+    FILE *diag = open_memstream(&query->diag, &query->diag_size);
+    if (out == NULL || diag == NULL) {
+        if (out != NULL) {
+            fclose(out);
+        }
+        if (diag != NULL) {
+            fclose(diag);
+        }
+        query->code = ERR_ALLOCATION_FAILURE;
+        return;
+    }
+    Error err = error_none();
+    if (load_err->code == ERR_NONE) {
+        err = cmd_execute_query(&query->cmd, bmp, out, diag);
+    } else if (query->cmd.action_type == TEST) {
+        err = error_ctor(ERR_INVALID_BITMAP_FILE, "%s", "Invalid");
+    } else {
+        err = error_ctor(load_err->code, "%s",
+                         load_err->msg != NULL ? load_err->msg : "");
+    }
+    if (err.code != ERR_NONE) {
+        /* loader messages end with a newline of their own */
+        const char *msg = err.msg != NULL ? err.msg : "";
+        int         length = (int)strlen(msg);
+        while (length > 0 && msg[length - 1] == '\n') {
+            length--;
+        }
+        fprintf(diag, "Plan line %zu: %.*s\n", query->line, length, msg);
+        query->code = error_dtor(&err);
+    }
+    fclose(out);
+    fclose(diag);
+}
+
+/**
+ * @brief loads the bitmap of `group` once, executes all of its queries and
+ * evicts the bitmap, waits while the memory cap would be exceeded
+ * @note the group is charged the estimated size of its bitmap until it is
+ * loaded, then the bytes it really holds (bitmap and derived structures)
+ * after the load and after every query */
+static void plan_execute_group(Plan *plan, size_t group) {
+    PlanQuery **queries = &plan->order[plan->groups[group]];
+    const size_t count = plan->groups[group + 1] - plan->groups[group];
+    uint64_t     charged = plan_estimate_bitmap(&queries[0]->cmd);
+    pthread_mutex_lock(&plan->lock);
+    while (plan->memory_cap != 0 && plan->memory_used != 0 &&
+           plan->memory_used + charged > plan->memory_cap) {
+        pthread_cond_wait(&plan->memory_released, &plan->lock);
+    }
+    plan->memory_used += charged;
+    pthread_mutex_unlock(&plan->lock);
+
+    const int64_t base = mem_thread_net;
+    Bitmap        bmp = {0};
+    mem_phase_enter(MEM_PHASE_LOAD);
+    Error load_err = cmd_load_bitmap(&queries[0]->cmd, &bmp);
+    mem_phase_enter(MEM_PHASE_SEARCH);
+    plan_charge(plan, base, &charged);
+    for (size_t i = 0; i < count; i++) {
+        plan_execute_query(queries[i], &bmp, &load_err);
+        plan_charge(plan, base, &charged);
+    }
+    error_dtor(&load_err);
+    bmp_dtor(&bmp);
+
+    pthread_mutex_lock(&plan->lock);
+    plan->memory_used -= charged;
+    pthread_cond_broadcast(&plan->memory_released);
+    pthread_mutex_unlock(&plan->lock);
+}
+
+/** @brief picks up groups one by one until there is none left */
+static void plan_worker(void *arg, uint32_t begin, uint32_t end) {
+    (void)begin;
+    (void)end;
+    Plan *plan = arg;
+    for (;;) {
+        pthread_mutex_lock(&plan->lock);
+        const size_t group = plan->next_group;
+        if (group < plan->group_count) {
+            plan->next_group++;
+        }
+        pthread_mutex_unlock(&plan->lock);
+        if (group == plan->group_count) {
+            return;
+        }
+        plan_execute_group(plan, group);
+    }
+}
+
+/**
+ * @brief executes "run" figsearch command: every bitmap of the plan is loaded
+ * once, bitmaps are processed in parallel and the results are printed in the
+ * plan order
+ * @return error when the plan is invalid or any of its queries failed */
+static Error plan_execute(const UserCommand *cmd) {
+    Plan  plan;
+    Error err = plan_ctor(cmd->file_name, &plan);
+    if (err.code != ERR_NONE) {
+        return err;
+    }
+    plan.memory_cap = (uint64_t)cmd->options.memory_cap * PLAN_MIB;
+    pthread_mutex_init(&plan.lock, NULL);
+    pthread_cond_init(&plan.memory_released, NULL);
+    uint32_t workers = parallel_thread_count();
+    if (workers > plan.group_count) {
+        workers = (uint32_t)plan.group_count;
+    }
+    parallel_for(workers, 1, plan_worker, &plan);
+    pthread_cond_destroy(&plan.memory_released);
+    pthread_mutex_destroy(&plan.lock);
+
+    /* print results in the original order */
+    size_t   failed = 0;
+    ErrorNum first_code = ERR_NONE;
+    for (size_t i = 0; i < plan.count; i++) {
+        const PlanQuery *query = &plan.queries[i];
+        if (query->out_size != 0) {
+            fwrite(query->out, 1, query->out_size, stdout);
+            fflush(stdout);
+        }
+        if (query->diag_size != 0) {
+            fwrite(query->diag, 1, query->diag_size, stderr);
+        }
+        if (query->code != ERR_NONE) {
+            first_code = failed++ == 0 ? query->code : first_code;
+        }
+    }
+    const size_t count = plan.count;
+    plan_dtor(&plan);
+    if (failed != 0) {
+        return error_ctor(first_code, "%zu out of %zu plan queries failed.",
+                          failed, count);
+    }
+    return error_none();
+}
+
+/* =========================================
+ *               Corpus Index
+ * ========================================= */
+
+/** @brief first word of an index file */
+#define CORPUS_INDEX_MAGIC ("figsearch-index")
+/** @brief version of the index file layout */
+#define CORPUS_INDEX_VERSION (1)
+/** @brief FNV-1a parameters of the content hash */
+#define CORPUS_HASH_OFFSET (0xCBF29CE484222325ULL)
+#define CORPUS_HASH_PRIME  (0x00000100000001B3ULL)
+
+/** @brief summary of a single bitmap of the indexed directory, stored as
+ * "hash mtime_sec mtime_nsec size height width filled hline vline square
+ * name" line of the index */
+typedef struct CorpusEntry {
+    /** @brief file name inside of the indexed directory */
+    char *name;
+    /** @brief modification time and file size the summary was taken at */
+    int64_t  mtime_sec;
+    int64_t  mtime_nsec;
+    uint64_t file_size;
+    /** @brief FNV-1a hash of the loaded pixels */
+    uint64_t   hash;
+    BitmapSize dimensions;
+    uint64_t   filled;
+    /** @brief exact longest hline/vline and largest square side */
+    BitmapBounds shapes;
+} CorpusEntry;
+
+/** @brief index file "figsearch-index VERSION THRESHOLD DIR" followed by an
+ * entry line per bitmap, ordered by name */
+typedef struct CorpusIndex {
+    char        *dir;
+    uint32_t     threshold;
+    CorpusEntry *entries;
+    size_t       count;
+} CorpusIndex;
 
-#define square_ctor(start, end)   shape_geometry_ctor(start, end)
-#define square_invalid_ctor()     shape_geometry_invalid_ctor()
-#define square_is_invalid(square) shape_geometry_is_invalid(square)
-#define square_print(square)      shape_geometry_print(square)
-#define square_cmp(lhs, rhs)      shape_geometry_cmp(lhs, rhs, square_side_length)
+/** @brief entry of the directory being indexed */
+typedef struct CorpusRefresh {
+    CorpusEntry entry;
+    /** @brief previous summary of the file (NULL for new files) */
+    const CorpusEntry *old;
+    Error              err;
+} CorpusRefresh;
 
-static inline uint32_t square_side_length(const Square s) {
-    return s.end.x - s.start.x + 1;
+/** @brief state shared by the workers refreshing stale entries */
+typedef struct CorpusBuild {
+    const UserCommand *cmd;
+    CorpusRefresh     *files;
+    /** @brief indices of `files` which have to be loaded */
+    size_t *stale;
+} CorpusBuild;
+
+static void corpus_index_dtor(CorpusIndex *index) {
+    for (size_t i = 0; i < index->count; i++) {
+        mem_free(index->entries[i].name);
+    }
+    mem_free(index->entries);
+    mem_free(index->dir);
+    *index = (CorpusIndex){0};
 }
-#define square_find_vertical_side(bmp, row, col) \
-    (line_find_vline((bmp), (Point){(col), (row)}))
-#define square_find_horizontal_side(bmp, row, col) \
-    (line_find_hline((bmp), (Point){(col), (row)}))
 
-/** @brief determines whether there exists valid square composed of `top_left`
- * and `bottom_right` corner */
-static inline bool square_found_valid_square(const Bitmap *bmp, Point top_left,
-                                             Point bottom_right) {
-    HLine hline = square_find_horizontal_side(bmp, bottom_right.y, top_left.x);
-    VLine vline = square_find_vertical_side(bmp, top_left.y, bottom_right.x);
+static int corpus_entry_cmp(const void *lhs, const void *rhs) {
+    return strcmp(((const CorpusEntry *)lhs)->name,
+                  ((const CorpusEntry *)rhs)->name);
+}
 
-    return hline.end.x >= bottom_right.x && vline.end.y >= bottom_right.y;
+/** @brief parses the next space terminated number of an index line
+ * @note hand-rolled, the query parses every line of the index */
+static bool corpus_parse_u64(char **text, int base, uint64_t *out_value) {
+    while (**text == ' ') {
+        (*text)++;
+    }
+    const char *c = *text;
+    uint64_t    value = 0;
+    for (;; c++) {
+        unsigned digit = 0;
+        if (*c >= '0' && *c <= '9') {
+            digit = (unsigned)(*c - '0');
+        } else if (base == 16 && *c >= 'a' && *c <= 'f') {
+            digit = (unsigned)(*c - 'a' + 10);
+        } else {
+            break;
+        }
+        if (value > (UINT64_MAX - digit) / (uint64_t)base) {
+            return false;
+        }
+        value = value * (uint64_t)base + digit;
+    }
+    if (c == *text || *c != ' ') {
+        return false;
+    }
+    *text = (char *)c + 1;
+    *out_value = value;
+    return true;
 }
 
-static inline void square_set_max_square(Square *max, uint32_t *max_length,
-                                         Square rhs) {
-    if (square_is_invalid(*max) || square_cmp(*max, rhs) < 0) {
-        *max = rhs;
-        *max_length = square_side_length(rhs);
+/**
+ * @brief parses entry line of an index, `out_entry->name` points into `text`
+ * @return false when the line is malformed */
+static bool corpus_entry_parse(char *text, CorpusEntry *out_entry) {
+    uint64_t fields[10];
+    for (size_t i = 0; i < sizeof(fields) / sizeof(*fields); i++) {
+        if (!corpus_parse_u64(&text, i == 0 ? 16 : 10, &fields[i])) {
+            return false;
+        }
+    }
+    for (size_t i = 4; i < 10; i++) {
+        if (i != 6 && fields[i] > UINT32_MAX) {
+            return false;
+        }
     }
+    text[strcspn(text, "\n")] = '\0';
+    if (*text == '\0') {
+        return false;
+    }
+    *out_entry = (CorpusEntry){
+        .name = text,
+        .hash = fields[0],
+        .mtime_sec = (int64_t)fields[1],
+        .mtime_nsec = (int64_t)fields[2],
+        .file_size = fields[3],
+        .dimensions = {.height = (uint32_t)fields[4],
+                       .width = (uint32_t)fields[5]},
+        .filled = fields[6],
+        .shapes = {(uint32_t)fields[7], (uint32_t)fields[8],
+                   (uint32_t)fields[9]},
+    };
+    return true;
 }
 
-/** @brief moves from `top_left` point horizontally and vertically, stops at the
- * the nearest end or nearest empty pixel
- * @note it is assumed that `top_left` is non-empty pixel
- * @return point of ended iteration (from `top_left`) */
-static Point square_move_along_orthogonals(const Bitmap *bmp,
-                                           const Point   top_left) {
-    uint32_t x_track = top_left.x, y_track = top_left.y;
-    /* move horizontally and vertically until hit end / empty pixel */
-    for (;;) {
-        if (x_track >= bmp->dimensions.width ||
-            bmp_at(bmp, top_left.y, x_track) == PXL_EMPTY) {
+/**
+ * @brief reads the header line of index `file` into `out_index`
+ * @return error when the file is not an index */
+static Error corpus_index_parse_header(FILE *file, const char *file_name,
+                                       char **line, size_t *line_size,
+                                       CorpusIndex *out_index) {
+    const size_t magic_length = strlen(CORPUS_INDEX_MAGIC);
+    char        *text = NULL;
+    uint64_t     version = 0, threshold = 0;
+    if (getline(line, line_size, file) != -1 &&
+        strncmp(*line, CORPUS_INDEX_MAGIC, magic_length) == 0) {
+        text = *line + magic_length;
+    }
+    if (text == NULL || *text++ != ' ' ||
+        !corpus_parse_u64(&text, 10, &version) ||
+        version != CORPUS_INDEX_VERSION ||
+        !corpus_parse_u64(&text, 10, &threshold) || threshold > UINT32_MAX) {
+        return error_ctor(ERR_INVALID_QUERY_FILE,
+                          "File [%s] is not a figsearch index (version %d)!",
+                          file_name, CORPUS_INDEX_VERSION);
+    }
+    text[strcspn(text, "\n")] = '\0';
+    out_index->dir = mem_malloc(strlen(text) + 1);
+    if (out_index->dir == NULL) {
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate index directory!\n");
+    }
+    strcpy(out_index->dir, text);
+    out_index->threshold = (uint32_t)threshold;
+    return error_none();
+}
+
+/**
+ * @brief loads all entries of index `file_name` into `out_index`, a missing
+ * file is loaded as an empty index
+ * @return error when the file exists but is not a valid index */
+static Error corpus_index_load(const char *file_name, CorpusIndex *out_index) {
+    *out_index = (CorpusIndex){0};
+    FILE *file = fopen(file_name, "r");
+    if (file == NULL) {
+        return errno == ENOENT
+                   ? error_none()
+                   : error_ctor(ERR_INVALID_QUERY_FILE,
+                                "Failed to open file [%s]! Os error: %s\n",
+                                file_name, strerror(errno));
+    }
+    char  *text = NULL;
+    size_t text_size = 0, capacity = 0;
+    Error  err = corpus_index_parse_header(file, file_name, &text, &text_size,
+                                           out_index);
+    for (size_t line = 2;
+         err.code == ERR_NONE && getline(&text, &text_size, file) != -1;
+         line++) {
+        CorpusEntry entry;
+        if (!corpus_entry_parse(text, &entry)) {
+            err = error_ctor(ERR_INVALID_QUERY_FILE,
+                             "Index line %zu is malformed!", line);
             break;
         }
-
-        if (y_track >= bmp->dimensions.height ||
-            bmp_at(bmp, y_track, top_left.x) == PXL_EMPTY) {
+        if (out_index->count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            CorpusEntry *entries =
+                mem_realloc(out_index->entries, sizeof(CorpusEntry) * capacity);
+            if (entries == NULL) {
+                err = error_ctor(ERR_ALLOCATION_FAILURE,
+                                 "Failed to allocate index entries!\n");
+                break;
+            }
+            out_index->entries = entries;
+        }
+        /* the name points into the line buffer which is reused */
+        const char *name = entry.name;
+        entry.name = mem_malloc(strlen(name) + 1);
+        if (entry.name == NULL) {
+            err = error_ctor(ERR_ALLOCATION_FAILURE,
+                             "Failed to allocate index entries!\n");
             break;
         }
+        strcpy(entry.name, name);
+        out_index->entries[out_index->count++] = entry;
+    }
+    free(text);
+    fclose(file);
+    if (err.code != ERR_NONE) {
+        corpus_index_dtor(out_index);
+        return err;
+    }
+    return error_none();
+}
 
-        x_track++;
-        y_track++;
+/** @brief joins `dir` and `name` into a newly allocated path */
+static char *corpus_path(const char *dir, const char *name) {
+    const size_t dir_length = strlen(dir);
+    const bool   slash = dir_length > 0 && dir[dir_length - 1] != '/';
+    char        *path = mem_malloc(dir_length + slash + strlen(name) + 1);
+    if (path != NULL) {
+        strcpy(path, dir);
+        if (slash) {
+            path[dir_length] = '/';
+        }
+        strcpy(path + dir_length + slash, name);
     }
-    return (Point){x_track - 1, y_track - 1};
+    return path;
 }
 
 /**
- * @brief scans for the largest square in a bitmap
- * @return invalid square if no square was found */
-static Square square_find_largest_square(const Bitmap *bmp) {
-    Square   max = square_invalid_ctor();
-    uint32_t max_length = 0;
-    for (uint32_t i = 0; i < bmp->dimensions.width * bmp->dimensions.height;
-         i++) {
-        /* for every pixel, check whether this pixel extends
-         * to orthogonal sides of a square (or itself in case of 1x1) */
-        uint32_t row = i / bmp->dimensions.width;
-        uint32_t col = i % bmp->dimensions.width;
-
-        /* only PXL_FILLED can be potential anchors of square */
-        if (bmp->data[i] == PXL_EMPTY) {
-            continue;
-        }
+ * @brief summarizes a single stale file: loads it and, unless its pixels
+ * hash to the previous summary, searches its shapes with `cmd`'s engine
+ * @return error when the file is not a valid bitmap */
+static Error corpus_refresh(const UserCommand *cmd, CorpusRefresh *file) {
+    CorpusEntry *entry = &file->entry;
+    char        *path = corpus_path(cmd->file_name, entry->name);
+    if (path == NULL) {
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate index path!\n");
+    }
+    BitmapLoader loader = bmp_loader_ctor(path);
+    loader.threshold = cmd->options.threshold;
+    mem_phase_enter(MEM_PHASE_LOAD);
+    Error err = bmp_loader_load(&loader);
+    mem_phase_enter(MEM_PHASE_SEARCH);
+    if (err.code != ERR_NONE) {
+        bmp_loader_dtor(&loader);
+        mem_free(path);
+        return err;
+    }
+    Bitmap       bmp = bmp_loader_get_bitmap(&loader);
+    const size_t size = bmp_size_raw(bmp.dimensions);
+    uint64_t     hash = CORPUS_HASH_OFFSET, filled = 0;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ (uint8_t)bmp.data[i]) * CORPUS_HASH_PRIME;
+        filled += bmp.data[i] == PXL_FILLED;
+    }
+    /* dimensions take part in the hash, the same pixels may be reshaped */
+    hash = (hash ^ bmp.dimensions.width) * CORPUS_HASH_PRIME;
+    entry->hash = hash;
+    entry->dimensions = bmp.dimensions;
+    entry->filled = filled;
+    if (file->old != NULL && file->old->hash == hash) {
+        entry->shapes = file->old->shapes;
+    } else {
+        SearchContext ctx = search_context_ctor();
+        shape_engine_search(cmd->options.engine, SHAPE_HLINE, &bmp, &ctx);
+        shape_engine_search(cmd->options.engine, SHAPE_VLINE, &bmp, &ctx);
+        shape_engine_search(cmd->options.engine, SHAPE_SQUARE, &bmp, &ctx);
+        err = ctx.err;
+        entry->shapes = bmp.cache->bounds;
+    }
+    bmp_dtor(&bmp);
+    mem_free(path);
+    return err;
+}
 
-        /* check if the remaining scan area is still larger than the largest
-         * square we have found */
-        uint32_t remaining_area =
-            (bmp->dimensions.height - row) * bmp->dimensions.width;
-        if (max_length * max_length >= remaining_area) {
-            return max;
-        }
+/** @brief parallel task refreshing stale files [begin, end) */
+static void corpus_refresh_worker(void *arg, uint32_t begin, uint32_t end) {
+    CorpusBuild *build = arg;
+    for (uint32_t i = begin; i < end; i++) {
+        CorpusRefresh *file = &build->files[build->stale[i]];
+        file->err = corpus_refresh(build->cmd, file);
+    }
+}
 
-        /* determine the expected bottom point and check for the square, if
-         * parallel sides were not found, check for each square "inside" the
-         * range of left_up to the expected_bottom_right point */
-        const Point top_left = {col, row};
-        Point       expected_bottom_right =
-            square_move_along_orthogonals(bmp, top_left);
+static void corpus_files_dtor(CorpusRefresh *files, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        mem_free(files[i].entry.name);
+        error_dtor(&files[i].err);
+    }
+    mem_free(files);
+}
 
-        /* if (potential) square side length is lower than the current, no
-         * reason to continue */
-        if (max_length > expected_bottom_right.x - col + 1) {
+/**
+ * @brief lists regular files of directory `dir` (hidden files and the index
+ * `skip` excluded) ordered by name, with their modification time and size
+ * @return error when the directory cannot be read */
+static Error corpus_scan(const char *dir, const struct stat *skip,
+                         CorpusRefresh **out_files, size_t *out_count) {
+    DIR *handle = opendir(dir);
+    if (handle == NULL) {
+        return error_ctor(ERR_INVALID_COMMAND,
+                          "Failed to open directory [%s]! Os error: %s\n", dir,
+                          strerror(errno));
+    }
+    CorpusRefresh *files = NULL;
+    size_t         count = 0, capacity = 0;
+    Error          err = error_none();
+    for (struct dirent *item = readdir(handle); item != NULL;
+         item = readdir(handle)) {
+        if (item->d_name[0] == '.' || strchr(item->d_name, '\n') != NULL) {
             continue;
         }
-
-        /* if (potential) square is indeed valid square set it to max (if
-         * larger) */
-        if (square_found_valid_square(bmp, top_left, expected_bottom_right)) {
-            square_set_max_square(&max, &max_length,
-                                  square_ctor(top_left, expected_bottom_right));
+        char *path = corpus_path(dir, item->d_name);
+        if (path == NULL) {
+            err = error_ctor(ERR_ALLOCATION_FAILURE,
+                             "Failed to allocate index path!\n");
+            break;
+        }
+        struct stat info;
+        const bool  regular = stat(path, &info) == 0 && S_ISREG(info.st_mode);
+        mem_free(path);
+        if (!regular || (skip != NULL && info.st_dev == skip->st_dev &&
+                         info.st_ino == skip->st_ino)) {
             continue;
         }
-
-        /* check each (potential) square inside the orthogonals */
-        for (; expected_bottom_right.x >= col;
-             expected_bottom_right.x--, expected_bottom_right.y--) {
-            if (square_found_valid_square(bmp, top_left,
-                                          expected_bottom_right)) {
-                square_set_max_square(
-                    &max, &max_length,
-                    square_ctor(top_left, expected_bottom_right));
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            CorpusRefresh *grown =
+                mem_realloc(files, sizeof(CorpusRefresh) * capacity);
+            if (grown == NULL) {
+                err = error_ctor(ERR_ALLOCATION_FAILURE,
+                                 "Failed to allocate index entries!\n");
                 break;
             }
+            files = grown;
         }
+        CorpusRefresh *file = &files[count];
+        *file = (CorpusRefresh){
+            .entry = {.mtime_sec = (int64_t)info.st_mtim.tv_sec,
+                      .mtime_nsec = (int64_t)info.st_mtim.tv_nsec,
+                      .file_size = (uint64_t)info.st_size},
+            .err = error_none(),
+        };
+        file->entry.name = mem_malloc(strlen(item->d_name) + 1);
+        if (file->entry.name == NULL) {
+            err = error_ctor(ERR_ALLOCATION_FAILURE,
+                             "Failed to allocate index entries!\n");
+            break;
+        }
+        strcpy(file->entry.name, item->d_name);
+        count++;
     }
-    return max;
+    closedir(handle);
+    if (err.code != ERR_NONE) {
+        corpus_files_dtor(files, count);
+        return err;
+    }
+    /* the entry is the first member, files sort as entries */
+    if (count > 0) {
+        qsort(files, count, sizeof(CorpusRefresh), corpus_entry_cmp);
+    }
+    *out_files = files;
+    *out_count = count;
+    return error_none();
 }
 
-/* =========================================
- *                 Command
- * ========================================= */
-
-/** @brief specifies the type of command the user can execute */
-typedef enum UserCommandAction {
-    HELP = 0,
-    TEST,
-    HLINE,
-    VLINE,
-    SQUARE
-} UserCommandAction;
-/** @brief struct containing command information passed by the user */
-typedef struct UserCommand {
-    UserCommandAction action_type;
-    /** @brief path to the bitmap file */
-    const char *file_name;
-} UserCommand;
-
-static const char *HELP_MESSAGE =
-    "Figsearch Algorithm\n"
-    "===================\n"
-    "A tool to analyze bitmap images for specific geometric patterns.\n\n"
-    "USAGE:\n"
-    "    figsearch [command] [bitmap location]\n\n"
-    "COMMANDS:\n"
-    "    --help       Displays this help message.\n"
-    "    test         Validates the specified bitmap file.\n"
-    "                 Requires: [bitmap location].\n"
-    "    hline        Finds the longest horizontal line in the bitmap.\n"
-    "                 Requires: [bitmap location].\n"
-    "    vline        Finds the longest vertical line in the bitmap.\n"
-    "                 Requires: [bitmap location].\n"
-    "    square       Detects the largest square in the bitmap.\n"
-    "                 Requires: [bitmap location].\n\n"
-    "NOTES:\n"
-    "    - All commands (except --help) require the [bitmap location] "
-    "argument.\n"
-    "    - hline, vline and square commands implicitly check the validity of "
-    "the file.\n"
-    "    - The bitmap location should be a valid path to a bitmap file.\n"
-    "    - Example usage: figsearch hline my_image.bmp\n";
-
 /**
- * @brief executes "--help" figsearch command by printing basic data about the
- * command options */
-static inline Error cmd_display_help_message(void) {
-    printf("%s", HELP_MESSAGE);
-    return error_none();
+ * @brief writes entries of `files` which were summarized into index
+ * `file_name`, the index is replaced at once when complete
+ * @return error when the index cannot be written */
+static Error corpus_index_write(const UserCommand *cmd,
+                                const CorpusRefresh *files, size_t count) {
+    const char *file_name = cmd->options.index_file;
+    char       *temp = mem_malloc(strlen(file_name) + sizeof(".tmp"));
+    if (temp == NULL) {
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate index path!\n");
+    }
+    strcpy(temp, file_name);
+    strcat(temp, ".tmp");
+    FILE *file = fopen(temp, "w");
+    if (file == NULL) {
+        Error err = error_ctor(ERR_INVALID_COMMAND,
+                               "Failed to open file [%s]! Os error: %s\n",
+                               temp, strerror(errno));
+        mem_free(temp);
+        return err;
+    }
+    fprintf(file, "%s %d %" PRIu32 " %s\n", CORPUS_INDEX_MAGIC,
+            CORPUS_INDEX_VERSION, cmd->options.threshold, cmd->file_name);
+    for (size_t i = 0; i < count; i++) {
+        const CorpusEntry *entry = &files[i].entry;
+        if (files[i].err.code != ERR_NONE) {
+            continue;
+        }
+        fprintf(file,
+                "%016" PRIx64 " %" PRId64 " %" PRId64 " %" PRIu64
+                " %" PRIu32 " %" PRIu32 " %" PRIu64 " %" PRIu32 " %" PRIu32
+                " %" PRIu32 " %s\n",
+                entry->hash, entry->mtime_sec, entry->mtime_nsec,
+                entry->file_size, entry->dimensions.height,
+                entry->dimensions.width, entry->filled, entry->shapes.hline,
+                entry->shapes.vline, entry->shapes.square, entry->name);
+    }
+    const bool written = !ferror(file);
+    Error      err = error_none();
+    if (fclose(file) != 0 || !written ||
+        rename(temp, file_name) != 0) {
+        err = error_ctor(ERR_INVALID_COMMAND,
+                         "Failed to write index [%s]! Os error: %s\n",
+                         file_name, strerror(errno));
+        remove(temp);
+    }
+    mem_free(temp);
+    return err;
 }
 
 /**
- * @brief executes "test" figsearch command by trying to load the bitmap file
- * @return ERR_INVALID_BITMAP_FILE with message "Invalid" when bitmap file is
- * not valid */
-static inline Error cmd_validate_bitmap_file(const char *file_name) {
-    /* try to load bmp, if caught any errors, print invalid */
-    BitmapLoader temp = bmp_loader_ctor(file_name);
-    Error        err = bmp_loader_load(&temp);
+ * @brief executes "index build": summarizes bitmaps of the directory into
+ * the index, files whose modification time and size are unchanged keep
+ * their summary without being read, files whose pixels hash the same keep
+ * their shapes without being searched, stale files are refreshed in
+ * parallel, files which are not valid bitmaps are reported and left out
+ * @return error when the directory cannot be read or index written */
+static Error corpus_index_build(const UserCommand *cmd) {
+    CorpusIndex old;
+    Error       err = corpus_index_load(cmd->options.index_file, &old);
     if (err.code != ERR_NONE) {
-        error_dtor(&err);
-        bmp_loader_dtor(&temp);
-        return error_ctor(ERR_INVALID_BITMAP_FILE, "%s", "Invalid");
+        return err;
+    }
+    /* summaries taken with another threshold are of different bitmaps */
+    const bool reusable = old.count > 0 &&
+                          old.threshold == cmd->options.threshold;
+    if (reusable) {
+        qsort(old.entries, old.count, sizeof(CorpusEntry), corpus_entry_cmp);
     }
-    printf("Valid\n");
-    /* cleanup and return */
-    bmp_loader_dtor(&temp);
-    return error_none();
-}
 
-/**
- * @brief loads bmp from given `file_name` and executes shape search function */
-static Error cmd_execute_shape_search(
-    const char *file_name, ShapeGeometry (*shape_search)(const Bitmap *bmp)) {
-    /* load bitmap */
-    Bitmap bmp = {0};
-    {
-        BitmapLoader loader = bmp_loader_ctor(file_name);
-        Error        err = bmp_loader_load(&loader);
-        if (err.code != ERR_NONE) {
-            bmp_loader_dtor(&loader);
-            return err;
+    struct stat    index_info;
+    const bool     index_exists = stat(cmd->options.index_file,
+                                       &index_info) == 0;
+    CorpusRefresh *files = NULL;
+    size_t         count = 0;
+    err = corpus_scan(cmd->file_name, index_exists ? &index_info : NULL,
+                      &files, &count);
+    if (err.code != ERR_NONE) {
+        corpus_index_dtor(&old);
+        return err;
+    }
+    size_t *stale = mem_malloc(sizeof(size_t) * (count + 1));
+    if (stale == NULL) {
+        corpus_files_dtor(files, count);
+        corpus_index_dtor(&old);
+        return error_ctor(ERR_ALLOCATION_FAILURE,
+                          "Failed to allocate index entries!\n");
+    }
+    size_t stale_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        CorpusEntry       *entry = &files[i].entry;
+        const CorpusEntry *previous =
+            reusable ? bsearch(entry, old.entries, old.count,
+                               sizeof(CorpusEntry), corpus_entry_cmp)
+                     : NULL;
+        if (previous != NULL && previous->mtime_sec == entry->mtime_sec &&
+            previous->mtime_nsec == entry->mtime_nsec &&
+            previous->file_size == entry->file_size) {
+            char *name = entry->name;
+            *entry = *previous;
+            entry->name = name;
+            continue;
         }
-        bmp = bmp_loader_get_bitmap(&loader);
+        files[i].old = previous;
+        stale[stale_count++] = i;
     }
-    /* scan for largest shape */
-    const ShapeGeometry shape = shape_search(&bmp);
-    /* print results */
-    if (shape_geometry_is_invalid(shape)) {
-        printf("Not found\n");
-    } else {
-        shape_geometry_print(shape);
+    CorpusBuild build = {.cmd = cmd, .files = files, .stale = stale};
+    parallel_for((uint32_t)stale_count, 1, corpus_refresh_worker, &build);
+
+    size_t failed = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (files[i].err.code != ERR_NONE) {
+            fprintf(stderr, "Skipping [%s]: %s\n", files[i].entry.name,
+                    files[i].err.msg != NULL ? files[i].err.msg : "");
+            failed++;
+        }
     }
-    /* cleanup and return */
-    bmp_dtor(&bmp);
-    return error_none();
+    err = corpus_index_write(cmd, files, count);
+    if (err.code == ERR_NONE && cmd->options.stats) {
+        fprintf(stderr,
+                "index: %zu bitmaps, %zu refreshed, %zu skipped\n",
+                count - failed, stale_count - failed, failed);
+    }
+    mem_free(stale);
+    corpus_files_dtor(files, count);
+    corpus_index_dtor(&old);
+    return err;
 }
 
-static Error cmd_execute(UserCommand *cmd) {
-    switch (cmd->action_type) {
-        case HELP:
-            return cmd_display_help_message();
-        case TEST:
-            return cmd_validate_bitmap_file(cmd->file_name);
-        case HLINE:
-            return cmd_execute_shape_search(cmd->file_name,
-                                            line_find_longest_hline);
-        case VLINE:
-            return cmd_execute_shape_search(cmd->file_name,
-                                            line_find_longest_vline);
-        case SQUARE:
-            return cmd_execute_shape_search(cmd->file_name,
-                                            square_find_largest_square);
+/** @return whether `entry` passes the minimums of "index query" */
+static bool corpus_entry_matches(const CorpusEntry        *entry,
+                                 const UserCommandOptions *options) {
+    const uint32_t sizes[] = {entry->shapes.hline, entry->shapes.vline,
+                              entry->shapes.square};
+    const uint32_t mins[] = {options->index_min.hline,
+                             options->index_min.vline,
+                             options->index_min.square};
+    bool given = false;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+        if (mins[i] == BMP_BOUND_UNKNOWN) {
+            continue;
+        }
+        given = true;
+        if ((sizes[i] >= mins[i]) == options->index_any) {
+            return options->index_any;
+        }
     }
-    return error_ctor(ERR_INTERNAL, "Invalid control path executed on line: %d",
-                      __LINE__);
+    return !options->index_any || !given;
 }
 
 /**
- * @brief parses command input and validates it
- * @return error with appropriate message if `out_cmd` param could not be
- * populated because of invalid input data */
-static Error cmd_parse(int argc, char **argv, UserCommand *out_cmd) {
-    /* ensure that the command is of correct size */
-    if (argc > CMD_MAX_ARGS || argc < CMD_MIN_ARGS) {
-        return error_ctor(ERR_INVALID_NUMBER_ARGS,
-                          "Invalid number of arguments given! Expected: "
-                          "1 or 2 but given: %d.\nFor more info refer to "
-                          "the help info:\n%s",
-                          argc - 1, HELP_MESSAGE);
+ * @brief executes "index query": prints the path of every indexed bitmap
+ * passing the minimums, the index is streamed and no bitmap is read
+ * @return error when the index is not valid */
+static Error corpus_index_query(const UserCommand *cmd) {
+    FILE *file = fopen(cmd->file_name, "r");
+    if (file == NULL) {
+        return error_ctor(ERR_INVALID_QUERY_FILE,
+                          "Failed to open file [%s]! Os error: %s\n",
+                          cmd->file_name, strerror(errno));
     }
-
-    /* validate command args */
-    if (argc == CMD_MIN_ARGS) /* HELP command only */ {
-        if (strcmp(argv[1], "--help") == 0) {
-            out_cmd->action_type = HELP;
-            return error_none();
+    CorpusIndex index = {0};
+    char       *text = NULL;
+    size_t      text_size = 0;
+    Error err = corpus_index_parse_header(file, cmd->file_name, &text,
+                                          &text_size, &index);
+    for (size_t line = 2;
+         err.code == ERR_NONE && getline(&text, &text_size, file) != -1;
+         line++) {
+        CorpusEntry entry;
+        if (!corpus_entry_parse(text, &entry)) {
+            err = error_ctor(ERR_INVALID_QUERY_FILE,
+                             "Index line %zu is malformed!", line);
+            break;
+        }
+        if (corpus_entry_matches(&entry, &cmd->options)) {
+            const size_t dir_length = strlen(index.dir);
+            fputs(index.dir, stdout);
+            if (dir_length > 0 && index.dir[dir_length - 1] != '/') {
+                fputc('/', stdout);
+            }
+            puts(entry.name);
         }
-        return error_ctor(ERR_INVALID_COMMAND,
-                          "Invalid command given [%s]! Expected: --help. Did "
-                          "you forget to add bitmap file name?",
-                          argv[1]);
     }
+    free(text);
+    fclose(file);
+    corpus_index_dtor(&index);
+    return err;
+}
 
-    /*
-     * convenient macro for command type check (cmd_parse
-     * function-only)
-     */
-#define register_command(cmd_input, cmd_name, reg_type, reg_file_name)     \
-    do {                                                                   \
-        if (strcmp((cmd_input), (cmd_name)) == 0) {                        \
-            *out_cmd = (struct UserCommand){.action_type = (reg_type),     \
-                                            .file_name = (reg_file_name)}; \
-            return error_none();                                           \
-        }                                                                  \
-    } while (0);
-
-    register_command(argv[1], "test", TEST, argv[2]);
-    register_command(argv[1], "hline", HLINE, argv[2]);
-    register_command(argv[1], "vline", VLINE, argv[2]);
-    register_command(argv[1], "square", SQUARE, argv[2]);
-
-#undef register_command
+/* =========================================
+ *                   Main
+ * ========================================= */
 
-    return error_ctor(ERR_INVALID_COMMAND,
-                      "Invalid command given [%s]! Expected one of: --help, "
-                      "test, hline, vline, sqaure.",
-                      argv[1]);
+static Error cmd_execute(UserCommand *cmd) {
+    if (cmd->options.timeout > 0) {
+        return cmd_execute_timed_search(cmd);
+    }
+    switch (cmd->action_type) {
+        case HELP:
+            return cmd_display_help_message();
+        case RUN:
+            return plan_execute(cmd);
+        case INDEX_BUILD:
+            return corpus_index_build(cmd);
+        case INDEX_QUERY:
+            return corpus_index_query(cmd);
+        default:
+            return cmd_execute_bitmap_command(cmd);
+    }
 }
 
 int main(int argc, char **argv) {
@@ -792,6 +8276,9 @@ int main(int argc, char **argv) {
     /* execute given command */
     {
         Error err = cmd_execute(&cmd);
+        if (cmd.options.stats) {
+            mem_print_stats(stderr);
+        }
         if (err.code != ERR_NONE) {
             error_print(err);
             return error_dtor(&err);
@@ -800,3 +8287,5 @@ int main(int argc, char **argv) {
 
     return EXIT_SUCCESS;
 }
+
+#endif /* FIGSEARCH_NO_MAIN */
@@ -0,0 +1,127 @@
+#ifndef FIGSEARCH_H
+#define FIGSEARCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Asynchronous searches for programs embedding figsearch, they link
+ * figsearch.c compiled with FIGSEARCH_NO_MAIN defined (the figsearch library
+ * of CMakeLists.txt). A job loads a bitmap and searches it on a worker of a
+ * job pool, its completion is signalled by a callback and by its pollable
+ * descriptor becoming readable.
+ */
+
+/* =========================================
+ *                Constants
+ * ========================================= */
+
+#define ERR_NONE                (0)
+#define ERR_ALLOCATION_FAILURE  (0x00FA75E5)
+#define ERR_INTERNAL            (0x000000B5)
+#define ERR_INVALID_NUMBER_ARGS (0xB16B00B5)
+#define ERR_INVALID_COMMAND     (0xBAADF00D)
+#define ERR_INVALID_BITMAP_FILE (0x8BADF00D)
+#define ERR_INVALID_DIMENSION   (0xABADBABE)
+#define ERR_INVALID_QUERY_FILE  (0xDEADC0DE)
+#define ERR_CANCELLED           (0x0D15CA4D)
+
+#define COORD_INVALID (UINT32_MAX)
+
+/* =========================================
+ *                  Types
+ * ========================================= */
+
+typedef int ErrorNum;
+
+/** @brief stores coordinate value of pixel from a bitmap */
+typedef struct Point {
+    /** @brief represents bitmap's column index */
+    uint32_t x;
+    /** @brief represents bitmap's row index */
+    uint32_t y;
+} Point;
+
+/** @brief a common structure to represent geometrical shapes (Line/Square) */
+typedef struct ShapeGeometry {
+    /** @brief top-left or start point */
+    Point start;
+    /** @brief bottom-right or end point */
+    Point end;
+} ShapeGeometry;
+
+/** @brief kind of the searched shape */
+typedef enum ShapeKind { SHAPE_HLINE = 0, SHAPE_VLINE, SHAPE_SQUARE } ShapeKind;
+
+/* =========================================
+ *                   Jobs
+ * ========================================= */
+
+/** @brief load-and-search request and its result */
+typedef struct Job Job;
+
+/** @brief workers executing the submitted jobs in the order of submission */
+typedef struct JobPool JobPool;
+
+/** @brief called on the worker thread once the job finished, the job must not
+ * be destroyed by the callback */
+typedef void (*JobCallback)(Job *job, void *arg);
+
+/**
+ * @brief creates job searching for the shape of `kind` in `file_name` (kept
+ * by the caller) with the default engine and threshold, they may be changed
+ * until submission
+ * @return ERR_INTERNAL when the completion descriptor cannot be created */
+ErrorNum job_create(const char *file_name, ShapeKind kind, Job **out_job);
+
+/** @brief destroys the job, a submitted job has to be done first
+ * @see job_wait */
+void job_destroy(Job *job);
+
+/** @brief selects the search engine by its `--engine` name
+ * @return false (keeping the engine) when there is no such engine */
+bool job_set_engine(Job *job, const char *engine);
+
+/** @brief sets threshold of PGM bitmaps (`--threshold`) */
+void job_set_threshold(Job *job, uint32_t threshold);
+
+/** @brief sets callback invoked with `arg` once the job is done */
+void job_set_callback(Job *job, JobCallback callback, void *arg);
+
+/** @return descriptor which becomes readable once the job is done */
+int job_fd(const Job *job);
+
+/** @brief asks the job to stop, it completes with ERR_CANCELLED unless it was
+ * already done (may be called from any thread), the rowmajor and skip scans
+ * stop at the next row, other engines finish their search
+ * @note a done job cancelled before it is submitted again is cancelled
+ * right away, like a job which was never submitted */
+void job_cancel(Job *job);
+
+/**
+ * @brief reads the result of a done job
+ * @param out_message receives message of the error (owned by the job), may be
+ * NULL
+ * @return error code of the job, `out_shape` has all coordinates set to
+ * COORD_INVALID when the shape was not found */
+ErrorNum job_result(const Job *job, ShapeGeometry *out_shape,
+                    const char **out_message);
+
+/**
+ * @brief starts pool of `threads` workers (0 stands for one per processor)
+ * @return ERR_INTERNAL when no worker could be started */
+ErrorNum job_pool_create(uint32_t threads, JobPool **out_pool);
+
+/** @brief stops the pool, queued jobs are cancelled and the workers are
+ * joined once they are done with their jobs */
+void job_pool_destroy(JobPool *pool);
+
+/** @brief queues the job, it has to stay alive until it is done
+ * @note a done job may be submitted again (to any pool), the result and the
+ * completion byte of its previous submission are dropped */
+void job_submit(JobPool *pool, Job *job);
+
+/** @brief blocks until the submitted job is done */
+void job_wait(JobPool *pool, Job *job);
+
+#endif /* FIGSEARCH_H */
@@ -0,0 +1,123 @@
+import sys
+import subprocess
+import random
+from time import perf_counter, time
+import os
+
+N_RUNS: int = 5
+ENGINES: list[str] = [
+    "rowmajor", "dedup", "tiled", "sat", "runs", "complement", "packed",
+    "fused", "skip"
+]
+COMMANDS: list[str] = ["hline", "vline", "square"]
+
+
+def curr_dir() -> str:
+    return os.path.dirname(os.path.abspath(__file__))
+
+
+def generate_bmp(loc: str, height: int, width: int, density: float) -> None:
+    with open(loc, "w+") as file:
+        file.write(f"{height} {width}\n")
+        for _ in range(height):
+            file.write(
+                " ".join("1" if random.random() < density else "0" for _ in range(width))
+                + "\n"
+            )
+
+
+def time_run(run_exec: list[str]) -> tuple[float, str]:
+    best: float = float("inf")
+    output: str = ""
+    for _ in range(N_RUNS):
+        begin = time()
+        ret = subprocess.run(run_exec, capture_output=True, text=True)
+        delta = time() - begin
+        if ret.returncode != 0:
+            raise Exception(f"{run_exec} failed: {ret.stderr.strip()}")
+        best = min(best, delta)
+        output = ret.stdout.strip()
+    return (best, output)
+
+
+def bench_engines(exec: str, bmp: str, engines: list[str]) -> None:
+    print(f"{'command':<8} " + " ".join(f"{engine:>10}" for engine in engines))
+    for command in COMMANDS:
+        outputs: set[str] = set()
+        timings: list[str] = []
+        for engine in engines:
+            delta, output = time_run([exec, command, "--engine", engine, bmp])
+            outputs.add(output)
+            timings.append(f"{delta * 1000:>8.1f}ms")
+        mark = "" if len(outputs) == 1 else "  \x1b[31mresults differ!\x1b[0m"
+        print(f"{command:<8} " + " ".join(timings) + mark)
+
+
+def bench_wide(exec: str) -> None:
+    """row-major vs. tiled layout on wide bitmaps (column access is strided)"""
+    for height, width, density in [(64, 200000, 0.9), (256, 50000, 0.95)]:
+        bmp = f"{curr_dir()}/pics/wide_{height}x{width}"
+        generate_bmp(bmp, height, width, density)
+        print(f"=== wide {height}x{width}, density {density} ===")
+        bench_engines(exec, bmp, ENGINES)
+
+
+def bench_full(exec: str) -> None:
+    """near-full bitmaps, the structure is in the few empty pixels"""
+    for size, density in [(2000, 0.99), (2000, 0.999)]:
+        bmp = f"{curr_dir()}/pics/full_{size}x{size}_{density}"
+        generate_bmp(bmp, size, size, density)
+        print(f"=== full {size}x{size}, density {density} ===")
+        bench_engines(exec, bmp, ENGINES)
+
+
+def bench_tall(exec: str) -> None:
+    """column walk vs. AND doubling of packed rows on tall bitmaps"""
+    for height, width, density in [(200000, 64, 0.9), (50000, 256, 0.97)]:
+        bmp = f"{curr_dir()}/pics/tall_{height}x{width}"
+        generate_bmp(bmp, height, width, density)
+        print(f"=== tall {height}x{width}, density {density} ===")
+        bench_engines(exec, bmp, ENGINES)
+
+
+def bench_latency(exec: str) -> None:
+    """exec-to-exit time of tiny bitmaps, which is dominated by the process
+    startup (check a static release build, e.g. `-O2 -static`, against the
+    sub-millisecond target)"""
+    runs = 200
+    for height, width in [(4, 4), (16, 16), (32, 64)]:
+        bmp = f"{curr_dir()}/pics/tiny_{height}x{width}"
+        generate_bmp(bmp, height, width, 0.7)
+        print(f"=== latency {height}x{width}, {runs} runs ===")
+        print(f"{'command':<8} {'median':>10} {'p99':>10}")
+        for command in ["test"] + COMMANDS:
+            deltas: list[float] = []
+            for _ in range(runs):
+                begin = perf_counter()
+                ret = subprocess.run([exec, command, bmp], capture_output=True)
+                deltas.append(perf_counter() - begin)
+                if ret.returncode != 0:
+                    raise Exception(f"{command} {bmp} failed: {ret.stderr!r}")
+            deltas.sort()
+            median = deltas[len(deltas) // 2]
+            p99 = deltas[len(deltas) * 99 // 100]
+            print(f"{command:<8} {median * 1000:>8.3f}ms {p99 * 1000:>8.3f}ms")
+
+
+BENCHES = {
+    "wide": bench_wide,
+    "full": bench_full,
+    "tall": bench_tall,
+    "latency": bench_latency,
+}
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2 or not os.path.exists(sys.argv[1]):
+        print(f"usage: {sys.argv[0]} [figsearch executable] [{'|'.join(BENCHES)}]...")
+        sys.exit(1)
+
+    os.makedirs(f"{curr_dir()}/pics", exist_ok=True)
+    random.seed(0)
+    for name in sys.argv[2:] if len(sys.argv) > 2 else BENCHES:
+        BENCHES[name](sys.argv[1])
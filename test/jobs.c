@@ -0,0 +1,155 @@
+/*
+ * Embedding test of the job API: submits searches to a job pool, polls their
+ * descriptors, cancels a job and reads the results.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "figsearch.h"
+
+/** @brief milliseconds a job may take before the test gives up on it */
+#define TEST_POLL_TIMEOUT (10000)
+
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,  \
+                    #cond);                                                   \
+            return false;                                                     \
+        }                                                                     \
+    } while (0)
+
+static const char BITMAP[] = "3 4\n"
+                             "1 1 1 0\n"
+                             "0 1 1 1\n"
+                             "1 1 1 1\n";
+
+static void count_callback(Job *job, void *arg) {
+    (void)job;
+    atomic_fetch_add((atomic_int *)arg, 1);
+}
+
+/** @return true when the descriptor of the job becomes readable in time */
+static bool wait_readable(Job *job) {
+    struct pollfd ready = {.fd = job_fd(job), .events = POLLIN};
+    return poll(&ready, 1, TEST_POLL_TIMEOUT) == 1 &&
+           (ready.revents & POLLIN) != 0;
+}
+
+static bool shape_equals(ShapeGeometry shape, uint32_t y, uint32_t x,
+                         uint32_t y2, uint32_t x2) {
+    return shape.start.y == y && shape.start.x == x && shape.end.y == y2 &&
+           shape.end.x == x2;
+}
+
+/** @brief searches every shape kind, the result is reported by the callback
+ * and the descriptor */
+static bool test_search(JobPool *pool, const char *path) {
+    const ShapeKind kinds[] = {SHAPE_HLINE, SHAPE_VLINE, SHAPE_SQUARE};
+    const uint32_t  expected[][4] = {{2, 0, 2, 3}, {0, 1, 2, 1}, {0, 1, 1, 2}};
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(*kinds); i++) {
+        atomic_int calls = 0;
+        Job       *job;
+        CHECK(job_create(path, kinds[i], &job) == ERR_NONE);
+        CHECK(job_set_engine(job, "packed"));
+        job_set_callback(job, count_callback, &calls);
+        job_submit(pool, job);
+        CHECK(wait_readable(job));
+        job_wait(pool, job);
+        ShapeGeometry shape;
+        CHECK(job_result(job, &shape, NULL) == ERR_NONE);
+        CHECK(shape_equals(shape, expected[i][0], expected[i][1],
+                           expected[i][2], expected[i][3]));
+        CHECK(atomic_load(&calls) == 1);
+        job_destroy(job);
+    }
+    return true;
+}
+
+/** @brief a job cancelled before it runs completes with ERR_CANCELLED */
+static bool test_cancel(JobPool *pool, const char *path) {
+    Job *job;
+    CHECK(job_create(path, SHAPE_SQUARE, &job) == ERR_NONE);
+    job_cancel(job);
+    job_submit(pool, job);
+    CHECK(wait_readable(job));
+    job_wait(pool, job);
+    ShapeGeometry shape;
+    const char   *message = NULL;
+    CHECK(job_result(job, &shape, &message) == ERR_CANCELLED);
+    CHECK(message != NULL);
+    CHECK(shape.start.x == COORD_INVALID);
+    job_destroy(job);
+    return true;
+}
+
+/** @brief a done job submitted again reports only its new result, the
+ * descriptor carries a single completion byte */
+static bool test_resubmit(JobPool *pool, const char *path) {
+    Job *job;
+    CHECK(job_create(path, SHAPE_SQUARE, &job) == ERR_NONE);
+    job_cancel(job);
+    job_submit(pool, job);
+    job_wait(pool, job);
+    ShapeGeometry shape;
+    CHECK(job_result(job, &shape, NULL) == ERR_CANCELLED);
+    /* the completion byte of the cancelled run is left unread */
+    job_submit(pool, job);
+    CHECK(wait_readable(job));
+    job_wait(pool, job);
+    const char *message = NULL;
+    CHECK(job_result(job, &shape, &message) == ERR_NONE);
+    CHECK(message == NULL);
+    CHECK(shape_equals(shape, 0, 1, 1, 2));
+    char byte;
+    CHECK(read(job_fd(job), &byte, 1) == 1);
+    struct pollfd ready = {.fd = job_fd(job), .events = POLLIN};
+    CHECK(poll(&ready, 1, 0) == 0);
+    job_destroy(job);
+    return true;
+}
+
+/** @brief unknown engines are refused, invalid bitmaps fail the job */
+static bool test_errors(JobPool *pool) {
+    Job *job;
+    CHECK(job_create("/nonexistent/bitmap.txt", SHAPE_HLINE, &job) ==
+          ERR_NONE);
+    CHECK(!job_set_engine(job, "nonexistent"));
+    job_submit(pool, job);
+    CHECK(wait_readable(job));
+    job_wait(pool, job);
+    ShapeGeometry shape;
+    const char   *message = NULL;
+    CHECK(job_result(job, &shape, &message) != ERR_NONE);
+    CHECK(message != NULL);
+    job_destroy(job);
+    return true;
+}
+
+int main(void) {
+    char path[] = "/tmp/figsearch-jobs-XXXXXX";
+    int  fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    const ssize_t written = write(fd, BITMAP, strlen(BITMAP));
+    close(fd);
+    JobPool *pool;
+    bool     passed = written == (ssize_t)strlen(BITMAP) &&
+                  job_pool_create(2, &pool) == ERR_NONE;
+    if (passed) {
+        passed = test_search(pool, path) && test_cancel(pool, path) &&
+                 test_resubmit(pool, path) && test_errors(pool);
+        job_pool_destroy(pool);
+    }
+    unlink(path);
+    printf("%s\n", passed ? "passed" : "FAILED");
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
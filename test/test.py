@@ -1,8 +1,12 @@
 import sys
+import tempfile
 import subprocess
 from dataclasses import dataclass
 import random
+import math
+import re
 from time import time
+from typing import Callable, Optional
 import os
 
 DEF_BMP_SIZE = (10, 10)
@@ -573,6 +577,1008 @@ def cmd_square(cmd: Command) -> None:
     input("Press any key to continue...")
 
 
+Grid = list[list[int]]
+# shape as printed by figsearch: top row, left column, bottom row, right column
+Shape = tuple[int, int, int, int]
+
+
+def random_grid(height: int, width: int, fill: float) -> Grid:
+    return [
+        [1 if random.random() < fill else 0 for _ in range(width)]
+        for _ in range(height)
+    ]
+
+
+def random_size() -> BitmapSize:
+    return BitmapSize(random.randint(1, 12), random.randint(1, 12))
+
+
+def random_fill() -> float:
+    return random.choice([0.0, 0.3, 0.6, 0.85, 1.0])
+
+
+def bmp_location() -> str:
+    return f"{curr_dir()}/pics/bmp_{random.randint(0, 10000)}"
+
+
+def write_grid(grid: Grid, loc: str) -> None:
+    with open(loc, "w+") as file:
+        file.write(f"{len(grid)} {len(grid[0])}\n")
+        file.writelines(" ".join(map(str, row)) + "\n" for row in grid)
+
+
+def shape_str(shape: Optional[Shape]) -> str:
+    return "Not found" if shape is None else " ".join(map(str, shape))
+
+
+def runs_right(grid: Grid) -> Grid:
+    """length of the run of filled pixels rightwards from each pixel"""
+    runs = [[0] * (len(grid[0]) + 1) for _ in grid]
+    for row in range(len(grid)):
+        for col in reversed(range(len(grid[0]))):
+            if grid[row][col]:
+                runs[row][col] = runs[row][col + 1] + 1
+    return runs
+
+
+def runs_down(grid: Grid) -> Grid:
+    """length of the run of filled pixels downwards from each pixel"""
+    runs = [[0] * len(grid[0]) for _ in range(len(grid) + 1)]
+    for row in reversed(range(len(grid))):
+        for col in range(len(grid[0])):
+            if grid[row][col]:
+                runs[row][col] = runs[row + 1][col] + 1
+    return runs
+
+
+def ref_best(candidates: list[tuple[int, Shape]]) -> Optional[Shape]:
+    """the largest shape, ties are broken by the top row, then left column"""
+    if not candidates:
+        return None
+    return min(candidates, key=lambda c: (-c[0], c[1]))[1]
+
+
+def ref_hlines(grid: Grid) -> list[tuple[int, Shape]]:
+    right = runs_right(grid)
+    return [
+        (right[y][x], (y, x, y, x + right[y][x] - 1))
+        for y in range(len(grid))
+        for x in range(len(grid[0]))
+        if grid[y][x] and (x == 0 or not grid[y][x - 1])
+    ]
+
+
+def ref_vlines(grid: Grid) -> list[tuple[int, Shape]]:
+    down = runs_down(grid)
+    return [
+        (down[y][x], (y, x, y + down[y][x] - 1, x))
+        for y in range(len(grid))
+        for x in range(len(grid[0]))
+        if grid[y][x] and (y == 0 or not grid[y - 1][x])
+    ]
+
+
+def ref_squares(grid: Grid) -> list[tuple[int, Shape]]:
+    """the largest square (its frame is filled) anchored at each pixel"""
+    right, down = runs_right(grid), runs_down(grid)
+    squares = []
+    for y in range(len(grid)):
+        for x in range(len(grid[0])):
+            for side in range(min(right[y][x], down[y][x]), 0, -1):
+                if right[y + side - 1][x] >= side and down[y][x + side - 1] >= side:
+                    squares.append((side, (y, x, y + side - 1, x + side - 1)))
+                    break
+    return squares
+
+
+REFERENCES: dict[str, Callable[[Grid], list[tuple[int, Shape]]]] = {
+    "hline": ref_hlines,
+    "vline": ref_vlines,
+    "square": ref_squares,
+}
+
+
+def ref_shape(command: str, grid: Grid) -> str:
+    return shape_str(ref_best(REFERENCES[command](grid)))
+
+
+def subprocess_check(
+    run_exec: list[str], check: Callable[[str], bool], description: str, **kwargs
+) -> bool:
+    """runs figsearch and passes its output (stderr on failure) to `check`"""
+    print_unit_test_fmt(run_exec)
+    ret = subprocess.run(run_exec, capture_output=True, text=True, **kwargs)
+    actual_output = (ret.stdout if ret.returncode == 0 else ret.stderr).strip()
+    if check(actual_output):
+        print(f"Test \x1b[33mpassed\x1b[0m!")
+        return True
+    print(
+        f"Test \x1b[31mfailed\x1b[0m! Expected: {description}; but received: {actual_output}"
+    )
+    input("Press any key to continue...")
+    return False
+
+
+def cmd_reference(cmd: Command, name: str, unit: Callable[[str], bool]) -> None:
+    """runs N_TESTS units checking `name` against a brute-force reference"""
+    print(f"Testing {name}...")
+    if not cmd.is_of_functional():
+        print("Skipped, reference tests check functionality only.")
+        return None
+    tests_passed: int = 0
+    for _ in range(N_TESTS):
+        tests_passed += 1 if unit(cmd.exec) else 0
+    if cmd.is_verbose:
+        print(
+            f"Summary: {tests_passed} out of {N_TESTS}. Success rate: {(tests_passed / N_TESTS) * 100}%"
+        )
+
+    print("Test ended.")
+    input("Press any key to continue...")
+
+    return None
+
+
+def cmd_pgm(cmd: Command) -> None:
+    def _write_pgm(gray: Grid, max_value: int, raw: bool, loc: str) -> None:
+        with open(loc, "wb+") as file:
+            header = f"{'P5' if raw else 'P2'}\n# figsearch test\n"
+            file.write(f"{header}{len(gray[0])} {len(gray)}\n{max_value}\n".encode())
+            if not raw:
+                file.writelines(
+                    (" ".join(map(str, row)) + "\n").encode() for row in gray
+                )
+                return None
+            width = 1 if max_value < 256 else 2
+            for row in gray:
+                file.write(b"".join(v.to_bytes(width, "big") for v in row))
+
+    def _run_unit(exec: str) -> bool:
+        size = random_size()
+        max_value = random.choice([1, 15, 255, 65535])
+        gray = [
+            [random.randint(0, max_value) for _ in range(size.width)]
+            for _ in range(size.height)
+        ]
+        threshold = random.choice([None, 0, 1, max_value // 3, max_value + 1])
+        limit = max_value // 2 + 1 if threshold is None else threshold
+        grid = [[1 if v >= limit else 0 for v in row] for row in gray]
+        options = [] if threshold is None else ["--threshold", str(threshold)]
+        bmp = bmp_location()
+        _write_pgm(gray, max_value, chance(), bmp)
+        return all(
+            [
+                subprocess_evaluate(
+                    [exec, command, bmp] + options, ref_shape(command, grid)
+                )
+                for command in ("hline", "vline", "square")
+            ]
+        )
+
+    cmd_reference(cmd, "PGM input with --threshold", _run_unit)
+
+
+ENGINES: list[str] = [
+    "rowmajor",
+    "dedup",
+    "tiled",
+    "sat",
+    "runs",
+    "complement",
+    "packed",
+    "fused",
+    "skip",
+]
+
+
+def cmd_engines(cmd: Command) -> None:
+    def _run_unit(exec: str) -> bool:
+        size = random_size()
+        if chance():  # spans several tiles of the tiled engine
+            size = BitmapSize(random.randint(1, 40), random.randint(1, 40))
+        elif chance():  # rows span several words of the packed engine
+            size = BitmapSize(random.randint(1, 20), random.randint(60, 140))
+        grid = random_grid(size.height, size.width, random_fill())
+        if chance():  # repeated rows are stored once by the dedup engine
+            rows = random_grid(random.randint(1, 3), size.width, random_fill())
+            grid = [list(random.choice(rows)) for _ in range(size.height)]
+        bmp = bmp_location()
+        write_grid(grid, bmp)
+        return all(
+            [
+                subprocess_evaluate(
+                    [exec, command, bmp, "--engine", engine], ref_shape(command, grid)
+                )
+                for engine in ENGINES
+                for command in ("hline", "vline", "square")
+            ]
+        )
+
+    cmd_reference(cmd, "--engine", _run_unit)
+
+
+def cmd_density(cmd: Command) -> None:
+    def _run_unit(exec: str) -> bool:
+        size = random_size()
+        grid = random_grid(size.height, size.width, random_fill())
+        bmp = bmp_location()
+        write_grid(grid, bmp)
+        queries = []
+        for _ in range(random.randint(1, 10)):
+            rows = sorted(random.randrange(size.height) for _ in range(2))
+            cols = sorted(random.randrange(size.width) for _ in range(2))
+            queries.append((rows[0], cols[0], rows[1], cols[1]))
+        expected = "\n".join(
+            str(sum(sum(row[x : x2 + 1]) for row in grid[y : y2 + 1]))
+            for y, x, y2, x2 in queries
+        )
+        queries_file = f"{bmp}.queries"
+        if chance():  # the rectangle reaches past the bitmap
+            queries.append((0, 0, size.height, 0))
+            expected = f"Invalid rectangle query #{len(queries)} in [{queries_file}]!"
+        with open(queries_file, "w+") as file:
+            file.writelines(" ".join(map(str, query)) + "\n" for query in queries)
+        return subprocess_evaluate(
+            [exec, "density", bmp, "--queries", queries_file], expected
+        )
+
+    cmd_reference(cmd, "'density' command", _run_unit)
+
+
+def cmd_run(cmd: Command) -> None:
+    def _run_unit(exec: str) -> bool:
+        grids, bmps = [], []
+        for _ in range(random.randint(1, 3)):
+            size = random_size()
+            grids.append(random_grid(size.height, size.width, random_fill()))
+            bmps.append(bmp_location())
+            write_grid(grids[-1], bmps[-1])
+        lines, expected = [], []
+        # queries of a bitmap are interleaved with the others, results keep
+        # the plan order
+        for _ in range(random.randint(1, 8)):
+            index = random.randrange(len(bmps))
+            command = random.choice(["hline", "vline", "square"])
+            lines.append(f"{bmps[index]} {command} --engine {random.choice(ENGINES)}")
+            expected.append(ref_shape(command, grids[index]))
+        plan = f"{bmp_location()}.plan"
+        with open(plan, "w+") as file:
+            file.writelines(line + "\n" for line in lines)
+        options = ["--memory-cap", "1"] if chance() else []
+        return subprocess_evaluate([exec, "run", plan] + options, "\n".join(expected))
+
+    cmd_reference(cmd, "'run' command", _run_unit)
+
+
+def cmd_memory_cap(cmd: Command) -> None:
+    def _location(grid: Grid) -> str:
+        """writes `grid` as a plain bitmap, a mosaic or an expression"""
+        bmp = bmp_location()
+        write_grid(grid, bmp)
+        kind = random.randrange(3)
+        if kind == 1:
+            manifest = f"{bmp}.mosaic"
+            with open(manifest, "w+") as file:
+                file.write(f"mosaic {len(grid)} {len(grid[0])}\n")
+                file.write(f"0 0 {os.path.basename(bmp)}\n")
+            return manifest
+        return f"not(not({bmp}))" if kind == 2 else bmp
+
+    def _run_unit(exec: str) -> bool:
+        lines, expected = [], []
+        for _ in range(random.randint(1, 4)):
+            size = random_size()
+            grid = random_grid(size.height, size.width, random_fill())
+            location = _location(grid)
+            for command in random.sample(["hline", "vline", "square"], 2):
+                lines.append(f"{location} {command}")
+                expected.append(ref_shape(command, grid))
+        missing = chance()
+        if missing:  # the load error is a single line of the diagnostics
+            lines.append(f"{bmp_location()}.missing hline")
+        plan = f"{bmp_location()}.plan"
+        with open(plan, "w+") as file:
+            file.writelines(line + "\n" for line in lines)
+        cap = random.choice(["1", "2", "1024"])
+        if missing:
+            bmp = lines[-1].split()[0]
+            expected = [
+                f"Plan line {len(lines)}: Failed to open file [{bmp}]! "
+                "Os error: No such file or directory",
+                f"1 out of {len(lines)} plan queries failed.",
+            ]
+        return subprocess_evaluate(
+            [exec, "run", plan, "--memory-cap", cap], "\n".join(expected)
+        )
+
+    cmd_reference(cmd, "'run' --memory-cap", _run_unit)
+
+
+def cmd_ties(cmd: Command) -> None:
+    def _run_unit(exec: str) -> bool:
+        size = random_size()
+        grid = random_grid(size.height, size.width, random_fill())
+        bmp = bmp_location()
+        write_grid(grid, bmp)
+        passed = True
+        for command in ("hline", "vline", "square"):
+            candidates = REFERENCES[command](grid)
+            largest = max((length for length, _ in candidates), default=0)
+            # ties are printed in the order of the scan, which is not fixed
+            ties = sorted(
+                shape_str(shape) for length, shape in candidates if length == largest
+            )
+            expected = ties if ties else ["Not found"]
+            passed &= subprocess_check(
+                [exec, command, bmp, "--ties"],
+                lambda output: sorted(output.splitlines()) == expected,
+                " / ".join(expected),
+            )
+        return passed
+
+    cmd_reference(cmd, "--ties", _run_unit)
+
+
+PYRAMID_LINE = re.compile(r"pyramid: (\d+) of (\d+) rows/columns skipped")
+
+
+def cmd_pyramid(cmd: Command) -> None:
+    def _run_unit(exec: str, command: str, grid: Grid, pruned: bool) -> bool:
+        bmp = bmp_location()
+        write_grid(grid, bmp)
+        lines = len(grid[0]) if command == "vline" else len(grid)
+        run_exec = [exec, command, bmp, "--stats"]
+        print_unit_test_fmt(run_exec)
+        ret = subprocess.run(run_exec, capture_output=True, text=True)
+        found = PYRAMID_LINE.findall(ret.stderr)
+        if pruned:
+            passed = len(found) == 1 and found[0][1] == str(lines)
+            passed = passed and 0 < int(found[0][0]) <= lines
+        else:
+            passed = found == []
+        if ret.stdout.strip() == ref_shape(command, grid) and passed:
+            print(f"Test \x1b[33mpassed\x1b[0m!")
+            return True
+        expected = "rows/columns skipped" if pruned else "no pyramid"
+        print(
+            f"Test \x1b[31mfailed\x1b[0m! Expected: {expected}; but received: {ret.stderr.strip()}"
+        )
+        input("Press any key to continue...")
+        return False
+
+    def _run_unit_sparse(exec: str) -> bool:
+        # a few dense blocks, the empty bands between them are skipped
+        height, width = random.randint(60, 120), random.randint(60, 120)
+        grid = [[0] * width for _ in range(height)]
+        for _ in range(random.randint(1, 3)):
+            side = random.randint(2, 10)
+            y, x = random.randrange(height - side), random.randrange(width - side)
+            block = random_grid(side, side, random.choice([0.85, 1.0]))
+            for row in range(side):
+                grid[y + row][x : x + side] = block[row]
+        command = random.choice(["hline", "vline", "square"])
+        return _run_unit(exec, command, grid, True)
+
+    def _run_unit_dense(exec: str) -> bool:
+        # no empty row, the pyramid would not skip anything and is not built
+        size = BitmapSize(random.randint(20, 60), random.randint(20, 60))
+        grid = random_grid(size.height, size.width, 0.6)
+        for row in grid:
+            row[random.randrange(size.width)] = 1
+        command = random.choice(["hline", "vline", "square"])
+        return _run_unit(exec, command, grid, False)
+
+    cmd_reference(cmd, "pyramid on block-sparse bitmaps", _run_unit_sparse)
+    cmd_reference(cmd, "pyramid on bitmaps without empty rows", _run_unit_dense)
+
+
+def segment_direction(index: int, angles: int) -> tuple[int, int]:
+    """fixed point direction of a segment, walked downwards (rightwards when
+    horizontal)"""
+
+    def _round(value: float) -> int:  # half away from zero, as llround
+        return int(math.copysign(math.floor(abs(value) + 0.5), value))
+
+    angle = math.pi * index / angles
+    dx, dy = _round(math.cos(angle) * (1 << 20)), _round(math.sin(angle) * (1 << 20))
+    return (-dx, -dy) if dy < 0 or (dy == 0 and dx < 0) else (dx, dy)
+
+
+def segment_offset(index: int, dx: int, dy: int) -> tuple[int, int]:
+    """row and column offset of the `index`-th pixel of a segment"""
+
+    def _shift(num: int, den: int) -> int:
+        magnitude = (index * abs(num) + den // 2) // den
+        return -magnitude if num < 0 else magnitude
+
+    if dy <= abs(dx):
+        return (_shift(dy, abs(dx)), -index if dx < 0 else index)
+    return (index, _shift(dx, dy))
+
+
+def ref_segment(grid: Grid, angles: int) -> str:
+    """every pixel is extended along every direction, pixel `i` of a segment
+    is rounded relative to its start"""
+    height, width = len(grid), len(grid[0])
+    best = None
+    for index in range(angles):
+        dx, dy = segment_direction(index, angles)
+        for y in range(height):
+            for x in range(width):
+                length = 0
+                while True:
+                    row, col = segment_offset(length, dx, dy)
+                    if not (0 <= y + row < height and 0 <= x + col < width):
+                        break
+                    if not grid[y + row][x + col]:
+                        break
+                    length += 1
+                if length == 0:
+                    continue
+                row, col = segment_offset(length - 1, dx, dy)
+                ends = sorted([(y, x), (y + row, x + col)])
+                key = (-length, ends[0], ends[1])
+                best = key if best is None or key < best else best
+    if best is None:
+        return "Not found"
+    return shape_str((*best[1], *best[2]))
+
+
+def cmd_segment(cmd: Command) -> None:
+    def _run_unit(exec: str) -> bool:
+        size = random_size()
+        grid = random_grid(size.height, size.width, random_fill())
+        bmp = bmp_location()
+        write_grid(grid, bmp)
+        return all(
+            [
+                subprocess_evaluate(
+                    [exec, "segment", bmp, "--angles", str(angles)],
+                    ref_segment(grid, angles),
+                )
+                for angles in (1, 2, 3, 8, 16)
+            ]
+        )
+
+    def _run_unit_shifted(exec: str) -> bool:
+        # the same segment has to be found whole wherever it starts
+        angles = random.choice([3, 8, 16])
+        dx, dy = segment_direction(random.randrange(angles), angles)
+        length = random.randint(2, 20)
+        pixels = [segment_offset(i, dx, dy) for i in range(length)]
+        left = -min(col for _, col in pixels)
+        height = max(row for row, _ in pixels) + 1
+        width = max(col for _, col in pixels) + left + 1
+        padding = random.randint(1, 8)
+        passed = True
+        for start in range(padding + 1):
+            grid = [[0] * (width + padding) for _ in range(height)]
+            for row, col in pixels:
+                grid[row][col + left + start] = 1
+            bmp = bmp_location()
+            write_grid(grid, bmp)
+            passed &= subprocess_evaluate(
+                [exec, "segment", bmp, "--angles", str(angles)],
+                ref_segment(grid, angles),
+            )
+        return passed
+
+    cmd_reference(cmd, "'segment' command", _run_unit)
+    cmd_reference(cmd, "'segment' command shifted across columns", _run_unit_shifted)
+
+
+def cmd_expression(cmd: Command) -> None:
+    operators: dict[str, Callable[[list[int]], int]] = {
+        "and": lambda pixels: int(all(pixels)),
+        "or": lambda pixels: int(any(pixels)),
+        "xor": lambda pixels: sum(pixels) % 2,
+    }
+
+    def _random_expression(
+        bmps: list[str], grids: list[Grid], depth: int
+    ) -> tuple[str, Grid]:
+        """random expression of the bitmaps and the grid it evaluates to"""
+        index = random.randrange(len(bmps))
+        if depth == 0 or random.random() < 0.3:
+            return (bmps[index], grids[index])
+        if random.random() < 0.25:
+            text, grid = _random_expression(bmps, grids, depth - 1)
+            return (f"not({text})", [[1 - pixel for pixel in row] for row in grid])
+        name = random.choice(list(operators))
+        args = [
+            _random_expression(bmps, grids, depth - 1)
+            for _ in range(random.randint(2, 3))
+        ]
+        grid = [
+            [
+                operators[name]([arg[1][y][x] for arg in args])
+                for x in range(len(grids[0][0]))
+            ]
+            for y in range(len(grids[0]))
+        ]
+        separator = random.choice([",", ", "])
+        return (f"{name}({separator.join(arg[0] for arg in args)})", grid)
+
+    def _run_unit(exec: str) -> bool:
+        size = random_size()
+        grids, bmps = [], []
+        for _ in range(random.randint(1, 3)):
+            grids.append(random_grid(size.height, size.width, random_fill()))
+            bmps.append(bmp_location())
+            write_grid(grids[-1], bmps[-1])
+        expression, grid = _random_expression(bmps, grids, 3)
+        return all(
+            [
+                subprocess_evaluate(
+                    [exec, command, expression], ref_shape(command, grid)
+                )
+                for command in ("hline", "vline", "square")
+            ]
+        )
+
+    cmd_reference(cmd, "bitmap expressions", _run_unit)
+
+
+def ref_top_squares(grid: Grid, count: int) -> list[Shape]:
+    """the largest square anchored at each pixel, from the largest"""
+    return [
+        shape for _, shape in sorted(ref_squares(grid), key=lambda c: (-c[0], c[1]))
+    ][:count]
+
+
+def ref_disjoint_squares(grid: Grid, count: int) -> list[Shape]:
+    """the largest square, then the largest one of the pixels left, ..."""
+    grid = [list(row) for row in grid]
+    squares = []
+    while len(squares) < count:
+        square = ref_best(ref_squares(grid))
+        if square is None:
+            break
+        squares.append(square)
+        for y in range(square[0], square[2] + 1):
+            grid[y][square[1] : square[3] + 1] = [0] * (square[3] - square[1] + 1)
+    return squares
+
+
+def cmd_top(cmd: Command) -> None:
+    def _run_unit(exec: str) -> bool:
+        size = random_size()
+        grid = random_grid(size.height, size.width, random_fill())
+        bmp = bmp_location()
+        write_grid(grid, bmp)
+        count = random.randint(1, 10)
+        if chance():  # more squares than pixels, every square is printed
+            count = 2**32 - 1
+        return all(
+            [
+                subprocess_evaluate(
+                    [exec, "square", bmp, "--top", str(count)] + options,
+                    "\n".join(map(shape_str, reference(grid, count))) or "Not found",
+                )
+                for options, reference in (
+                    ([], ref_top_squares),
+                    (["--disjoint"], ref_disjoint_squares),
+                )
+            ]
+        )
+
+    cmd_reference(cmd, "--top and --disjoint", _run_unit)
+
+
+def cmd_mosaic(cmd: Command) -> None:
+    def _cuts(length: int) -> list[int]:
+        return sorted({0, length} | {random.randrange(length) for _ in range(2)})
+
+    def _run_unit(exec: str) -> bool:
+        height, width = random.randint(1, 30), random.randint(1, 30)
+        grid = [[0] * width for _ in range(height)]
+        manifest = bmp_location()
+        lines = []
+        rows, cols = _cuts(height), _cuts(width)
+        for top, bottom in zip(rows, rows[1:]):
+            for left, right in zip(cols, cols[1:]):
+                if random.random() < 0.2:  # pixels of missing tiles are empty
+                    continue
+                tile = random_grid(bottom - top, right - left, random_fill())
+                for y, row in enumerate(tile):
+                    grid[top + y][left:right] = row
+                # tile paths are relative to the manifest
+                name = f"{os.path.basename(manifest)}_{top}_{left}"
+                write_grid(tile, f"{os.path.dirname(manifest)}/{name}")
+                lines.append(f"{top} {left} {name}")
+        random.shuffle(lines)
+        overlapping = chance() and len(lines) > 0
+        if overlapping:
+            lines.append(lines[0])  # the same tile placed twice
+        with open(manifest, "w+") as file:
+            file.write(f"mosaic {height} {width}\n")
+            file.writelines(line + "\n" for line in lines)
+        if overlapping:
+            return subprocess_check(
+                [exec, "hline", manifest],
+                lambda output: output.endswith("overlap!"),
+                "tiles overlap",
+            )
+        return all(
+            [
+                subprocess_evaluate([exec, command, manifest], ref_shape(command, grid))
+                for command in ("hline", "vline", "square")
+            ]
+        )
+
+    cmd_reference(cmd, "mosaic manifests", _run_unit)
+
+
+def cmd_index(cmd: Command) -> None:
+    def _query(exec: str, directory: str, index: str, grids: dict[str, Grid]) -> bool:
+        minimums = {
+            command: random.randint(1, 6)
+            for command in random.sample(
+                ["hline", "vline", "square"], random.randint(1, 3)
+            )
+        }
+        any_passes = chance()
+        passing = []
+        for name, grid in sorted(grids.items()):
+            passes = [
+                max((size for size, _ in REFERENCES[command](grid)), default=0)
+                >= minimum
+                for command, minimum in minimums.items()
+            ]
+            if any(passes) if any_passes else all(passes):
+                passing.append(f"{directory}/{name}")
+        options = [f"--{command}={minimum}" for command, minimum in minimums.items()]
+        return subprocess_evaluate(
+            [exec, "index", "query", index]
+            + options
+            + (["--any"] if any_passes else []),
+            "\n".join(passing),
+        )
+
+    def _run_unit(exec: str) -> bool:
+        # the index is built over a whole directory, pics holds files only
+        with tempfile.TemporaryDirectory() as directory:
+            grids = {}
+            for i in range(random.randint(1, 5)):
+                size = random_size()
+                grids[f"bmp_{i}"] = random_grid(size.height, size.width, random_fill())
+                write_grid(grids[f"bmp_{i}"], f"{directory}/bmp_{i}")
+            index = f"{bmp_location()}.index"
+            passed = subprocess_evaluate([exec, "index", "build", directory, index], "")
+            passed &= _query(exec, directory, index, grids)
+            # a changed file is summarized again by the next build
+            name = random.choice(list(grids))
+            size = BitmapSize(len(grids[name]) + 1, random.randint(1, 12))
+            grids[name] = random_grid(size.height, size.width, random_fill())
+            write_grid(grids[name], f"{directory}/{name}")
+            passed &= subprocess_evaluate(
+                [exec, "index", "build", directory, index], ""
+            )
+            return passed and _query(exec, directory, index, grids)
+
+    cmd_reference(cmd, "'index' command", _run_unit)
+
+
+def ref_is_witness(command: str, grid: Grid, shape: Shape, minimum: int) -> bool:
+    """whether `shape` is a whole line (a square frame) of at least `minimum`"""
+    if command != "square":
+        return any(
+            size >= minimum and candidate == shape
+            for size, candidate in REFERENCES[command](grid)
+        )
+    y, x, y2, x2 = shape
+    side = x2 - x + 1
+    if y2 - y != x2 - x or side < minimum or y2 >= len(grid) or x2 >= len(grid[0]):
+        return False
+    right, down = runs_right(grid), runs_down(grid)
+    return min(right[y][x], down[y][x], right[y2][x], down[y][x2]) >= side
+
+
+def cmd_at_least(cmd: Command) -> None:
+    def _check(command: str, grid: Grid, minimum: int, output: str) -> bool:
+        largest = max((size for size, _ in REFERENCES[command](grid)), default=0)
+        if largest < minimum:
+            return output == "Not found"
+        try:
+            shape = tuple(map(int, output.split()))
+        except ValueError:
+            return False
+        return len(shape) == 4 and ref_is_witness(command, grid, shape, minimum)
+
+    def _run_unit(exec: str) -> bool:
+        size = random_size()
+        grid = random_grid(size.height, size.width, random_fill())
+        bmp = bmp_location()
+        write_grid(grid, bmp)
+        minimum = random.randint(1, 8)
+        engine = random.choice(ENGINES)
+        # any shape of at least the minimum may be printed
+        return all(
+            [
+                subprocess_check(
+                    [
+                        exec,
+                        command,
+                        bmp,
+                        "--at-least",
+                        str(minimum),
+                        "--engine",
+                        engine,
+                    ],
+                    lambda output: _check(command, grid, minimum, output),
+                    f"{command} of at least {minimum}",
+                )
+                for command in ("hline", "vline", "square")
+            ]
+        )
+
+    cmd_reference(cmd, "--at-least", _run_unit)
+
+
+MEMORY_LINE = re.compile(
+    r"memory: (\w+) (\d+) allocations, (\d+) bytes, "
+    r"peak (\d+) bytes live, largest (\d+) bytes"
+)
+
+
+def cmd_stats(cmd: Command) -> None:
+    def _check(output: str) -> bool:
+        phases = {
+            match[0]: tuple(map(int, match[1:]))
+            for match in MEMORY_LINE.findall(output)
+        }
+        return all(
+            phase in phases
+            and all(count > 0 for count in phases[phase])
+            and phases[phase][2] >= phases[phase][3]
+            for phase in ("load", "search")
+        )
+
+    def _run_unit(exec: str) -> bool:
+        # the bitmap is loaded to the heap and the engine builds its structures
+        size = BitmapSize(random.randint(50, 90), random.randint(50, 90))
+        grid = random_grid(size.height, size.width, random_fill())
+        bmp = bmp_location()
+        write_grid(grid, bmp)
+        command = random.choice(["hline", "vline", "square"])
+        engine = random.choice(["dedup", "tiled", "sat", "runs"])
+        run_exec = [exec, command, bmp, "--stats", "--engine", engine]
+        print_unit_test_fmt(run_exec)
+        ret = subprocess.run(run_exec, capture_output=True, text=True)
+        if ret.stdout.strip() == ref_shape(command, grid) and _check(ret.stderr):
+            print(f"Test \x1b[33mpassed\x1b[0m!")
+            return True
+        print(
+            f"Test \x1b[31mfailed\x1b[0m! Expected: memory of load and search phases; but received: {ret.stderr.strip()}"
+        )
+        input("Press any key to continue...")
+        return False
+
+    cmd_reference(cmd, "--stats memory counters", _run_unit)
+
+
+def ref_diamond(grid: Grid) -> str:
+    """the largest hollow diamond (`side` pixels on each of its diagonal
+    sides), printed as its top and bottom vertex"""
+
+    def _filled(y: int, x: int) -> bool:
+        return 0 <= y < len(grid) and 0 <= x < len(grid[0]) and grid[y][x] == 1
+
+    candidates = []
+    for y in range(len(grid)):
+        for x in range(len(grid[0])):
+            for side in range(len(grid), 0, -1):
+                edge = side - 1
+                if all(
+                    _filled(y + i, x - i)
+                    and _filled(y + i, x + i)
+                    and _filled(y + edge + i, x - edge + i)
+                    and _filled(y + edge + i, x + edge - i)
+                    for i in range(side)
+                ):
+                    candidates.append((side, (y, x, y + 2 * edge, x)))
+                    break
+    return shape_str(ref_best(candidates))
+
+
+def cmd_diamond(cmd: Command) -> None:
+    def _run_unit(exec: str) -> bool:
+        size = random_size()
+        grid = random_grid(size.height, size.width, random_fill())
+        if chance():  # random bitmaps rarely hold a diamond larger than a pixel
+            y, x = random.randrange(size.height), random.randrange(size.width)
+            edge = random.randint(1, 5)
+            for i in range(edge + 1):
+                for row, col in (
+                    (y + i, x - i),
+                    (y + i, x + i),
+                    (y + edge + i, x - edge + i),
+                    (y + edge + i, x + edge - i),
+                ):
+                    if 0 <= row < size.height and 0 <= col < size.width:
+                        grid[row][col] = 1
+        bmp = bmp_location()
+        write_grid(grid, bmp)
+        return subprocess_evaluate([exec, "diamond", bmp], ref_diamond(grid))
+
+    cmd_reference(cmd, "'diamond' command", _run_unit)
+
+
+def ref_bar(command: str, grid: Grid, thickness: int) -> str:
+    """the longest line of the pixels filled in all of `thickness` consecutive
+    rows (hline) or columns (vline), printed as the corners of the bar"""
+    transposed = command == "vline"
+    if transposed:
+        grid = [list(column) for column in zip(*grid)]
+    candidates = []
+    for top in range(len(grid) - thickness + 1):
+        window = [[int(all(pixels)) for pixels in zip(*grid[top : top + thickness])]]
+        for length, (_, x, _, x2) in ref_hlines(window):
+            bar = (top, x, top + thickness - 1, x2)
+            candidates.append((length, (x, top, x2, bar[2]) if transposed else bar))
+    return shape_str(ref_best(candidates))
+
+
+def cmd_thickness(cmd: Command) -> None:
+    def _run_unit(exec: str) -> bool:
+        size = random_size()
+        if chance():  # bars are searched in packed rows of 64-bit words
+            size = BitmapSize(random.randint(60, 140), random.randint(60, 140))
+        grid = random_grid(size.height, size.width, random_fill())
+        bmp = bmp_location()
+        write_grid(grid, bmp)
+        thickness = random.randint(1, 4)
+        return all(
+            [
+                subprocess_evaluate(
+                    [exec, command, bmp, "--thickness", str(thickness)],
+                    ref_bar(command, grid, thickness),
+                )
+                for command in ("hline", "vline")
+            ]
+        )
+
+    cmd_reference(cmd, "--thickness", _run_unit)
+
+
+def cmd_compare(cmd: Command) -> None:
+    def _check(output: str, expected: str) -> bool:
+        lines = output.splitlines()
+        if len(lines) < 3 or not lines[-1].startswith("fastest: "):
+            return False
+        engines = []
+        for line in lines[1:-1]:
+            # engine, time [ms], status and the shape it found
+            fields = line.split(maxsplit=3)
+            if len(fields) != 4 or fields[2] != "ok" or fields[3] != expected:
+                return False
+            engines.append(fields[0])
+        return set(ENGINES) <= set(engines) and lines[-1][9:] in engines
+
+    def _run_unit(exec: str) -> bool:
+        size = random_size()
+        grid = random_grid(size.height, size.width, random_fill())
+        bmp = bmp_location()
+        write_grid(grid, bmp)
+        return all(
+            [
+                subprocess_check(
+                    [exec, command, bmp, "--engine=all", "--compare"],
+                    lambda output: _check(output, ref_shape(command, grid)),
+                    f"every engine finding {ref_shape(command, grid)}",
+                )
+                for command in ("hline", "vline", "square")
+            ]
+        )
+
+    cmd_reference(cmd, "--compare", _run_unit)
+
+
+def cmd_timeout(cmd: Command) -> None:
+    def _run_unit(exec: str) -> bool:
+        size = random_size()
+        grid = random_grid(size.height, size.width, random_fill())
+        bmp = bmp_location()
+        write_grid(grid, bmp)
+        engine = random.choice(["rowmajor", "sat"])
+        return all(
+            [
+                subprocess_evaluate(
+                    [exec, command, bmp, "--timeout", "60000", "--engine", engine],
+                    ref_shape(command, grid),
+                )
+                for command in ("hline", "vline", "square")
+            ]
+        )
+
+    def _run_unit_expired(exec: str) -> bool:
+        # loading alone takes longer, engines which cannot be cancelled
+        # finish but their result is dropped
+        size = 1000
+        bmp = bmp_location()
+        write_grid(random_grid(size, size, 0.9), bmp)
+        engine = random.choice(["rowmajor", "skip", "sat", "packed"])
+        return subprocess_evaluate(
+            [exec, "square", bmp, "--timeout", "1", "--engine", engine],
+            "Search timed out after 1 ms!",
+        )
+
+    def _run_unit_planned(exec: str) -> bool:
+        # queries of a plan share a worker, none of them can be timed
+        bmp = bmp_location()
+        write_grid(random_grid(2, 2, 1.0), bmp)
+        lines = [f"{bmp} hline"] * random.randint(0, 3)
+        lines.append(f"{bmp} square --timeout 100")
+        plan = f"{bmp}.plan"
+        with open(plan, "w+") as file:
+            file.writelines(line + "\n" for line in lines)
+        return subprocess_evaluate(
+            [exec, "run", plan],
+            f"Plan line {len(lines)}: option [--timeout] cannot be planned!",
+        )
+
+    cmd_reference(cmd, "--timeout", _run_unit)
+    cmd_reference(cmd, "--timeout expiring", _run_unit_expired)
+    cmd_reference(cmd, "--timeout in plans", _run_unit_planned)
+
+
+CORNERS_LINE = re.compile(r"^corners: .*$", re.MULTILINE)
+
+
+def ref_corners(grid: Grid) -> tuple[int, int]:
+    """number of top-left corners (filled with the right and the lower
+    neighbour filled too) and number of filled pixels"""
+    height, width = len(grid), len(grid[0])
+    corners = sum(
+        1
+        for y in range(height - 1)
+        for x in range(width - 1)
+        if grid[y][x] and grid[y][x + 1] and grid[y + 1][x]
+    )
+    return (corners, sum(map(sum, grid)))
+
+
+def cmd_corners(cmd: Command) -> None:
+    def _check(exec: str, grid: Grid) -> bool:
+        bmp = bmp_location()
+        write_grid(grid, bmp)
+        corners, filled = ref_corners(grid)
+        # an empty bitmap has no anchor, its masks are never built, masks
+        # keeping over 3/4 of the filled pixels are dropped
+        expected = []
+        if filled > 0:
+            walked = ", every filled pixel walked" if corners * 4 > filled * 3 else ""
+            expected.append(
+                f"corners: {corners} top-left corners out of {filled} filled pixels{walked}"
+            )
+        run_exec = [exec, "square", bmp, "--stats"]
+        print_unit_test_fmt(run_exec)
+        ret = subprocess.run(run_exec, capture_output=True, text=True)
+        found = CORNERS_LINE.findall(ret.stderr)
+        if ret.stdout.strip() == ref_shape("square", grid) and found == expected:
+            print(f"Test \x1b[33mpassed\x1b[0m!")
+            return True
+        print(
+            f"Test \x1b[31mfailed\x1b[0m! Expected: {expected}; but received: {ret.stderr.strip()}"
+        )
+        input("Press any key to continue...")
+        return False
+
+    def _run_unit(exec: str) -> bool:
+        size = random_size()
+        if chance():  # masks are built from packed rows of 64-bit words
+            size = BitmapSize(random.randint(60, 140), random.randint(60, 140))
+        return _check(exec, random_grid(size.height, size.width, random_fill()))
+
+    def _run_unit_dense(exec: str) -> bool:
+        size = BitmapSize(random.randint(20, 140), random.randint(20, 140))
+        fill = random.choice([0.95, 0.99, 1.0])
+        return _check(exec, random_grid(size.height, size.width, fill))
+
+    cmd_reference(cmd, "--stats corner masks", _run_unit)
+    cmd_reference(cmd, "--stats corner masks of dense bitmaps", _run_unit_dense)
+
+
 def prepare() -> None:
     if os.path.exists(f"{curr_dir()}/pics"):
         for filename in os.listdir(f"{curr_dir()}/pics"):
@@ -599,3 +1605,22 @@ if __name__ == "__main__":
     cmd_hline(cmd)
     cmd_vline(cmd)
     cmd_square(cmd)
+    cmd_pgm(cmd)
+    cmd_engines(cmd)
+    cmd_density(cmd)
+    cmd_run(cmd)
+    cmd_memory_cap(cmd)
+    cmd_ties(cmd)
+    cmd_pyramid(cmd)
+    cmd_segment(cmd)
+    cmd_expression(cmd)
+    cmd_top(cmd)
+    cmd_mosaic(cmd)
+    cmd_index(cmd)
+    cmd_at_least(cmd)
+    cmd_stats(cmd)
+    cmd_diamond(cmd)
+    cmd_thickness(cmd)
+    cmd_compare(cmd)
+    cmd_timeout(cmd)
+    cmd_corners(cmd)